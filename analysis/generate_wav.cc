@@ -22,24 +22,25 @@
 namespace ringli {
 
 std::string GenerateWav(const std::vector<Waveform>& waveforms,
-                        float sample_rate, float seconds, float noise) {
+                        float sample_rate, float seconds, float noise,
+                        size_t num_channels) {
   const size_t num_samples = static_cast<size_t>(sample_rate * seconds);
   const float period = 1.0f / sample_rate;
-  std::vector<int16_t> samples(num_samples);
+  std::vector<int16_t> samples(num_samples * num_channels);
   std::srand(0);
   const float rand_max_reciprocal =
       2 * std::numeric_limits<int16_t>::max() / static_cast<float>(RAND_MAX);
-  for (size_t i = 0; i < num_samples; ++i) {
-    const float t = i * period;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const float t = (i / num_channels) * period;
+    const float phase_shift = i % num_channels;
     samples[i] = noise * (std::rand() - RAND_MAX * 0.5) * rand_max_reciprocal;
     for (const auto& waveform : waveforms) {
-      samples[i] +=
-          std::sin(t * 2 * M_PI * waveform.frequency + waveform.phase) *
-          (std::numeric_limits<int16_t>::max() * waveform.amplitude);
+      samples[i] += std::sin(t * 2 * M_PI * waveform.frequency +
+                             waveform.phase + phase_shift) *
+                    (std::numeric_limits<int16_t>::max() * waveform.amplitude);
     }
   }
   const size_t data_size = samples.size() * sizeof(int16_t);
-  const size_t num_channels = 1;
   std::string wav_data;
   WavHeader wav_header;
   // RIFF chunk
@@ -50,7 +51,7 @@ std::string GenerateWav(const std::vector<Waveform>& waveforms,
   memcpy(wav_header.format_chunk.format_chunk_id, "fmt ", 4);
   wav_header.format_chunk.format_chunk_size = 16;
   wav_header.format_chunk.audio_format = 1;
-  wav_header.format_chunk.number_of_channels = 1;
+  wav_header.format_chunk.number_of_channels = num_channels;
   wav_header.format_chunk.sampling_frequency = sample_rate;
   wav_header.format_chunk.byte_rate =
       num_channels * sample_rate * sizeof(int16_t);
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stddef.h>
+
 #include <string>
 #include <vector>
 #ifndef ANALYSIS_GENERATE_WAV_H_
@@ -25,8 +27,11 @@ struct Waveform {
   float phase = 0;
 };
 
+// Returns the wav file of the sum of the waveforms and uniform noise. With more
+// than one channel, the phases of the waveforms are shifted by channel.
 std::string GenerateWav(const std::vector<Waveform>& waveforms,
-                        float sample_rate, float seconds, float noise);
+                        float sample_rate, float seconds, float noise,
+                        size_t num_channels = 1);
 
 }  // namespace ringli
 
@@ -0,0 +1,144 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks that the streaming modes do not allocate memory for every block.
+// The global allocation functions are replaced in this file to count the
+// allocations, which only adds a counter to the rest of the test binary.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_split.h"
+#include "analysis/generate_wav.h"
+#include "analysis/ringli_codec.h"
+#include "common/data_defs/constants.h"
+#include "common/streaming.h"
+#include "gtest/gtest.h"
+
+namespace {
+std::atomic<size_t> num_allocations{0};
+}  // namespace
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* ptr = malloc(std::max<size_t>(size, 1));
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+namespace ringli {
+namespace {
+
+constexpr size_t kNumChannels = 2;
+// The encoder gets one block of samples at a time, the decoder gets the
+// compressed data in chunks that are shorter than most blocks.
+constexpr size_t kEncoderChunkSize =
+    kRingliBlockSize * kNumChannels * sizeof(int16_t);
+constexpr size_t kDecoderChunkSize = 256;
+
+// Feeds input[begin, end) to processor in chunks of chunk_size bytes and reads
+// back its output, returns the number of chunks that allocated memory.
+size_t NumAllocatingChunks(StreamingInterface* processor,
+                           const std::string& input, size_t begin, size_t end,
+                           size_t chunk_size) {
+  std::vector<uint8_t> output(input.size() * 4);
+  size_t num_allocating_chunks = 0;
+  for (size_t pos = begin; pos < end; pos += chunk_size) {
+    const size_t len = std::min(chunk_size, end - pos);
+    const size_t start_count = num_allocations;
+    EXPECT_TRUE(processor->ProcessInput(
+        reinterpret_cast<const uint8_t*>(&input[pos]), len));
+    processor->CopyOutput(output.data(), output.size());
+    if (num_allocations != start_count) ++num_allocating_chunks;
+  }
+  return num_allocating_chunks;
+}
+
+class RingliAllocationTest : public testing::TestWithParam<std::string> {
+ protected:
+  RingliAllocationTest() {
+    const std::vector<std::string> codec_params =
+        absl::StrSplit(GetParam(), ':');
+    EXPECT_TRUE(codec_.ParseParams(codec_params));
+    input_ = GenerateWav({{.frequency = 150.0, .amplitude = 0.5},
+                          {.frequency = 5100.0, .amplitude = 0.2}},
+                         48000.0, 4.0, 0.05, kNumChannels);
+  }
+
+  StreamingRingliCodec codec_;
+  std::string input_;
+};
+
+// The segmented modes are not listed, they build the entropy codes of every
+// segment.
+INSTANTIATE_TEST_SUITE_P(RingliStreamingModes, RingliAllocationTest,
+                         testing::Values("ringli:qc(0;7)",
+                                         "ringli:qc(0;7):t2",
+                                         "ringli:aconly:qc(0;7)",
+                                         "ringli:pc:o2-16:e5:q1",
+                                         "ringli:pc:o2-8:e5:q7",
+                                         "ringli:pc:o2-8:e5:q7:t2",
+                                         "ringli:pc:aconly:o2-8:e5:q7",
+                                         "ringli:apc:e5:q3",
+                                         "ringli:apc:aconly:e5:q3",
+                                         "ringli:apc:aconly:ns:e5:q3"));
+
+TEST_P(RingliAllocationTest, EncoderDoesNotAllocatePerBlock) {
+  StreamingInterface* encoder = codec_.encoder();
+  encoder->Reset();
+  // The first half of the input allocates the buffers of the encoder.
+  const size_t half = input_.size() / 2;
+  NumAllocatingChunks(encoder, input_, 0, half, kEncoderChunkSize);
+  EXPECT_EQ(NumAllocatingChunks(encoder, input_, half, input_.size(),
+                                kEncoderChunkSize),
+            0);
+  EXPECT_TRUE(encoder->Flush());
+}
+
+// The arithmetic-only modes decode while the input arrives, the other modes
+// decode the whole stream in Flush(), or a whole segment at a time.
+class RingliStreamingDecoderAllocationTest : public RingliAllocationTest {};
+
+INSTANTIATE_TEST_SUITE_P(RingliFullyStreamingModes,
+                         RingliStreamingDecoderAllocationTest,
+                         testing::Values("ringli:aconly:qc(0;7)",
+                                         "ringli:pc:aconly:o2-8:e5:q7",
+                                         "ringli:apc:aconly:e5:q3",
+                                         "ringli:apc:aconly:e5:q1"));
+
+TEST_P(RingliStreamingDecoderAllocationTest, DecoderDoesNotAllocatePerBlock) {
+  std::string compressed;
+  ASSERT_TRUE(codec_.Compress(input_, &compressed));
+  StreamingInterface* decoder = codec_.decoder();
+  decoder->Reset();
+  const size_t half = compressed.size() / 2;
+  NumAllocatingChunks(decoder, compressed, 0, half, kDecoderChunkSize);
+  EXPECT_EQ(NumAllocatingChunks(decoder, compressed, half, compressed.size(),
+                                kDecoderChunkSize),
+            0);
+  EXPECT_TRUE(decoder->Flush());
+}
+
+}  // namespace
+}  // namespace ringli
@@ -21,6 +21,7 @@
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/substitute.h"
+#include "common/ans_params.h"
 #include "common/ringli_header.h"
 #include "common/segment_curve.h"
 #include "encode/ringli_encoder.h"
@@ -59,6 +60,14 @@ bool ParseParam(const std::string& param, RingliEncoderConfig& config) {
   } else if (param == "aq") {
     config.dconfig.pred_quant = 1;
     config.dconfig.use_adaptive_quantization = true;
+  } else if (param == "ep") {
+    // The presets are ANS codes of the predictive modes.
+    if (config.dconfig.use_predictive_coding &&
+        !config.dconfig.ecparams.arithmetic_only) {
+      config.dconfig.ecparams.entropy_presets = 1;
+    } else {
+      return false;
+    }
   } else if (param[0] == 'e') {
     config.dconfig.effort = std::stoi(param.substr(1));
   } else if (param == "pc") {
@@ -72,6 +81,59 @@ bool ParseParam(const std::string& param, RingliEncoderConfig& config) {
     config.use_noise_shaping = true;
   } else if (param == "nf") {
     config.dconfig.use_noise_filter = true;
+  } else if (param[0] == 's') {
+    config.dconfig.ecparams.segment_size = std::stoi(param.substr(1));
+  } else if (param[0] == 'i') {
+    const int num_ans_states = std::stoi(param.substr(1));
+    if (num_ans_states < 1 || num_ans_states > kMaxANSStates ||
+        (num_ans_states & (num_ans_states - 1)) != 0) {
+      return false;
+    }
+    config.dconfig.ecparams.num_ans_states = num_ans_states;
+  } else if (param == "cs") {
+    // Only the segmented predictive streams have channel substreams.
+    if (config.dconfig.use_predictive_coding &&
+        !(config.dconfig.use_online_predictive_coding &&
+          config.dconfig.ecparams.arithmetic_only)) {
+      config.dconfig.ecparams.channel_substreams = 1;
+    } else {
+      return false;
+    }
+  } else if (param == "g") {
+    config.dconfig.ecparams.gamma_symbols = 1;
+  } else if (param == "rc") {
+    // Only the fully streaming mode has a range coder.
+    if (config.dconfig.use_online_predictive_coding &&
+        config.dconfig.ecparams.arithmetic_only) {
+      config.dconfig.ecparams.range_coding = 1;
+    } else {
+      return false;
+    }
+  } else if (param == "ac64") {
+    // The DCT mode always uses the 16-bit arithmetic coder.
+    if (config.dconfig.use_predictive_coding &&
+        config.dconfig.ecparams.arithmetic_only) {
+      config.dconfig.ecparams.wide_arithmetic_coding = 1;
+    } else {
+      return false;
+    }
+  } else if (param == "bb") {
+    // The DCT mode writes the extra bits with the bit writer.
+    if (config.dconfig.use_predictive_coding &&
+        config.dconfig.ecparams.arithmetic_only) {
+      config.dconfig.ecparams.bypass_bits = 1;
+    } else {
+      return false;
+    }
+  } else if (param[0] == 'k') {
+    // The fully streaming mode has no segments to seek to.
+    if (config.dconfig.use_online_predictive_coding &&
+        config.dconfig.ecparams.arithmetic_only) {
+      return false;
+    }
+    config.dconfig.ecparams.seek_interval = std::stoi(param.substr(1));
+  } else if (param[0] == 't') {
+    config.num_threads = std::stoi(param.substr(1));
   } else {
     return false;
   }
@@ -106,6 +168,39 @@ std::string ConfigToString(const RingliEncoderConfig& config) {
     if (config.dconfig.use_adaptive_quantization) {
       result.push_back("aq");
     }
+    if (config.dconfig.ecparams.segment_size > 0) {
+      result.push_back(
+          absl::Substitute("s$0", config.dconfig.ecparams.segment_size));
+    }
+    if (config.dconfig.ecparams.seek_interval > 0) {
+      result.push_back(
+          absl::Substitute("k$0", config.dconfig.ecparams.seek_interval));
+    }
+    if (config.dconfig.ecparams.channel_substreams) {
+      result.push_back("cs");
+    }
+    if (config.dconfig.ecparams.gamma_symbols) {
+      result.push_back("g");
+    }
+    if (config.dconfig.ecparams.range_coding) {
+      result.push_back("rc");
+    }
+    if (config.dconfig.ecparams.wide_arithmetic_coding) {
+      result.push_back("ac64");
+    }
+    if (config.dconfig.ecparams.bypass_bits) {
+      result.push_back("bb");
+    }
+    if (config.dconfig.ecparams.entropy_presets) {
+      result.push_back("ep");
+    }
+    if (config.dconfig.ecparams.num_ans_states > 1) {
+      result.push_back(
+          absl::Substitute("i$0", config.dconfig.ecparams.num_ans_states));
+    }
+    if (config.num_threads > 0) {
+      result.push_back(absl::Substitute("t$0", config.num_threads));
+    }
   } else if (config.dconfig.use_predictive_coding &&
              config.dconfig.use_online_predictive_coding) {
     result.push_back(absl::Substitute("q$0", config.dconfig.pred_quant));
@@ -127,6 +222,24 @@ std::string ConfigToString(const RingliEncoderConfig& config) {
     }
     result.push_back(absl::StrCat("q", quantization_type,
                                   config.quantization_curve.ToString()));
+    if (config.dconfig.ecparams.segment_size > 0) {
+      result.push_back(
+          absl::Substitute("s$0", config.dconfig.ecparams.segment_size));
+    }
+    if (config.dconfig.ecparams.seek_interval > 0) {
+      result.push_back(
+          absl::Substitute("k$0", config.dconfig.ecparams.seek_interval));
+    }
+    if (config.dconfig.ecparams.gamma_symbols) {
+      result.push_back("g");
+    }
+    if (config.dconfig.ecparams.num_ans_states > 1) {
+      result.push_back(
+          absl::Substitute("i$0", config.dconfig.ecparams.num_ans_states));
+    }
+    if (config.num_threads > 0) {
+      result.push_back(absl::Substitute("t$0", config.num_threads));
+    }
   }
   return absl::StrJoin(result, ":");
 }
@@ -35,7 +35,7 @@ class StreamingRingliCodec : public StreamingAudioCodec {
   }
   StreamingInterface* decoder() override {
     if (!decoder_) {
-      decoder_ = std::make_unique<StreamingRingliDecoder>();
+      decoder_ = std::make_unique<StreamingRingliDecoder>(config_.num_threads);
     }
     return decoder_.get();
   }
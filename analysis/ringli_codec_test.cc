@@ -14,11 +14,15 @@
 
 #include "analysis/ringli_codec.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
@@ -26,7 +30,14 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "analysis/generate_wav.h"
+#include "common/data_defs/constants.h"
 #include "common/error_norm.h"
+#include "common/ringli_header.h"
+#include "common/wav_header.h"
+#include "common/wav_writer.h"
+#include "decode/entropy_decode.h"
+#include "decode/ringli_decoder.h"
+#include "encode/ringli_encoder.h"
 #include "gtest/gtest.h"
 
 namespace ringli {
@@ -56,8 +67,23 @@ INSTANTIATE_TEST_SUITE_P(
     RingliParseParams, RingliCodecParamTest,
     testing::Values(RingliTestParams{"ringli:qc(0;7)"},
                     RingliTestParams{"ringli:pc:o4-28:e7:q7"},
+                    RingliTestParams{"ringli:pc:o2-16:e3:q1"},
                     RingliTestParams{"ringli:apc:e7:q3"},
-                    RingliTestParams{"ringli:aconly:qc(0;7)"}));
+                    RingliTestParams{"ringli:aconly:qc(0;7)"},
+                    RingliTestParams{"ringli:qc(0;7):t4"},
+                    RingliTestParams{"ringli:pc:o2-8:e5:q1:t4"},
+                    RingliTestParams{"ringli:qc(0;7):s8"},
+                    RingliTestParams{"ringli:pc:o2-8:e5:q1:s16"},
+                    RingliTestParams{"ringli:qc(0;7):s8:k4"},
+                    RingliTestParams{"ringli:pc:o2-8:e5:q1:s16:cs"},
+                    RingliTestParams{"ringli:qc(0;7):i4"},
+                    RingliTestParams{"ringli:pc:o2-8:e5:q1:s16:i8"},
+                    RingliTestParams{"ringli:aconly:qc(0;7):g"},
+                    RingliTestParams{"ringli:pc:o2-8:aconly:e5:q1:g"},
+                    RingliTestParams{"ringli:apc:aconly:e7:q3:rc"},
+                    RingliTestParams{"ringli:pc:o2-8:aconly:e5:q1:ac64"},
+                    RingliTestParams{"ringli:apc:aconly:e5:q1:bb"},
+                    RingliTestParams{"ringli:pc:o2-8:e5:q1:s16:ep"}));
 
 TEST_P(RingliCodecParamTest, CanParseParams) {
   StreamingRingliCodec codec;
@@ -71,6 +97,464 @@ TEST_P(RingliCodecParamTest, CanParseParams) {
   EXPECT_EQ(codec.ToString(), codec_params_string);
 }
 
+// The flags that the selected mode would ignore are rejected, since the
+// ignored flags would not round trip through ToString().
+TEST(RingliCodecTest, RejectsFlagsOfOtherModes) {
+  for (const char* params : {
+           // The range coder of the fully streaming mode.
+           "ringli:qc(0;7):rc",
+           "ringli:aconly:qc(0;7):rc",
+           "ringli:pc:o2-8:e5:q1:rc",
+           "ringli:pc:aconly:o2-8:e5:q1:rc",
+           "ringli:apc:e5:q3:rc",
+           // The arithmetic coded extra bits of the predictive modes.
+           "ringli:qc(0;7):bb",
+           "ringli:aconly:qc(0;7):bb",
+           "ringli:pc:o2-8:e5:q1:bb",
+           "ringli:apc:e5:q3:bb",
+           // The 64-bit arithmetic coder of the predictive modes.
+           "ringli:qc(0;7):ac64",
+           "ringli:aconly:qc(0;7):ac64",
+           "ringli:pc:o2-8:e5:q1:ac64",
+           "ringli:apc:e5:q3:ac64",
+           // The ANS code presets of the predictive modes.
+           "ringli:qc(0;7):ep",
+           "ringli:aconly:qc(0;7):ep",
+           "ringli:pc:aconly:o2-8:e5:q1:ep",
+           "ringli:apc:aconly:e5:q3:ep",
+           // The channel substreams of the segmented predictive streams.
+           "ringli:qc(0;7):s8:cs",
+           "ringli:aconly:qc(0;7):s8:cs",
+           "ringli:apc:aconly:e5:q3:cs",
+           // The seek points of the segmented streams.
+           "ringli:apc:aconly:e5:q3:k4",
+           "ringli:apc:aconly:e5:q3:rc:k1",
+       }) {
+    StreamingRingliCodec codec;
+    const std::vector<std::string> codec_params = absl::StrSplit(params, ':');
+    EXPECT_FALSE(codec.ParseParams(codec_params)) << params;
+  }
+}
+
+// One second of two sinusoids with some noise in each channel.
+std::string TestInput(size_t num_channels = 1) {
+  return GenerateWav({{.frequency = 150.0, .amplitude = 0.5},
+                      {.frequency = 5100.0, .amplitude = 0.2}},
+                     48000.0, 1.0, 0.05, num_channels);
+}
+
+std::string CompressWithParams(const std::string& codec_params_string,
+                               const std::string& input) {
+  StreamingRingliCodec codec;
+  const std::vector<std::string> codec_params =
+      absl::StrSplit(codec_params_string, ':');
+  EXPECT_TRUE(codec.ParseParams(codec_params));
+  std::string compressed;
+  EXPECT_TRUE(codec.Compress(input, &compressed));
+  return compressed;
+}
+
+TEST(RingliCodecTest, ThreadedEncodingGivesIdenticalOutput) {
+  const std::string input = TestInput();
+  for (const auto& [params, threads] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"ringli:qc(0;7)", ":t4"},
+           {"ringli:aconly:qb(0;1);(1000;300)", ":t1"},
+           {"ringli:pc:o2-16:e5:q1", ":t4"},
+           {"ringli:pc:aconly:o2-8:e5:q7", ":t2"},
+           {"ringli:apc:e7:q3", ":t3"}}) {
+    StreamingRingliCodec codec;
+    const std::vector<std::string> codec_params =
+        absl::StrSplit(params + threads, ':');
+    EXPECT_TRUE(codec.ParseParams(codec_params));
+    std::string compressed;
+    EXPECT_TRUE(codec.Compress(input, &compressed));
+    EXPECT_EQ(CompressWithParams(params, input), compressed) << params;
+    // The blocks were encoded on the worker threads.
+    const auto* encoder =
+        static_cast<const StreamingRingliEncoder*>(codec.encoder());
+    EXPECT_GT(encoder->NumThreadedTasks(), 0) << params;
+  }
+}
+
+std::string DecompressWithParams(const std::string& codec_params_string,
+                                 const std::string& compressed) {
+  StreamingRingliCodec codec;
+  const std::vector<std::string> codec_params =
+      absl::StrSplit(codec_params_string, ':');
+  EXPECT_TRUE(codec.ParseParams(codec_params));
+  std::string output;
+  EXPECT_TRUE(codec.Decompress(compressed, &output));
+  return output;
+}
+
+// Like DecompressWithParams(), but passes the header of the stream to the
+// decoder at once and the rest in chunks of chunk_size bytes.
+std::string DecompressInChunks(const std::string& codec_params_string,
+                               const std::string& compressed,
+                               size_t chunk_size) {
+  StreamingRingliCodec codec;
+  const std::vector<std::string> codec_params =
+      absl::StrSplit(codec_params_string, ':');
+  EXPECT_TRUE(codec.ParseParams(codec_params));
+  StreamingInterface* decoder = codec.decoder();
+  decoder->Reset();
+  const size_t header_size = std::min(sizeof(RingliHeader), compressed.size());
+  EXPECT_TRUE(decoder->ProcessInput(
+      reinterpret_cast<const uint8_t*>(compressed.data()), header_size));
+  for (size_t pos = header_size; pos < compressed.size(); pos += chunk_size) {
+    const size_t len = std::min(chunk_size, compressed.size() - pos);
+    EXPECT_TRUE(decoder->ProcessInput(
+        reinterpret_cast<const uint8_t*>(&compressed[pos]), len));
+  }
+  EXPECT_TRUE(decoder->Flush());
+  std::string output(decoder->OutputSize(), 0);
+  decoder->CopyOutput(reinterpret_cast<uint8_t*>(output.data()),
+                      output.size());
+  return output;
+}
+
+// A coding flag appended to the codec params of each of the base params,
+// which must not change the decoded output.
+struct FlagTestParams {
+  std::string params;
+  std::string flag;
+  size_t num_channels;
+  // If not zero, the flagged stream is also decoded with the input after the
+  // header passed in chunks of this size.
+  size_t chunk_size;
+  // Returns true if the header config has the flag.
+  bool (*flag_is_set)(const RingliDecoderConfig& config);
+};
+
+std::vector<FlagTestParams> FlagTests(
+    const std::vector<std::string>& params,
+    const std::vector<std::string>& flags, size_t num_channels,
+    size_t chunk_size, bool (*flag_is_set)(const RingliDecoderConfig&)) {
+  std::vector<FlagTestParams> tests;
+  for (const std::string& p : params) {
+    for (const std::string& flag : flags) {
+      tests.push_back({p, flag, num_channels, chunk_size, flag_is_set});
+    }
+  }
+  return tests;
+}
+
+RingliDecoderConfig HeaderConfig(const std::string& compressed) {
+  RingliHeader header;
+  CHECK_GE(compressed.size(), sizeof(header));
+  memcpy(&header, compressed.data(), sizeof(header));
+  return header.config;
+}
+
+class RingliFlagTest : public testing::TestWithParam<FlagTestParams> {};
+
+TEST_P(RingliFlagTest, DecodesToIdenticalOutput) {
+  const FlagTestParams& p = GetParam();
+  const std::string flag_params = p.params + p.flag;
+  const std::string input = TestInput(p.num_channels);
+  const std::string compressed = CompressWithParams(p.params, input);
+  const std::string flag_compressed = CompressWithParams(flag_params, input);
+  // The flag is in the header and changes the coded data, i.e. it was not
+  // ignored by the encoder.
+  EXPECT_FALSE(p.flag_is_set(HeaderConfig(compressed))) << flag_params;
+  EXPECT_TRUE(p.flag_is_set(HeaderConfig(flag_compressed))) << flag_params;
+  EXPECT_NE(compressed.substr(sizeof(RingliHeader)),
+            flag_compressed.substr(sizeof(RingliHeader)))
+      << flag_params;
+  const std::string expected = DecompressWithParams(p.params, compressed);
+  EXPECT_EQ(expected, DecompressWithParams(flag_params, flag_compressed))
+      << flag_params;
+  if (p.chunk_size > 0) {
+    EXPECT_EQ(expected,
+              DecompressInChunks(flag_params, flag_compressed, p.chunk_size))
+        << flag_params;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    SegmentedStreams, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:qc(0;7)", "ringli:aconly:qc(0;7)", "ringli:pc:o2-8:e5:q7",
+         "ringli:pc:o2-16:e5:q1", "ringli:pc:aconly:o2-8:e5:q7"},
+        {":s1", ":s8"}, 1, 0,
+        [](const RingliDecoderConfig& c) { return c.segmented(); })));
+
+INSTANTIATE_TEST_SUITE_P(
+    InterleavedANSStates, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:qc(0;7)", "ringli:qc(0;7):s8", "ringli:pc:o2-8:e5:q7",
+         "ringli:pc:o2-8:e5:q7:s16", "ringli:apc:e5:q3"},
+        {":i2", ":i4", ":i8"}, 1, 0, [](const RingliDecoderConfig& c) {
+          return c.ecparams.num_ans_states > 1;
+        })));
+
+// Small input chunks after the header stop the streaming decoders within the
+// symbols.
+INSTANTIATE_TEST_SUITE_P(
+    GammaSymbols, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:aconly:qc(0;7)", "ringli:aconly:qc(0;7):s4",
+         "ringli:pc:aconly:o2-8:e5:q7", "ringli:pc:aconly:o2-8:e5:q7:s3",
+         "ringli:apc:aconly:e5:ns:nf:q3"},
+        {":g"}, 1, 3, [](const RingliDecoderConfig& c) {
+          return c.ecparams.gamma_symbols != 0;
+        })));
+
+bool HasRangeCoding(const RingliDecoderConfig& c) {
+  return c.ecparams.range_coding;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RangeCodingMono, RingliFlagTest,
+    testing::ValuesIn(FlagTests({"ringli:apc:aconly:e5:q3",
+                                 "ringli:apc:aconly:e5:ns:nf:q3",
+                                 "ringli:apc:aconly:e7:q1"},
+                                {":rc"}, 1, 3, HasRangeCoding)));
+
+INSTANTIATE_TEST_SUITE_P(
+    RangeCodingStereo, RingliFlagTest,
+    testing::ValuesIn(FlagTests({"ringli:apc:aconly:e5:q3",
+                                 "ringli:apc:aconly:e5:ns:nf:q3",
+                                 "ringli:apc:aconly:e7:q1"},
+                                {":rc"}, 2, 3, HasRangeCoding)));
+
+// Odd sized input chunks after the header split the 32-bit words.
+INSTANTIATE_TEST_SUITE_P(
+    WideArithmeticCoding, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:pc:aconly:o2-8:e5:q7", "ringli:pc:aconly:o2-8:e5:q7:g",
+         "ringli:pc:aconly:o2-8:e5:q7:s3", "ringli:pc:aconly:o2-8:e5:q7:s3:cs",
+         "ringli:apc:aconly:e5:q3", "ringli:apc:aconly:e5:ns:nf:q3"},
+        {":ac64"}, 2, 3, [](const RingliDecoderConfig& c) {
+          return c.ecparams.wide_arithmetic_coding != 0;
+        })));
+
+INSTANTIATE_TEST_SUITE_P(
+    BypassBits, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:pc:aconly:o2-8:e5:q1", "ringli:pc:aconly:o2-8:e5:q1:s3",
+         "ringli:pc:aconly:o2-8:e5:q1:ac64", "ringli:apc:aconly:e5:q1"},
+        {":bb"}, 1, 3, [](const RingliDecoderConfig& c) {
+          return c.ecparams.bypass_bits != 0;
+        })));
+
+INSTANTIATE_TEST_SUITE_P(
+    EntropyPresets, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:pc:o2-8:e5:q7", "ringli:pc:o2-8:e5:q7:s16",
+         "ringli:pc:o2-16:e5:q1:s1", "ringli:pc:o2-8:e5:q7:s3:cs",
+         "ringli:apc:e5:q3", "ringli:apc:e5:q3:s8"},
+        {":ep"}, 2, 0, [](const RingliDecoderConfig& c) {
+          return c.ecparams.entropy_presets != 0;
+        })));
+
+INSTANTIATE_TEST_SUITE_P(
+    ChannelSubstreams, RingliFlagTest,
+    testing::ValuesIn(FlagTests(
+        {"ringli:pc:o2-8:e5:q7:s4", "ringli:pc:o2-8:e5:q7:s3:k2",
+         "ringli:pc:aconly:o2-8:e5:q7:s3", "ringli:apc:e5:q3:s8"},
+        {":cs"}, 6, 0,
+        [](const RingliDecoderConfig& c) { return c.channel_substreams(); })));
+
+TEST(RingliCodecTest, EntropyPresetsShrinkShortClips) {
+  const std::string input =
+      GenerateWav({{.frequency = 440.0, .amplitude = 0.5}}, 48000.0, 0.02,
+                  0.01);
+  EXPECT_LT(CompressWithParams("ringli:apc:e5:q3:ep", input).size(),
+            CompressWithParams("ringli:apc:e5:q3", input).size());
+}
+
+TEST(RingliCodecTest, LargeResidualsDecodeLosslessly) {
+  // Loud noise leaves residuals with many extra bits.
+  const std::string input =
+      GenerateWav({{.frequency = 150.0, .amplitude = 0.6},
+                   {.frequency = 5100.0, .amplitude = 0.2}},
+                  48000.0, 1.0, 0.2);
+  for (const char* params :
+       {"ringli:pc:aconly:o2-8:e5:q1", "ringli:pc:aconly:o2-8:e5:q1:s3",
+        "ringli:apc:aconly:e5:q1", "ringli:pc:aconly:o2-8:e5:q1:ac64",
+        "ringli:pc:aconly:o2-8:e5:q1:s3:ac64", "ringli:apc:aconly:e5:q1:ac64",
+        "ringli:pc:aconly:o2-8:e5:q1:bb", "ringli:pc:aconly:o2-8:e5:q1:s3:bb",
+        "ringli:apc:aconly:e5:q1:bb", "ringli:pc:aconly:o2-8:e5:q1:ac64:bb",
+        "ringli:apc:aconly:e5:q1:ac64:bb"}) {
+    const std::string compressed = CompressWithParams(params, input);
+    EXPECT_EQ(input, DecompressWithParams(params, compressed)) << params;
+    // Small input chunks after the header stop the streaming decoders within
+    // the extra bits.
+    EXPECT_EQ(input, DecompressInChunks(params, compressed, 3)) << params;
+  }
+}
+
+TEST(RingliCodecTest, ThreadedChannelSubstreamsGiveIdenticalOutput) {
+  const std::string input = TestInput(/*num_channels=*/6);
+  for (const char* params :
+       {"ringli:pc:o2-8:e5:q7:s4:cs", "ringli:pc:o2-8:e5:q7:s3:k2:cs",
+        "ringli:pc:aconly:o2-8:e5:q7:s3:cs", "ringli:apc:e5:q3:s8:cs"}) {
+    const std::string threaded_params = std::string(params) + ":t4";
+    const std::string compressed = CompressWithParams(params, input);
+    EXPECT_EQ(compressed, CompressWithParams(threaded_params, input))
+        << params;
+    EXPECT_EQ(DecompressWithParams(params, compressed),
+              DecompressWithParams(threaded_params, compressed))
+        << params;
+  }
+}
+
+TEST(RingliCodecTest, ThreadedDecodingGivesIdenticalOutput) {
+  const std::string input = TestInput();
+  for (const char* params :
+       {"ringli:qc(0;7):s2:k1", "ringli:qc(0;7):s4:k2", "ringli:qc(0;7):s4",
+        "ringli:aconly:qc(0;7):s4", "ringli:pc:aconly:o2-8:e5:q7:s3",
+        "ringli:pc:o2-8:e5:q7:s2:k1"}) {
+    const std::string compressed = CompressWithParams(params, input);
+    const std::string expected = DecompressWithParams(params, compressed);
+    const std::string threaded_params = std::string(params) + ":t4";
+    EXPECT_EQ(expected, DecompressWithParams(threaded_params, compressed))
+        << params;
+    // Smaller input chunks leave fewer segments to decode in parallel.
+    EXPECT_EQ(expected, DecompressInChunks(threaded_params, compressed, 3000))
+        << params;
+  }
+}
+
+TEST(RingliCodecTest, DecodeRangeMatchesFullDecode) {
+  const std::string input = TestInput();
+  const size_t kWavHeaderSize = 44;
+  const size_t kFrameSize = 2;
+  for (const char* params :
+       {"ringli:qc(0;7):s2:k2", "ringli:pc:o2-8:e5:q7:s3:k1",
+        "ringli:qc(0;7):s4", "ringli:aconly:qc(0;7):s2:k1",
+        "ringli:pc:aconly:o2-8:e5:q7:s3:k2", "ringli:apc:aconly:e5:ns:nf:q3"}) {
+    std::string compressed = CompressWithParams(params, input);
+    const std::string expected = DecompressWithParams(params, compressed);
+    const size_t num_samples = (expected.size() - kWavHeaderSize) / kFrameSize;
+    RingliHeader header;
+    memcpy(&header, compressed.data(), sizeof(header));
+    if (header.config.has_seek_table()) {
+      std::vector<size_t> offsets;
+      size_t table_start;
+      ASSERT_TRUE(
+          ReadSeekTable(reinterpret_cast<const uint8_t*>(compressed.data()),
+                        compressed.size(), &offsets, &table_start));
+      // The blocks before the second seek point are not needed for the ranges
+      // after the first eight blocks.
+      ASSERT_GT(offsets.size(), 2) << params;
+      std::fill(compressed.begin() + sizeof(RingliHeader),
+                compressed.begin() + offsets[1], 0);
+    }
+    for (const auto& [start, end] : std::vector<std::pair<size_t, size_t>>{
+             {10000, 10001},
+             {10000, 20000},
+             {8 * kRingliBlockSize, 9 * kRingliBlockSize},
+             {30000, num_samples},
+             {40000, num_samples + 1000},
+             {num_samples, num_samples}}) {
+      StreamingRingliDecoder decoder;
+      ASSERT_TRUE(decoder.DecodeRange(
+          reinterpret_cast<const uint8_t*>(compressed.data()),
+          compressed.size(), start, end))
+          << params << " " << start;
+      std::string output(decoder.OutputSize(), 0);
+      decoder.CopyOutput(reinterpret_cast<uint8_t*>(output.data()),
+                         output.size());
+      const size_t size = (std::min(end, num_samples) - start) * kFrameSize;
+      ASSERT_EQ(output.size(), kWavHeaderSize + size) << params << " " << start;
+      EXPECT_EQ(output.substr(kWavHeaderSize),
+                expected.substr(kWavHeaderSize + start * kFrameSize, size))
+          << params << " " << start;
+    }
+  }
+}
+
+TEST(RingliCodecTest, StreamingDecoderOutputsBeforeFlush) {
+  const std::string input = TestInput();
+  for (const char* params :
+       {"ringli:aconly:qc(0;7)", "ringli:pc:aconly:o2-8:e5:q7",
+        "ringli:qc(0;7):s8", "ringli:pc:o2-8:e5:q7:s16",
+        "ringli:apc:aconly:e5:q3", "ringli:apc:aconly:e5:q3:rc",
+        "ringli:apc:aconly:e5:q3:ac64"}) {
+    StreamingRingliCodec codec;
+    const std::vector<std::string> codec_params = absl::StrSplit(params, ':');
+    EXPECT_TRUE(codec.ParseParams(codec_params));
+    std::string compressed;
+    EXPECT_TRUE(codec.Compress(input, &compressed));
+    std::string expected;
+    EXPECT_TRUE(codec.Decompress(compressed, &expected));
+    StreamingInterface* decoder = codec.decoder();
+    decoder->Reset();
+    const size_t kChunkSize = 100;
+    for (size_t pos = 0; pos < compressed.size(); pos += kChunkSize) {
+      if (pos == kChunkSize * (compressed.size() / kChunkSize / 2)) {
+        // Most blocks in the first half of the stream are already decoded.
+        EXPECT_GT(decoder->OutputSize(), expected.size() / 4) << params;
+      }
+      const size_t len = std::min(kChunkSize, compressed.size() - pos);
+      EXPECT_TRUE(decoder->ProcessInput(
+          reinterpret_cast<const uint8_t*>(&compressed[pos]), len));
+    }
+    EXPECT_TRUE(decoder->Flush());
+    std::string output(decoder->OutputSize(), 0);
+    decoder->CopyOutput(reinterpret_cast<uint8_t*>(output.data()),
+                        output.size());
+    EXPECT_EQ(output, expected) << params;
+  }
+}
+
+std::string ReadTestData(const std::string& name) {
+  const std::filesystem::path path =
+      std::filesystem::path(CMAKE_CURRENT_SOURCE_DIR) / "testdata" / name;
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file) << "Could not open " << path;
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+// Returns the samples of the wav files that the legacy streams in testdata/
+// were encoded from: an integer sinusoid per channel plus noise in [-2, 2].
+std::string LegacyTestSamples(size_t num_channels, size_t num_samples) {
+  std::vector<int16_t> samples(num_channels * num_samples);
+  for (size_t c = 0; c < num_channels; ++c) {
+    // 2 cos(w) in Q14.
+    const int32_t coef = c == 0 ? 31000 : 28000;
+    int32_t y1 = 4000 + 1000 * c;
+    int32_t y2 = 0;
+    uint32_t seed = 1 + c;
+    for (size_t i = 0; i < num_samples; ++i) {
+      const int32_t y = ((coef * y1) >> 14) - y2;
+      y2 = y1;
+      y1 = y;
+      seed = seed * 1103515245u + 12345u;
+      const int32_t noise = static_cast<int32_t>((seed >> 16) % 5) - 2;
+      samples[i * num_channels + c] = y + noise;
+    }
+  }
+  std::string output;
+  WriteSamples(samples.data(), samples.size(), &output);
+  return output;
+}
+
+TEST(RingliCodecTest, LegacyStreamsDecodeLosslessly) {
+  // Lossless streams of 3000 samples per channel, written by the encoder of
+  // the original format.
+  for (const auto& [name, num_channels] :
+       std::vector<std::pair<std::string, size_t>>{
+           {"legacy_apc_e7_q1.ringli", 2},
+           {"legacy_pc_o2-16_e5_q1.ringli", 2},
+           {"legacy_apc_aconly_e5_q1.ringli", 1},
+           {"legacy_pc_aconly_o2-8_e5_q1.ringli", 2}}) {
+    const std::string compressed = ReadTestData(name);
+    ASSERT_EQ(memcmp(compressed.data(), kRingliLegacyId,
+                     sizeof(kRingliLegacyId)),
+              0);
+    const std::string output = DecompressWithParams("ringli", compressed);
+    ASSERT_GE(output.size(), kWavHeaderSize) << name;
+    EXPECT_EQ(output.substr(kWavHeaderSize),
+              LegacyTestSamples(num_channels, 3000))
+        << name;
+  }
+}
+
 struct RingliEvaluationTestParams {
   std::string codec_params = "";
   int64_t compressed_size = 0;
@@ -153,8 +637,8 @@ INSTANTIATE_TEST_SUITE_P(
     RingliCompressMultipleSine, RingliCodecEvaluationMultipleSineTest,
     testing::Values(
         RingliEvaluationTestParams{"ringli:qb(0;1);(1000;1000)", 33391, 46},
-        RingliEvaluationTestParams{"ringli:pc:o2-8:e5:q7", 133794, 87},
-        RingliEvaluationTestParams{"ringli:pc:o2-8:e5:q1", 216750, -1},
+        RingliEvaluationTestParams{"ringli:pc:o2-8:e5:q7", 126756, 87},
+        RingliEvaluationTestParams{"ringli:pc:o2-8:e5:q1", 212657, -1},
         RingliEvaluationTestParams{"ringli:apc:e7:q3", 122955, 94},
         RingliEvaluationTestParams{"ringli:apc:aconly:e7:q3", 115776, 94},
         RingliEvaluationTestParams{"ringli:aconly:qc(0;7)", 227521, 86}));
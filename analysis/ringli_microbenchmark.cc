@@ -0,0 +1,771 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the codec's inner kernels, each compared against the
+// straightforward implementation it replaces.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "common/ans_params.h"
+#include "common/block_predictor.h"
+#include "common/context.h"
+#include "common/convolve.h"
+#include "common/covariance_lattice.h"
+#include "common/dct.h"
+#include "common/data_defs/constants.h"
+#include "common/data_defs/data_vector.h"
+#include "common/distributions.h"
+#include "common/entropy_coding.h"
+#include "common/fast_online_predictor.h"
+#include "common/log2floor.h"
+#include "common/predictor.h"
+#include "common/ringli_header.h"
+#include "decode/ans_decode.h"
+#include "decode/arith_decode.h"
+#include "decode/entropy_decode.h"
+#include "decode/ringli_input.h"
+#include "encode/ans_encode.h"
+#include "encode/arith_encode.h"
+#include "encode/entropy_encode.h"
+#include "encode/range_encode.h"
+#include "encode/write_bits.h"
+
+ABSL_FLAG(int, reps, 1000, "Number of repetitions of each benchmark.");
+ABSL_FLAG(std::vector<std::string>, benchmarks, std::vector<std::string>(),
+          "Comma-separated list of benchmarks to run, all if empty.");
+
+namespace ringli {
+namespace {
+
+// Keeps the compiler from optimizing away the benchmarked computation.
+volatile double g_sink;
+
+// Returns the average run time of fn in nanoseconds.
+double TimeNanos(int reps, const std::function<void()>& fn) {
+  fn();
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < reps; ++i) {
+    fn();
+  }
+  const auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / reps;
+}
+
+void PrintResult(const char* name, double baseline_ns, double optimized_ns) {
+  printf("%-32s %12.1f ns %12.1f ns %8.2fx\n", name, baseline_ns, optimized_ns,
+         baseline_ns / optimized_ns);
+}
+
+// Convolution as it was done before the interior was vectorized: clamped
+// indexing in the inner loop and a freshly computed kernel on every call.
+template <size_t K, size_t SIZE>
+DataVector<double, SIZE> ReferenceConvolve(
+    const DataVector<double, 2 * K + 1>& kernel,
+    const DataVector<double, SIZE>& data) {
+  DataVector<double, SIZE> res;
+  for (int i = 0; i < SIZE; ++i) {
+    double sum = 0;
+    for (int j = -static_cast<int>(K); j <= static_cast<int>(K); ++j) {
+      const int ix = std::max(0, std::min<int>(SIZE - 1, i + j));
+      sum += data[ix] * kernel[K + j];
+    }
+    res[i] = sum;
+  }
+  return res;
+}
+
+void BenchmarkConvolve(int reps) {
+  constexpr size_t K = kDctLength;
+  constexpr size_t kSize = kACPredictionWindowSize;
+  constexpr double kSigma = 2.0;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  DataVector<double, kSize> data;
+  for (size_t i = 0; i < kSize; ++i) {
+    data[i] = dist(rng);
+  }
+  const double kernel_base = TimeNanos(reps, [&]() {
+    g_sink = GaussianKernel<K>(kSigma)[K];
+  });
+  const double kernel_cached = TimeNanos(reps, [&]() {
+    g_sink = CachedGaussianKernel<K>(kSigma)[K];
+  });
+  PrintResult("gaussian_kernel", kernel_base, kernel_cached);
+  const DataVector<double, 2 * K + 1> kernel = GaussianKernel<K>(kSigma);
+  const double convolve_base = TimeNanos(reps, [&]() {
+    g_sink = ReferenceConvolve<K, kSize>(kernel, data)[kSize / 2];
+  });
+  const double convolve_fast = TimeNanos(reps, [&]() {
+    g_sink = Convolve(kernel, data)[kSize / 2];
+  });
+  PrintResult("convolve", convolve_base, convolve_fast);
+}
+
+// Inverse transform of a sub-block where only the coefficients set by the AC
+// prediction steps are non-zero, as on low bitrate streams.
+void BenchmarkTruncatedInverseDCT(int reps) {
+  constexpr size_t kNumCoeffs = kACPredictionStart << kNumACPredictionSteps;
+  const DCT<kDctLength> dct;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  DataVector<double, kDctLength> coeffs;
+  for (size_t k = 0; k < kNumCoeffs; ++k) {
+    coeffs[k] = dist(rng);
+  }
+  const double full = TimeNanos(reps, [&]() {
+    g_sink = dct.ApplyInverseDCT(coeffs)[0];
+  });
+  const double truncated = TimeNanos(reps, [&]() {
+    g_sink = dct.ApplyInverseDCT(
+        coeffs, DCT<kDctLength>::NumCoefficients(coeffs))[0];
+  });
+  PrintResult("truncated_inverse_dct", full, truncated);
+}
+
+// Returns the ANS coded symbols with num_states interleaved states, laid out
+// as in the entropy coded data: the final states followed by the renormalising
+// words of the symbols in decoding order.
+std::vector<uint8_t> EncodeANSSymbols(const std::vector<int>& symbols,
+                                      const ANSEncSymbolInfo* info,
+                                      size_t num_states) {
+  std::vector<ANSCoder> ans(num_states);
+  std::vector<uint16_t> words(symbols.size());
+  std::vector<uint8_t> nbits(symbols.size());
+  for (size_t i = symbols.size(); i-- > 0;) {
+    words[i] = ans[i % num_states].PutSymbol(info[symbols[i]], &nbits[i]);
+  }
+  std::vector<uint8_t> data;
+  const auto append = [&data](uint16_t word) {
+    data.push_back(word & 0xff);
+    data.push_back(word >> 8);
+  };
+  for (const ANSCoder& coder : ans) {
+    append(coder.GetState() >> 16);
+    append(coder.GetState() & 0xffff);
+  }
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    if (nbits[i]) append(words[i]);
+  }
+  return data;
+}
+
+// Decoding of a run of ANS coded symbols with one state and with four
+// interleaved states.
+void BenchmarkANSDecode(int reps) {
+  constexpr size_t kNumSymbols = 1 << 14;
+  constexpr int kAlphabetSize = 16;
+  // Roughly geometric distribution, as that of the residual symbols.
+  int counts[kAlphabetSize];
+  int total = 0;
+  for (int s = 0; s < kAlphabetSize; ++s) {
+    counts[s] = std::max(1, (ANS_TAB_SIZE / 2) >> (s / 2 + s % 2));
+    total += counts[s];
+  }
+  counts[0] += ANS_TAB_SIZE - total;
+  ANSEncSymbolInfo info[kAlphabetSize];
+  ANSDecodingData code;
+  for (int s = 0, start = 0; s < kAlphabetSize; start += counts[s++]) {
+    info[s].freq_ = counts[s];
+    info[s].start_ = start;
+    for (int j = 0; j < counts[s]; ++j) {
+      code.map_[start + j] = {static_cast<uint16_t>(j),
+                              static_cast<uint16_t>(counts[s]),
+                              static_cast<uint8_t>(s)};
+    }
+  }
+  std::mt19937 rng(1);
+  std::vector<int> symbols(kNumSymbols);
+  for (int& symbol : symbols) {
+    symbol = code.map_[rng() & ANS_TAB_MASK].symbol_;
+  }
+  double time_ns[2];
+  for (size_t num_states : {1, 4}) {
+    const std::vector<uint8_t> data =
+        EncodeANSSymbols(symbols, info, num_states);
+    time_ns[num_states > 1] = TimeNanos(reps, [&]() {
+      RingliInput in(data.data(), data.size());
+      ANSDecoder ans;
+      ans.Init(&in, num_states);
+      int sum = 0;
+      for (size_t i = 0; i < kNumSymbols; ++i) {
+        sum += ans.ReadSymbol(code, &in);
+      }
+      g_sink = ans.CheckCRC() ? sum : -1;
+    });
+  }
+  PrintResult("ans_decode", time_ns[0], time_ns[1]);
+}
+
+// Returns the 16-bit words of the adaptive arithmetic coded symbols of the
+// MAX_SYMBOLS alphabet with the balanced or the gamma binarization.
+template <typename ArithmeticEncoder = BinaryArithmeticEncoder>
+std::vector<uint16_t> EncodeArithmeticSymbols(const std::vector<int>& symbols,
+                                              bool gamma) {
+  std::vector<Prob> probs(MAX_SYMBOLS - 1);
+  std::vector<uint16_t> words;
+  const auto append = [](void* opaque, uint16_t word) {
+    static_cast<std::vector<uint16_t>*>(opaque)->push_back(word);
+  };
+  ArithmeticEncoder ac;
+  const auto add_bit = [&](Prob* p, int bit) {
+    const uint8_t prob = p->get_proba();
+    p->Add(bit);
+    ac.AddBit(prob, bit, &words, append);
+  };
+  for (const int symbol : symbols) {
+    if (gamma) {
+      const int n = symbol + 1;
+      const int k = Log2FloorNonZero(n);
+      for (int j = 0; j < k; ++j) add_bit(&probs[j], 1);
+      if (k < LOG_MAX_SYMBOLS) add_bit(&probs[k], 0);
+      for (int b = k - 1, node = 1; b >= 0; --b) {
+        add_bit(&probs[GammaBitIndex(LOG_MAX_SYMBOLS, k, node)],
+                (n >> b) & 1);
+        node = 2 * node + ((n >> b) & 1);
+      }
+    } else {
+      for (int val0 = 0, val1 = MAX_SYMBOLS; val0 + 1 < val1;) {
+        const int mid = (val0 + val1) >> 1;
+        const int bit = symbol >= mid;
+        add_bit(&probs[mid - 1], bit);
+        if (bit) {
+          val0 = mid;
+        } else {
+          val1 = mid;
+        }
+      }
+    }
+  }
+  ac.Flush(&words, append);
+  return words;
+}
+
+// Decoding of adaptive arithmetic coded residual symbols, as in the fully
+// streaming mode, with the balanced and with the gamma binarization.
+void BenchmarkArithmeticSymbolDecode(int reps) {
+  constexpr size_t kNumSymbols = 1 << 14;
+  // Direct coded symbols with a roughly geometric distribution, as those of
+  // the residuals.
+  std::mt19937 rng(1);
+  std::geometric_distribution<int> dist(0.4);
+  std::vector<int> symbols(kNumSymbols);
+  for (int& symbol : symbols) {
+    symbol = std::min(dist(rng), 2 * kPredNumDirectAbsval - 2);
+  }
+  double time_ns[2];
+  for (const bool gamma : {false, true}) {
+    const std::vector<uint16_t> words = EncodeArithmeticSymbols(symbols, gamma);
+    time_ns[gamma] = TimeNanos(reps, [&]() {
+      int sum = 0;
+      IntegerArithmeticDecoder decoder(
+          kPredNumDirectAbsval, MAX_SYMBOLS, gamma, /*wide=*/false,
+          /*bypass_bits=*/false, &sum, [](void* opaque, int val) {
+            *static_cast<int*>(opaque) += val;
+            return true;
+          });
+      std::vector<Prob> probs(MAX_SYMBOLS - 1);
+      decoder.set_distribution(probs.data());
+      for (const uint16_t word : words) {
+        decoder.ProcessInput(word);
+      }
+      g_sink = sum;
+    });
+  }
+  PrintResult("arithmetic_symbol_decode", time_ns[0], time_ns[1]);
+}
+
+// Decoding of the same residual symbols with the binary arithmetic decoder
+// and with the multi-symbol range decoder of the range coding mode.
+void BenchmarkRangeSymbolDecode(int reps) {
+  constexpr size_t kNumSymbols = 1 << 14;
+  std::mt19937 rng(1);
+  std::geometric_distribution<int> dist(0.4);
+  std::vector<int> symbols(kNumSymbols);
+  for (int& symbol : symbols) {
+    symbol = std::min(dist(rng), 2 * kPredNumDirectAbsval - 2);
+  }
+  const std::vector<uint16_t> binary_words =
+      EncodeArithmeticSymbols(symbols, /*gamma=*/false);
+  std::vector<uint16_t> range_words;
+  const auto append = [](void* opaque, uint16_t word) {
+    static_cast<std::vector<uint16_t>*>(opaque)->push_back(word);
+  };
+  AdaptiveDistribution encoder_dist;
+  RangeEncoder rc;
+  for (const int symbol : symbols) {
+    uint32_t start, size;
+    encoder_dist.GetInterval(symbol, &start, &size);
+    rc.AddSymbol(start, size, encoder_dist.total(), &range_words, append);
+    encoder_dist.Add(symbol);
+  }
+  rc.Flush(&range_words, append);
+  const auto add = [](void* opaque, int val) {
+    *static_cast<int*>(opaque) += val;
+    return true;
+  };
+  double time_ns[2];
+  time_ns[0] = TimeNanos(reps, [&]() {
+    int sum = 0;
+    IntegerArithmeticDecoder decoder(kPredNumDirectAbsval, MAX_SYMBOLS,
+                                     /*gamma=*/false, /*wide=*/false,
+                                     /*bypass_bits=*/false, &sum, add);
+    std::vector<Prob> probs(MAX_SYMBOLS - 1);
+    decoder.set_distribution(probs.data());
+    for (const uint16_t word : binary_words) {
+      decoder.ProcessInput(word);
+    }
+    g_sink = sum;
+  });
+  time_ns[1] = TimeNanos(reps, [&]() {
+    int sum = 0;
+    IntegerRangeDecoder decoder(kPredNumDirectAbsval, &sum, add);
+    AdaptiveDistribution distribution;
+    decoder.set_distribution(&distribution);
+    for (const uint16_t word : range_words) {
+      decoder.ProcessInput(word);
+    }
+    g_sink = sum;
+  });
+  PrintResult("range_symbol_decode", time_ns[0], time_ns[1]);
+}
+
+// Decoding of the equiprobable extra bits of large residuals, one binary split
+// per bit and with the bypass coding of up to 16 bits at once.
+void BenchmarkBypassBitsDecode(int reps) {
+  constexpr size_t kNumValues = 1 << 14;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> nbits_dist(1, 12);
+  std::vector<int> nbits(kNumValues);
+  std::vector<uint32_t> values(kNumValues);
+  for (size_t i = 0; i < kNumValues; ++i) {
+    nbits[i] = nbits_dist(rng);
+    values[i] = rng() & ((1u << nbits[i]) - 1);
+  }
+  const auto append = [](void* opaque, uint16_t word) {
+    std::vector<uint8_t>* data = static_cast<std::vector<uint8_t>*>(opaque);
+    data->push_back(word & 0xff);
+    data->push_back(word >> 8);
+  };
+  double time_ns[2];
+  for (const bool bypass : {false, true}) {
+    std::vector<uint8_t> data;
+    BinaryArithmeticEncoder ac;
+    for (size_t i = 0; i < kNumValues; ++i) {
+      if (bypass) {
+        ac.AddBits(nbits[i], values[i], &data, append);
+      } else {
+        for (int b = 0; b < nbits[i]; ++b) {
+          ac.AddBit(128, (values[i] >> b) & 1, &data, append);
+        }
+      }
+    }
+    ac.Flush(&data, append);
+    time_ns[bypass] = TimeNanos(reps, [&]() {
+      RingliInput in(data.data(), data.size());
+      BinaryArithmeticDecoder decoder;
+      decoder.Init(&in);
+      uint32_t sum = 0;
+      for (size_t i = 0; i < kNumValues; ++i) {
+        sum += decoder.ReadBits(bypass, nbits[i], &in);
+      }
+      g_sink = sum;
+    });
+  }
+  PrintResult("bypass_bits_decode", time_ns[0], time_ns[1]);
+}
+
+// Returns the sum of the adaptive arithmetic coded symbols of
+// EncodeArithmeticSymbols() with the balanced binarization, read from the
+// little-endian data.
+template <typename ArithmeticDecoder>
+int DecodeArithmeticSymbols(const std::vector<uint8_t>& data,
+                            size_t num_symbols) {
+  RingliInput in(data.data(), data.size());
+  ArithmeticDecoder ac;
+  ac.Init(&in);
+  std::vector<Prob> probs(MAX_SYMBOLS - 1);
+  int sum = 0;
+  for (size_t i = 0; i < num_symbols; ++i) {
+    int val0 = 0;
+    int val1 = MAX_SYMBOLS;
+    while (val0 + 1 < val1) {
+      const int mid = (val0 + val1) >> 1;
+      Prob* const p = &probs[mid - 1];
+      const int bit = ac.ReadBit(p->get_proba(), &in);
+      p->Add(bit);
+      if (bit) {
+        val0 = mid;
+      } else {
+        val1 = mid;
+      }
+    }
+    sum += val0;
+  }
+  return sum;
+}
+
+// Decoding of adaptive arithmetic coded symbols from a buffer, as in the
+// segmented arithmetic-only mode, with the 32-bit and the 64-bit coder.
+void BenchmarkWideArithmeticDecode(int reps) {
+  constexpr size_t kNumSymbols = 1 << 14;
+  std::mt19937 rng(1);
+  std::geometric_distribution<int> dist(0.1);
+  std::vector<int> symbols(kNumSymbols);
+  for (int& symbol : symbols) {
+    symbol = std::min(dist(rng), MAX_SYMBOLS - 1);
+  }
+  const auto to_bytes = [](const std::vector<uint16_t>& words) {
+    std::vector<uint8_t> data;
+    for (const uint16_t word : words) {
+      data.push_back(word & 0xff);
+      data.push_back(word >> 8);
+    }
+    return data;
+  };
+  const std::vector<uint8_t> data = to_bytes(
+      EncodeArithmeticSymbols<BinaryArithmeticEncoder>(symbols, false));
+  const std::vector<uint8_t> wide_data = to_bytes(
+      EncodeArithmeticSymbols<BinaryArithmeticEncoder64>(symbols, false));
+  double time_ns[2];
+  time_ns[0] = TimeNanos(reps, [&]() {
+    g_sink = DecodeArithmeticSymbols<BinaryArithmeticDecoder>(data,
+                                                              kNumSymbols);
+  });
+  time_ns[1] = TimeNanos(reps, [&]() {
+    g_sink = DecodeArithmeticSymbols<BinaryArithmeticDecoder64>(wide_data,
+                                                                kNumSymbols);
+  });
+  PrintResult("wide_arithmetic_decode", time_ns[0], time_ns[1]);
+}
+
+// Streaming decoding of adaptive arithmetic coded symbols from a byte stream,
+// assembling and passing the 16-bit words one at a time and in one batch per
+// input chunk.
+void BenchmarkStreamingWordsDecode(int reps) {
+  constexpr size_t kNumSymbols = 1 << 14;
+  constexpr size_t kChunkSize = 256;
+  std::mt19937 rng(1);
+  std::geometric_distribution<int> dist(0.4);
+  std::vector<int> symbols(kNumSymbols);
+  for (int& symbol : symbols) {
+    symbol = std::min(dist(rng), 2 * kPredNumDirectAbsval - 2);
+  }
+  std::vector<uint8_t> data;
+  for (const uint16_t word : EncodeArithmeticSymbols(symbols, false)) {
+    data.push_back(word & 0xff);
+    data.push_back(word >> 8);
+  }
+  const auto add = [](void* opaque, int val) {
+    *static_cast<int*>(opaque) += val;
+    return true;
+  };
+  double time_ns[2];
+  for (const bool batched : {false, true}) {
+    time_ns[batched] = TimeNanos(reps, [&]() {
+      int sum = 0;
+      IntegerArithmeticDecoder decoder(kPredNumDirectAbsval, MAX_SYMBOLS,
+                                       /*gamma=*/false, /*wide=*/false,
+                                       /*bypass_bits=*/false, &sum, add);
+      std::vector<Prob> probs(MAX_SYMBOLS - 1);
+      decoder.set_distribution(probs.data());
+      uint16_t next_word = 0;
+      int shift = 0;
+      for (size_t pos = 0; pos < data.size(); pos += kChunkSize) {
+        const size_t len = std::min(kChunkSize, data.size() - pos);
+        if (batched) {
+          decoder.ProcessWords(&data[pos], len / 2);
+          continue;
+        }
+        for (size_t i = pos; i < pos + len; ++i) {
+          next_word |= data[i] << shift;
+          shift += 8;
+          if (shift == 16) {
+            decoder.ProcessInput(next_word);
+            shift = 0;
+            next_word = 0;
+          }
+        }
+      }
+      g_sink = sum;
+    });
+  }
+  PrintResult("streaming_words_decode", time_ns[0], time_ns[1]);
+}
+
+// Clustering of the histograms of the block predictive mode contexts of a
+// short clip, with all pairs of clusters as candidates and with the bounded
+// candidate set of the lower effort levels. Also prints the size of the
+// context map, the entropy codes and the symbols coded with them.
+void BenchmarkHistogramClustering(int reps) {
+  constexpr size_t kNumSamples = 1 << 16;
+  const PredictiveContextModel context_model;
+  const int num_contexts = 3 + kNumLSFContexts + context_model.NumContexts();
+  // Laplacian residuals with a slowly drifting scale, and their contexts.
+  std::mt19937 rng(1);
+  std::exponential_distribution<double> magnitude(1.0);
+  std::normal_distribution<double> drift(0.0, 0.05);
+  PredictiveContextModel model;
+  std::vector<int> symbols(kNumSamples);
+  std::vector<int> contexts(kNumSamples);
+  std::vector<int> context_counts(num_contexts);
+  double scale = 8.0;
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    if (i % kRingliBlockSize == 0) model.Reset();
+    scale = std::clamp(scale * std::exp(drift(rng)), 0.5, 2000.0);
+    const int absval = std::lround(magnitude(rng) * scale);
+    const int value = (rng() & 1) ? absval : -absval;
+    contexts[i] = 3 + kNumLSFContexts + model.Context();
+    // The residual symbol of the predictive mode, without the extra bits.
+    const int sign = value < 0;
+    if (absval < kPredNumDirectAbsval) {
+      symbols[i] = 2 * absval - (absval > 0 && !sign);
+    } else {
+      const int n = Log2FloorNonZero(absval - kPredNumDirectAbsval + 2);
+      const int msb = ((absval - kPredNumDirectAbsval + 2) >> (n - 1)) & 1;
+      symbols[i] = 2 * kPredNumDirectAbsval - 1 + 4 * (n - 1) + 2 * msb + sign;
+    }
+    ++context_counts[contexts[i]];
+    model.Add(value);
+  }
+  // A full clustering takes several milliseconds.
+  const int clustering_reps = std::max(1, reps / 100);
+  double time_ns[2];
+  double bits[2];
+  for (const bool fast : {false, true}) {
+    EntropySource source(fast);
+    source.Resize(num_contexts);
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      source.AddCode(symbols[i], contexts[i]);
+    }
+    time_ns[fast] = TimeNanos(clustering_reps, [&]() {
+      source.ClusterHistograms();
+      g_sink = source.NumHistograms();
+    });
+    std::vector<uint8_t> storage(1 << 20);
+    size_t storage_ix = 0;
+    WriteBitsPrepareStorage(storage_ix, storage.data());
+    source.EncodeContextMap(&storage_ix, storage.data());
+    source.BuildAndStoreEntropyCodes(&storage_ix, storage.data());
+    bits[fast] = storage_ix;
+    for (int ctx = 0; ctx < num_contexts; ++ctx) {
+      if (context_counts[ctx] > 0) bits[fast] += source.ClusteredEntropy(ctx);
+    }
+  }
+  PrintResult("histogram_clustering", time_ns[0], time_ns[1]);
+  printf("%-32s %13.0f B %13.0f B %+8.2f%%\n", "histogram_clustering_size",
+         bits[0] / 8, bits[1] / 8, 100.0 * (bits[1] / bits[0] - 1.0));
+}
+
+void BenchmarkOnlinePredictorBank(int reps) {
+  constexpr size_t kNumChannels = 6;
+  constexpr size_t kNumTicks = 1024;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> noise(-50, 50);
+  std::vector<float> samples(kNumChannels * kNumTicks);
+  for (size_t i = 0; i < kNumTicks; ++i) {
+    for (size_t c = 0; c < kNumChannels; ++c) {
+      samples[i * kNumChannels + c] =
+          std::round(8000 * std::sin(0.02 * (c + 1) * i)) + noise(rng);
+    }
+  }
+  // One FastOnlinePredictor per channel behind the Predictor interface, as
+  // the fully streaming mode used them before.
+  std::vector<std::unique_ptr<Predictor>> predictors;
+  for (size_t c = 0; c < kNumChannels; ++c) {
+    predictors.push_back(std::make_unique<FastOnlinePredictor>());
+  }
+  PerChannelPredictor per_channel(std::move(predictors));
+  FastOnlinePredictorBank bank(kNumChannels);
+  const auto run = [&](MultiChannelPredictor* predictor) {
+    float predictions[kNumChannels];
+    double sum = 0;
+    predictor->Reset();
+    for (size_t i = 0; i < kNumTicks; ++i) {
+      predictor->Predict(predictions);
+      sum += predictions[0];
+      predictor->AddNewSamples(&samples[i * kNumChannels]);
+    }
+    g_sink = sum;
+  };
+  PrintResult("online_predictor_bank",
+              TimeNanos(reps, [&]() { run(&per_channel); }),
+              TimeNanos(reps, [&]() { run(&bank); }));
+}
+
+void BenchmarkLaggedProductSums(int reps) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int32_t> dist(-32768, 32767);
+  std::vector<int32_t> data(kRingliBlockSize);
+  for (int32_t& x : data) x = dist(rng);
+  // The lag sums of CovarianceLattice for the highest predictor order, as
+  // they were accumulated before they were vectorized.
+  const double baseline_ns = TimeNanos(reps, [&]() {
+    double sum = 0;
+    for (size_t lag = 0; lag <= kMaxPredictorOrder; ++lag) {
+      double lag_sum = 0;
+      for (size_t n = kMaxPredictorOrder; n < kRingliBlockSize; ++n) {
+        lag_sum += data[n] * data[n - lag];
+      }
+      sum += lag_sum;
+    }
+    g_sink = sum;
+  });
+  const double optimized_ns = TimeNanos(reps, [&]() {
+    double sum = 0;
+    for (size_t lag = 0; lag <= kMaxPredictorOrder; ++lag) {
+      sum += LaggedProductSum(data.data(), kMaxPredictorOrder,
+                              kRingliBlockSize, lag);
+    }
+    g_sink = sum;
+  });
+  PrintResult("lagged_product_sums", baseline_ns, optimized_ns);
+}
+
+// Returns a block of samples of a sine with noise and a block predictor of
+// the highest order that was fitted to them, and sets header to its
+// parameters.
+BlockPredictor<kRingliBlockSize> FittedBlockPredictor(
+    double frequency, std::vector<int32_t>* samples,
+    RingliPredictiveHeader* header) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int32_t> noise(-50, 50);
+  samples->resize(kRingliBlockSize);
+  for (size_t i = 0; i < kRingliBlockSize; ++i) {
+    (*samples)[i] = std::round(8000 * std::sin(frequency * i)) + noise(rng);
+  }
+  CovarianceLattice<int32_t> lattice(samples->data(), kRingliBlockSize,
+                                     kMaxPredictorOrder, 1.0 / 12);
+  return BlockPredictor<kRingliBlockSize>::CreateForEncoder(
+      kMaxPredictorOrder, header, lattice);
+}
+
+void BenchmarkLosslessResiduals(int reps) {
+  std::vector<int32_t> samples;
+  RingliPredictiveHeader header;
+  const BlockPredictor<kRingliBlockSize> fitted =
+      FittedBlockPredictor(0.02, &samples, &header);
+  std::vector<int32_t> residuals(kRingliBlockSize);
+  float predictions[kRingliBlockSize];
+  // The lossless block-predictive mode used to run the predictor sample by
+  // sample.
+  const double baseline_ns = TimeNanos(reps, [&]() {
+    BlockPredictor<kRingliBlockSize> predictor = fitted;
+    for (size_t i = 0; i < kRingliBlockSize; ++i) {
+      const float prediction = std::round(predictor.Predict());
+      predictor.AddNewSample(samples[i]);
+      residuals[i] = samples[i] - prediction;
+    }
+    g_sink = residuals[kRingliBlockSize - 1];
+  });
+  const double optimized_ns = TimeNanos(reps, [&]() {
+    BlockPredictor<kRingliBlockSize> predictor = fitted;
+    predictor.PredictBlock(samples.data(), predictions);
+    for (size_t i = 0; i < kRingliBlockSize; ++i) {
+      residuals[i] = samples[i] - std::round(predictions[i]);
+    }
+    g_sink = residuals[kRingliBlockSize - 1];
+  });
+  PrintResult("lossless_residuals", baseline_ns, optimized_ns);
+}
+
+void BenchmarkBlockSynthesis(int reps) {
+  // A lossless stereo block.
+  constexpr size_t kNumChannels = 2;
+  RingliBlock encoded_block(kNumChannels);
+  for (size_t c = 0; c < kNumChannels; ++c) {
+    std::vector<int32_t> samples;
+    BlockPredictor<kRingliBlockSize> predictor = FittedBlockPredictor(
+        0.02 * (c + 1), &samples, &encoded_block.header.pred[c]);
+    for (size_t i = 0; i < kRingliBlockSize; ++i) {
+      const float prediction = std::round(predictor.Predict());
+      predictor.AddNewSample(samples[i]);
+      encoded_block.channels[c][i] = samples[i] - prediction;
+    }
+  }
+  AudioBlock decoded_block(kNumChannels);
+  // The decoder used to run one BlockPredictor per channel, sample by sample.
+  const double baseline_ns = TimeNanos(reps, [&]() {
+    for (size_t c = 0; c < kNumChannels; ++c) {
+      auto predictor = BlockPredictor<kRingliBlockSize>::CreateForDecoder(
+          encoded_block.header.pred[c]);
+      for (size_t i = 0; i < kRingliBlockSize; ++i) {
+        const float prediction = std::round(predictor.Predict());
+        const float sample = prediction + encoded_block.channels[c][i];
+        predictor.AddNewSample(sample);
+        decoded_block[c][i] = std::round(sample);
+      }
+    }
+    g_sink = decoded_block[0][kRingliBlockSize - 1];
+  });
+  const double optimized_ns = TimeNanos(reps, [&]() {
+    DecodeBlockPredictive(encoded_block, 1, &decoded_block);
+    g_sink = decoded_block[0][kRingliBlockSize - 1];
+  });
+  PrintResult("block_synthesis", baseline_ns, optimized_ns);
+}
+
+struct Benchmark {
+  const char* name;
+  void (*run)(int reps);
+};
+
+constexpr Benchmark kBenchmarks[] = {
+    {"convolve", BenchmarkConvolve},
+    {"truncated_inverse_dct", BenchmarkTruncatedInverseDCT},
+    {"ans_decode", BenchmarkANSDecode},
+    {"arithmetic_symbol_decode", BenchmarkArithmeticSymbolDecode},
+    {"range_symbol_decode", BenchmarkRangeSymbolDecode},
+    {"bypass_bits_decode", BenchmarkBypassBitsDecode},
+    {"wide_arithmetic_decode", BenchmarkWideArithmeticDecode},
+    {"streaming_words_decode", BenchmarkStreamingWordsDecode},
+    {"histogram_clustering", BenchmarkHistogramClustering},
+    {"online_predictor_bank", BenchmarkOnlinePredictorBank},
+    {"lagged_product_sums", BenchmarkLaggedProductSums},
+    {"lossless_residuals", BenchmarkLosslessResiduals},
+    {"block_synthesis", BenchmarkBlockSynthesis},
+};
+
+int Main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  const int reps = absl::GetFlag(FLAGS_reps);
+  const std::vector<std::string> selected = absl::GetFlag(FLAGS_benchmarks);
+  printf("%-32s %15s %15s %9s\n", "benchmark", "baseline", "optimized",
+         "speedup");
+  for (const Benchmark& benchmark : kBenchmarks) {
+    if (!selected.empty() && std::find(selected.begin(), selected.end(),
+                                       benchmark.name) == selected.end()) {
+      continue;
+    }
+    benchmark.run(reps);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace ringli
+
+int main(int argc, char* argv[]) { return ringli::Main(argc, argv); }
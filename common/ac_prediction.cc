@@ -0,0 +1,94 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/ac_prediction.h"
+
+#include "absl/log/check.h"
+#include "common/convolve.h"
+#include "common/data_defs/constants.h"
+#include "common/data_defs/data_vector.h"
+#include "common/dct.h"
+
+namespace ringli {
+
+ACPredictionOperator::ACPredictionOperator() {
+  // The matrices are the responses of the explicit transform and convolution
+  // chain to unit coefficients.
+  DCT<kDctLength> dct;
+  const int positions[3] = {0, kNumSubBlocks / 2, kNumSubBlocks - 1};
+  for (int step = 0; step < kNumACPredictionSteps; ++step) {
+    const int k_limit = kACPredictionStart << step;
+    const auto& kernel =
+        CachedGaussianKernel<kDctLength>(kACPredictionSigma / k_limit);
+    for (int pos = 0; pos < 3; ++pos) {
+      const int block = positions[pos];
+      for (int d = -1; d <= 1; ++d) {
+        if (block + d < 0 || block + d >= kNumSubBlocks) continue;
+        double* matrix = matrices_[step][pos][d + 1];
+        for (int j = 0; j < k_limit; ++j) {
+          DataVector<double, kDctLength> unit;
+          unit[j] = 1.0;
+          const DataVector<double, kDctLength> signal =
+              dct.ApplyInverseDCT(unit);
+          ACPredictionWindow window;
+          for (int n = 0; n < kDctLength; ++n) {
+            window[(block + d) * kDctLength + n] = signal[n];
+          }
+          window = Convolve(kernel, window);
+          DataVector<double, kDctLength> smoothed;
+          for (int n = 0; n < kDctLength; ++n) {
+            smoothed[n] = window[block * kDctLength + n];
+          }
+          const DataVector<double, kDctLength> response =
+              dct.ApplyDirectDCT(smoothed);
+          for (int k = k_limit; k < 2 * k_limit; ++k) {
+            matrix[(k - k_limit) * k_limit + j] = response[k];
+          }
+        }
+      }
+    }
+  }
+}
+
+void ACPredictionOperator::Apply(int step, const ACPredictionWindow& coeffs,
+                                 ACPredictionWindow* prediction) const {
+  DCHECK_LT(step, kNumACPredictionSteps);
+  const int k_limit = kACPredictionStart << step;
+  for (int block = 0; block < kNumSubBlocks; ++block) {
+    const int pos = block == 0 ? 0 : block == kNumSubBlocks - 1 ? 2 : 1;
+    double* out = &(*prediction)[block * kDctLength + k_limit];
+    for (int k = 0; k < k_limit; ++k) {
+      out[k] = 0.0;
+    }
+    for (int d = -1; d <= 1; ++d) {
+      if (block + d < 0 || block + d >= kNumSubBlocks) continue;
+      const double* matrix = matrices_[step][pos][d + 1];
+      const double* in = &coeffs[(block + d) * kDctLength];
+      for (int k = 0; k < k_limit; ++k) {
+        double sum = 0.0;
+        for (int j = 0; j < k_limit; ++j) {
+          sum += matrix[k * k_limit + j] * in[j];
+        }
+        out[k] += sum;
+      }
+    }
+  }
+}
+
+const ACPredictionOperator& GetACPredictionOperator() {
+  static const ACPredictionOperator* kOperator = new ACPredictionOperator();
+  return *kOperator;
+}
+
+}  // namespace ringli
@@ -0,0 +1,62 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMMON_AC_PREDICTION_H_
+#define COMMON_AC_PREDICTION_H_
+
+#include "common/data_defs/constants.h"
+#include "common/data_defs/data_vector.h"
+
+namespace ringli {
+
+typedef DataVector<double, kACPredictionWindowSize> ACPredictionWindow;
+
+// Linear operator of the AC prediction steps of the DCT mode.
+//
+// Step s predicts the coefficients k_limit <= k < 2 * k_limit of every DCT
+// sub-block of the prediction window from the coefficients k < k_limit, where
+// k_limit = kACPredictionStart << s, by an inverse DCT of the truncated
+// sub-blocks, a Gaussian smoothing of the whole window and a forward DCT. The
+// smoothing kernel is not wider than a sub-block, so the prediction of a
+// sub-block depends only on the sub-block and its two neighbours. The chain is
+// therefore stored as three k_limit x k_limit matrices for the interior
+// sub-blocks, and for each of the two outermost sub-blocks, where the
+// convolution clamps the signal at the window edges.
+class ACPredictionOperator {
+ public:
+  ACPredictionOperator();
+
+  // Sets prediction[i + k] for every sub-block start i and
+  // k_limit <= k < 2 * k_limit from the coefficients coeffs[i + k] with
+  // k < k_limit. The other elements of prediction are left unchanged.
+  void Apply(int step, const ACPredictionWindow& coeffs,
+             ACPredictionWindow* prediction) const;
+
+ private:
+  static constexpr int kNumSubBlocks = kACPredictionWindowSize / kDctLength;
+  static constexpr int kMaxLimit = kACPredictionStart
+                                   << (kNumACPredictionSteps - 1);
+
+  // matrices_[step][pos][d + 1][(k - k_limit) * k_limit + j] is the weight of
+  // coefficient j of sub-block i + d in the prediction of coefficient k of
+  // sub-block i, where pos is 0 for the first, 2 for the last and 1 for the
+  // interior sub-blocks of the window.
+  double matrices_[kNumACPredictionSteps][3][3][kMaxLimit * kMaxLimit] = {};
+};
+
+const ACPredictionOperator& GetACPredictionOperator();
+
+}  // namespace ringli
+
+#endif  // COMMON_AC_PREDICTION_H_
@@ -0,0 +1,76 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/ac_prediction.h"
+
+#include <random>
+
+#include "common/convolve.h"
+#include "common/data_defs/constants.h"
+#include "common/data_defs/data_vector.h"
+#include "common/dct.h"
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+// Prediction step computed with explicit transforms and convolution.
+ACPredictionWindow PredictWithTransforms(int step,
+                                         const ACPredictionWindow& coeffs) {
+  DCT<kDctLength> dct;
+  const int k_limit = kACPredictionStart << step;
+  ACPredictionWindow signal;
+  for (int i = 0; i < kACPredictionWindowSize; i += kDctLength) {
+    DataVector<double, kDctLength> dct_data;
+    for (int k = 0; k < k_limit; ++k) {
+      dct_data[k] = coeffs[i + k];
+    }
+    const DataVector<double, kDctLength> signal_data =
+        dct.ApplyInverseDCT(dct_data);
+    for (int k = 0; k < kDctLength; ++k) {
+      signal[i + k] = signal_data[k];
+    }
+  }
+  signal = Convolve(
+      CachedGaussianKernel<kDctLength>(kACPredictionSigma / k_limit), signal);
+  ACPredictionWindow prediction;
+  for (int i = 0; i < kACPredictionWindowSize; i += kDctLength) {
+    DataVector<double, kDctLength> signal_data(&signal[i]);
+    const DataVector<double, kDctLength> dct_data =
+        dct.ApplyDirectDCT(signal_data);
+    for (int k = k_limit; k < 2 * k_limit; ++k) {
+      prediction[i + k] = dct_data[k];
+    }
+  }
+  return prediction;
+}
+
+TEST(ACPredictionTest, MatchesTransformChain) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> dist(-3000.0, 3000.0);
+  ACPredictionWindow coeffs;
+  for (int i = 0; i < kACPredictionWindowSize; ++i) {
+    coeffs[i] = dist(rng);
+  }
+  const ACPredictionOperator& ac_prediction = GetACPredictionOperator();
+  for (int step = 0; step < kNumACPredictionSteps; ++step) {
+    ACPredictionWindow prediction;
+    ac_prediction.Apply(step, coeffs, &prediction);
+    const ACPredictionWindow expected = PredictWithTransforms(step, coeffs);
+    EXPECT_LT((prediction - expected).AbsMax(), 1e-8) << "step=" << step;
+  }
+}
+
+}  // namespace
+}  // namespace ringli
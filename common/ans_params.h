@@ -24,6 +24,8 @@ constexpr int ANS_LOG_TAB_SIZE = 10;
 constexpr int ANS_TAB_SIZE = (1 << ANS_LOG_TAB_SIZE);
 constexpr int ANS_TAB_MASK = ANS_TAB_SIZE - 1;
 constexpr int ANS_SIGNATURE = 0x13;  // Initial state, used as CRC.
+// Maximum number of interleaved ANS states.
+constexpr int kMaxANSStates = 8;
 
 // Returns the precision (number of bits) that should be used to store
 // a histogram count such that Log2Floor(count) == logcount.
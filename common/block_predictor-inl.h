@@ -0,0 +1,196 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-target kernels of the block-predictive mode, included by
+// block_predictor.cc and by the tests that run them on every target.
+
+#if defined(COMMON_BLOCK_PREDICTOR_INL_H_) == defined(HWY_TARGET_TOGGLE)
+#ifdef COMMON_BLOCK_PREDICTOR_INL_H_
+#undef COMMON_BLOCK_PREDICTOR_INL_H_
+#else
+#define COMMON_BLOCK_PREDICTOR_INL_H_
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+#include "common/block_predictor.h"
+#include "common/data_defs/constants.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+
+// Sets predictions[i] for i in [begin, end) to the filter output of
+// BlockPredictor, begin must be at least order. Each lane adds the products
+// in the same order and with separate multiplications and additions as the
+// scalar filter, so that the predictions are bit-identical. This relies on the
+// build disabling floating-point contraction, see -ffp-contract=off in the
+// top-level CMakeLists.txt.
+static void FilterHistory(const float* HWY_RESTRICT pcoefs, int order,
+                          const float* HWY_RESTRICT history, size_t begin,
+                          size_t end, float* HWY_RESTRICT predictions) {
+  const hn::ScalableTag<float> df;
+  const size_t lanes = hn::Lanes(df);
+  size_t i = begin;
+  for (; i + lanes <= end; i += lanes) {
+    auto prediction = hn::Zero(df);
+    for (int p = 0; p < order; ++p) {
+      const auto product =
+          hn::Mul(hn::Set(df, pcoefs[p]), hn::LoadU(df, history + i - 1 - p));
+      prediction = hn::Add(prediction, product);
+    }
+    hn::StoreU(prediction, df, predictions + i);
+  }
+  for (; i < end; ++i) {
+    float prediction = 0.0f;
+    for (int p = 0; p < order; ++p) {
+      prediction += pcoefs[p] * history[i - 1 - p];
+    }
+    predictions[i] = prediction;
+  }
+}
+
+using DF = hn::CappedTag<float, kMaxSynthesisLanes>;
+using DI = hn::RebindToSigned<DF>;
+
+// Returns x rounded to the nearest integer with halfway cases rounded away
+// from zero, like std::round().
+HWY_INLINE hn::VFromD<DF> RoundHalfAway(DF df, hn::VFromD<DF> x) {
+  const auto truncated = hn::Trunc(x);
+  const auto away = hn::Ge(hn::Abs(hn::Sub(x, truncated)), hn::Set(df, 0.5f));
+  const auto step = hn::CopySign(hn::Set(df, 1.0f), x);
+  return hn::Add(truncated, hn::IfThenElseZero(away, step));
+}
+
+// Runs the synthesis filter of BlockPredictor for the samples [begin, end) of
+// the channels in the lanes of the interleaved history and samples, which
+// hold the residuals on input and the decoded samples on output. The
+// coefficients of the lower order channels are padded with zeros, adding
+// their products after the others leaves the decoded samples unchanged.
+template <int kOrder>
+void FilterChannels(const float* HWY_RESTRICT coeffs, int quant, size_t begin,
+                    size_t end, float* HWY_RESTRICT history,
+                    int32_t* HWY_RESTRICT samples) {
+  const DF df;
+  const DI di;
+  const size_t lanes = hn::Lanes(df);
+  const auto vquant = hn::Set(di, quant);
+  for (size_t i = begin; i < end; ++i) {
+    auto prediction = hn::Zero(df);
+    for (int p = 0; p < kOrder; ++p) {
+      const auto product = hn::Mul(hn::Load(df, coeffs + p * lanes),
+                                   hn::Load(df, history + (i - 1 - p) * lanes));
+      prediction = hn::Add(prediction, product);
+    }
+    if (quant == 1) prediction = RoundHalfAway(df, prediction);
+    const auto residual =
+        hn::ConvertTo(df, hn::Mul(vquant, hn::Load(di, samples + i * lanes)));
+    const auto sample = hn::Add(prediction, residual);
+    hn::Store(sample, df, history + i * lanes);
+    hn::Store(hn::ConvertTo(di, RoundHalfAway(df, sample)), di,
+              samples + i * lanes);
+  }
+}
+
+typedef void (*FilterChannelsFn)(const float*, int, size_t, size_t, float*,
+                                 int32_t*);
+
+template <size_t... kOrders>
+constexpr std::array<FilterChannelsFn, sizeof...(kOrders)> FilterChannelsFns(
+    std::index_sequence<kOrders...>) {
+  return {&FilterChannels<kOrders>...};
+}
+
+// Decodes a block of each of the num_channels channels, pcoefs holds
+// kMaxPredictorOrder coefficients per channel.
+static void SynthesizeChannels(const float* HWY_RESTRICT pcoefs,
+                               const int* orders, size_t num_channels,
+                               int quant, const int32_t* const* residuals,
+                               int32_t* const* output) {
+  static constexpr std::array<FilterChannelsFn, kMaxPredictorOrder + 1>
+      kFilters = FilterChannelsFns(
+          std::make_index_sequence<kMaxPredictorOrder + 1>());
+  const DF df;
+  const size_t lanes = hn::Lanes(df);
+  HWY_ALIGN float history[kMaxSynthesisLanes * kRingliBlockSize];
+  HWY_ALIGN int32_t samples[kMaxSynthesisLanes * kRingliBlockSize];
+  HWY_ALIGN float coeffs[kMaxSynthesisLanes * kMaxPredictorOrder];
+  for (size_t first = 0; first < num_channels; first += lanes) {
+    const size_t n = std::min(lanes, num_channels - first);
+    int max_order = 0;
+    for (size_t j = 0; j < n; ++j) {
+      max_order = std::max(max_order, orders[first + j]);
+    }
+    const size_t warmup = std::max(max_order, 2);
+    std::fill(coeffs, coeffs + max_order * lanes, 0.0f);
+    if (n < lanes) {
+      std::fill(history, history + warmup * lanes, 0.0f);
+      std::fill(samples, samples + kRingliBlockSize * lanes, 0);
+    }
+    for (size_t j = 0; j < n; ++j) {
+      const float* channel_pcoefs = pcoefs + (first + j) * kMaxPredictorOrder;
+      const int order = orders[first + j];
+      const int32_t* channel_residuals = residuals[first + j];
+      for (int p = 0; p < order; ++p) {
+        coeffs[p * lanes + j] = channel_pcoefs[p];
+      }
+      // The first samples are decoded one by one, since they do not have
+      // enough history for the filter of every channel.
+      float prelude[kMaxPredictorOrder];
+      for (size_t i = 0; i < warmup; ++i) {
+        float prediction;
+        if (i < std::max(order, 2)) {
+          prediction = BlockWarmupPrediction(prelude, i, order);
+        } else {
+          prediction = 0.0f;
+          for (int p = 0; p < order; ++p) {
+            prediction += channel_pcoefs[p] * prelude[i - 1 - p];
+          }
+        }
+        if (quant == 1) prediction = std::round(prediction);
+        const float residual = quant * channel_residuals[i];
+        prelude[i] = prediction + residual;
+        history[i * lanes + j] = prelude[i];
+        samples[i * lanes + j] = std::round(prelude[i]);
+      }
+      for (size_t i = warmup; i < kRingliBlockSize; ++i) {
+        samples[i * lanes + j] = channel_residuals[i];
+      }
+    }
+    kFilters[max_order](coeffs, quant, warmup, kRingliBlockSize, history,
+                        samples);
+    for (size_t j = 0; j < n; ++j) {
+      int32_t* channel_output = output[first + j];
+      for (size_t i = 0; i < kRingliBlockSize; ++i) {
+        channel_output[i] = samples[i * lanes + j];
+      }
+    }
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#endif  // COMMON_BLOCK_PREDICTOR_INL_H_
@@ -17,18 +17,33 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdio>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Dense"
+#include "absl/container/inlined_vector.h"
 #include "absl/log/check.h"
 #include "absl/types/span.h"
 #include "common/data_defs/constants.h"
 #include "common/ringli_header.h"
 
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/block_predictor.cc"
+#include "hwy/foreach_target.h"
+// Must come after foreach_target.h.
+#include "common/block_predictor-inl.h"
+#include "hwy/highway.h"
+
+#if HWY_ONCE
+
 namespace ringli {
+
+HWY_EXPORT(FilterHistory);
+HWY_EXPORT(SynthesizeChannels);
+
 namespace {
 
 // Returns true if the synthesis filter defined by the prediction coefficients
@@ -38,7 +53,8 @@ static bool IsInversePredictionFilterStable(const float* pcoefs, int order) {
   // See eqs (50) and (51) in J.Makhoul, "Linear Prediction: A Tutorial
   // Review", Proceedings of the IEEE, vol. 63, pp. 561-580
   const int P = order;
-  std::vector<double> reflected_coefs(P + 1);
+  CHECK_LE(P, kMaxPredictorOrder);
+  double reflected_coefs[kMaxPredictorOrder + 1];
   reflected_coefs[0] = 1.0;
   for (int p = 1; p <= P; ++p) {
     reflected_coefs[p] = -pcoefs[p - 1];
@@ -50,11 +66,11 @@ static bool IsInversePredictionFilterStable(const float* pcoefs, int order) {
     }
     if (i > 1) {
       double scale = 1.0 / (1.0 - ki * ki);
-      std::vector<double> tmp(P + 1);
+      double tmp[kMaxPredictorOrder + 1];
       for (int j = 1; j < i; ++j) {
         tmp[j] = (reflected_coefs[j] - ki * reflected_coefs[i - j]) * scale;
       }
-      reflected_coefs = tmp;
+      std::copy(tmp + 1, tmp + i, reflected_coefs + 1);
     }
   }
   return true;
@@ -209,7 +225,8 @@ bool ComputeLineSpectralFrequencies(const float* pcoefs, uint16_t* quant_lsf,
     while (n < M) {
       n *= 2;
     }
-    std::vector<std::pair<double, double>> values(n + 1);
+    // Only grows beyond the inline capacity after several retries.
+    absl::InlinedVector<std::pair<double, double>, 4 * kMaxM> values(n + 1);
     bool found_all_roots = false;
     for (int retry = 0; !found_all_roots && retry < 10; ++retry) {
       const double len = 1.0 / n;
@@ -285,6 +302,40 @@ bool ComputeLineSpectralFrequencies(const float* pcoefs, uint16_t* quant_lsf,
 
 }  // namespace
 
+void PredictFromHistory(const float* pcoefs, int order, const float* history,
+                        size_t len, float* predictions) {
+  const size_t warmup = std::min<size_t>(std::max(order, 2), len);
+  for (size_t i = 0; i < warmup; ++i) {
+    predictions[i] = BlockWarmupPrediction(history, i, order);
+  }
+  HWY_DYNAMIC_DISPATCH(FilterHistory)(pcoefs, order, history, warmup, len,
+                                      predictions);
+}
+
+void DecodeBlockPredictive(const RingliBlock& encoded_block, int quant,
+                           AudioBlock* decoded_block) {
+  const size_t num_channels = encoded_block.channels.GetChannels().size();
+  for (size_t first = 0; first < num_channels; first += kMaxSynthesisLanes) {
+    const size_t n = std::min(kMaxSynthesisLanes, num_channels - first);
+    float pcoefs[kMaxSynthesisLanes][kMaxPredictorOrder];
+    int orders[kMaxSynthesisLanes];
+    const int32_t* residuals[kMaxSynthesisLanes];
+    int32_t* output[kMaxSynthesisLanes];
+    for (size_t j = 0; j < n; ++j) {
+      const RingliPredictiveHeader& header =
+          encoded_block.header.pred[first + j];
+      CHECK_LE(header.order, kMaxPredictorOrder);
+      ComputeLinearPredictorCoeffs(&header.quant_lsf[0], pcoefs[j],
+                                   header.order);
+      orders[j] = header.order;
+      residuals[j] = encoded_block.channels[first + j].Data();
+      output[j] = (*decoded_block)[first + j].Data();
+    }
+    HWY_DYNAMIC_DISPATCH(SynthesizeChannels)(&pcoefs[0][0], orders, n, quant,
+                                             residuals, output);
+  }
+}
+
 void ComputeLinearPredictorCoeffs(const uint16_t* quant_lsf, float* pcoefs,
                                   int order) {
   CHECK_EQ(order % 2, 0);
@@ -313,7 +364,8 @@ void ComputeLinearPredictorCoeffs(const uint16_t* quant_lsf, float* pcoefs,
 void ComputePredictorParams(RingliPredictiveHeader* header, float* pcoefs,
                             int order) {
   CHECK(IsInversePredictionFilterStable(pcoefs, order));
-  header->quant_lsf.resize(order);
+  CHECK_LE(order, kMaxPredictorOrder);
+  header->order = order;
   if (!ComputeLineSpectralFrequencies(pcoefs, &header->quant_lsf[0], order)) {
     fprintf(stderr, "Could not find LSF, reverting to default predictor\n");
     DefaultLineSpectralFrequencies(&header->quant_lsf[0], order);
@@ -329,3 +381,5 @@ void DefaultLineSpectralFrequencies(uint16_t* quant_lsf, int order) {
 }
 
 }  // namespace ringli
+
+#endif  // HWY_ONCE
@@ -18,12 +18,12 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <memory>
-#include <utility>
-#include <vector>
+#include <algorithm>
+#include <array>
 
 #include "absl/log/check.h"
 #include "common/covariance_lattice.h"
+#include "common/data_defs/constants.h"
 #include "common/predictor.h"
 #include "common/ringli_header.h"
 
@@ -38,39 +38,65 @@ void ComputePredictorParams(RingliPredictiveHeader* header, float* pcoefs,
 
 void DefaultLineSpectralFrequencies(uint16_t* quant_lsf, int order);
 
+// Returns the prediction of BlockPredictor for the sample at the given
+// position, which must be less than max(order, 2), from the previous samples
+// in history. These first samples do not have enough history for the filter.
+inline float BlockWarmupPrediction(const float* history, int position,
+                                   int order) {
+  if (position == 0) {
+    return 0;
+  }
+  if (position == 1) {
+    return history[position - 1];
+  }
+  return 2 * history[position - 1] - history[position - 2];
+}
+
+// Sets predictions[i] to the prediction of BlockPredictor for the sample at
+// position i for i in [0, len), if history holds the previous samples. The
+// filter runs in parallel over the samples.
+void PredictFromHistory(const float* pcoefs, int order, const float* history,
+                        size_t len, float* predictions);
+
+// Maximum number of channels that DecodeBlockPredictive() filters together.
+constexpr size_t kMaxSynthesisLanes = 4;
+
+// Decodes the channels of a block of the block-predictive mode with the given
+// quantization from their residuals. The result is the same as that of
+// BlockPredictor run sample by sample, but the channels are filtered in
+// parallel, with the filter loop specialized for the predictor order.
+void DecodeBlockPredictive(const RingliBlock& encoded_block, int quant,
+                           AudioBlock* decoded_block);
+
 template <size_t kBlockSize>
 class BlockPredictor : public Predictor {
  public:
   static BlockPredictor<kBlockSize> CreateForEncoder(
       int order, RingliPredictiveHeader* header,
       CovarianceLattice<int32_t>& covlattice_orig) {
-    std::vector<float> pcoefs(order);
+    float pcoefs[kMaxPredictorOrder];
     covlattice_orig.FitPredictorCoeffs(&pcoefs[0], order);
     ComputePredictorParams(header, &pcoefs[0], order);
-    return BlockPredictor<kBlockSize>(order, std::move(pcoefs));
+    return BlockPredictor<kBlockSize>(order, pcoefs);
   }
 
-  static std::unique_ptr<Predictor> CreateForDecoder(
-      const RingliPredictiveHeader* header) {
-    const int order = header->quant_lsf.size();
-    std::vector<float> pcoefs(order);
-    ComputeLinearPredictorCoeffs(&header->quant_lsf[0], &pcoefs[0], order);
-    return std::make_unique<BlockPredictor<kBlockSize>>(order,
-                                                        std::move(pcoefs));
+  static BlockPredictor<kBlockSize> CreateForDecoder(
+      const RingliPredictiveHeader& header) {
+    float pcoefs[kMaxPredictorOrder];
+    ComputeLinearPredictorCoeffs(&header.quant_lsf[0], &pcoefs[0],
+                                 header.order);
+    return BlockPredictor<kBlockSize>(header.order, pcoefs);
   }
 
-  explicit BlockPredictor(int order, const std::vector<float>& pcoefs)
-      : position_(0), order_(order), pcoefs_(pcoefs) {}
+  BlockPredictor(int order, const float* pcoefs)
+      : position_(0), order_(order) {
+    CHECK_LE(order, kMaxPredictorOrder);
+    std::copy(pcoefs, pcoefs + order, pcoefs_.begin());
+  }
 
   float Predict() override {
-    if (position_ == 0) {
-      return 0;
-    }
-    if (position_ == 1) {
-      return history_[position_ - 1];
-    }
-    if (position_ < order_ && order_ > 2) {
-      return 2 * history_[position_ - 1] - history_[position_ - 2];
+    if (position_ < 2 || (position_ < order_ && order_ > 2)) {
+      return BlockWarmupPrediction(history_.data(), position_, order_);
     }
     float prediction = 0.0f;
     for (int p = 0; p < order_; ++p) {
@@ -86,10 +112,21 @@ class BlockPredictor : public Predictor {
 
   void Reset() override { position_ = 0; };
 
+  // Adds the whole block of samples and sets predictions to what Predict()
+  // would have returned before each of them. This is the residual filter of
+  // the lossless mode, where the predictor sees the original samples.
+  void PredictBlock(const int32_t* samples, float* predictions) {
+    DCHECK_EQ(position_, 0);
+    std::copy(samples, samples + kBlockSize, history_.begin());
+    PredictFromHistory(pcoefs_.data(), order_, history_.data(), kBlockSize,
+                       predictions);
+    position_ = kBlockSize;
+  }
+
  private:
   uint32_t position_;
   const int order_;
-  const std::vector<float> pcoefs_;
+  std::array<float, kMaxPredictorOrder> pcoefs_;
   std::array<float, kBlockSize> history_;
 };
 
@@ -17,15 +17,132 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cmath>
+#include <random>
+#include <vector>
 
 #include "Eigen/Dense"
+#include "common/covariance_lattice.h"
 #include "common/data_defs/constants.h"
 #include "common/ringli_header.h"
 #include "gtest/gtest.h"
 
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/block_predictor_test.cc"
+#include "hwy/foreach_target.h"
+// Must come after foreach_target.h.
+#include "common/block_predictor-inl.h"
+#include "hwy/highway.h"
+#include "hwy/tests/hwy_gtest.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+// Returns a block of a sine with noise, with a different frequency for each
+// seed.
+std::vector<int32_t> TestSignal(int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int32_t> noise(-100, 100);
+  std::vector<int32_t> samples(kRingliBlockSize);
+  for (size_t i = 0; i < kRingliBlockSize; ++i) {
+    samples[i] = std::round(8000 * std::sin(0.01 * seed * i)) + noise(rng);
+  }
+  return samples;
+}
+
+void TestFilterHistoryMatchesPredict() {
+  const std::vector<int32_t> samples = TestSignal(1);
+  const std::vector<float> history(samples.begin(), samples.end());
+  for (int order : {2, 6, 16}) {
+    CovarianceLattice<int32_t> lattice(samples.data(), kRingliBlockSize,
+                                       kMaxPredictorOrder, 1.0 / 12);
+    RingliPredictiveHeader header;
+    BlockPredictor<kRingliBlockSize> predictor =
+        BlockPredictor<kRingliBlockSize>::CreateForEncoder(order, &header,
+                                                           lattice);
+    float pcoefs[kMaxPredictorOrder];
+    ComputeLinearPredictorCoeffs(&header.quant_lsf[0], pcoefs, order);
+    float predictions[kRingliBlockSize];
+    const size_t warmup = std::max(order, 2);
+    for (size_t i = 0; i < warmup; ++i) {
+      predictions[i] = BlockWarmupPrediction(history.data(), i, order);
+    }
+    FilterHistory(pcoefs, order, history.data(), warmup, kRingliBlockSize,
+                  predictions);
+    for (size_t i = 0; i < kRingliBlockSize; ++i) {
+      ASSERT_EQ(predictor.Predict(), predictions[i])
+          << "order=" << order << " i=" << i;
+      predictor.AddNewSample(samples[i]);
+    }
+  }
+}
+
+void TestSynthesizeChannelsMatchesPredict() {
+  // More channels than are filtered together, with different orders.
+  const int kOrders[] = {8, 2, 16, 4, 12, 6};
+  const size_t num_channels = sizeof(kOrders) / sizeof(kOrders[0]);
+  for (int quant : {1, 7}) {
+    float pcoefs[num_channels][kMaxPredictorOrder];
+    std::vector<std::vector<int32_t>> residuals(num_channels);
+    std::vector<std::vector<int32_t>> expected(num_channels);
+    for (size_t c = 0; c < num_channels; ++c) {
+      const std::vector<int32_t> samples = TestSignal(c + 1);
+      CovarianceLattice<int32_t> lattice(samples.data(), kRingliBlockSize,
+                                         kMaxPredictorOrder, 1.0 / 12);
+      RingliPredictiveHeader header;
+      BlockPredictor<kRingliBlockSize>::CreateForEncoder(kOrders[c], &header,
+                                                         lattice);
+      ComputeLinearPredictorCoeffs(&header.quant_lsf[0], pcoefs[c],
+                                   kOrders[c]);
+      BlockPredictor<kRingliBlockSize> predictor =
+          BlockPredictor<kRingliBlockSize>::CreateForDecoder(header);
+      for (size_t i = 0; i < kRingliBlockSize; ++i) {
+        float prediction = predictor.Predict();
+        if (quant == 1) prediction = std::round(prediction);
+        const int32_t residual = std::round((samples[i] - prediction) / quant);
+        residuals[c].push_back(residual);
+        const float sample = prediction + quant * residual;
+        predictor.AddNewSample(sample);
+        expected[c].push_back(std::round(sample));
+      }
+    }
+    std::vector<std::vector<int32_t>> decoded(
+        num_channels, std::vector<int32_t>(kRingliBlockSize));
+    const int32_t* residual_ptrs[num_channels];
+    int32_t* decoded_ptrs[num_channels];
+    for (size_t c = 0; c < num_channels; ++c) {
+      residual_ptrs[c] = residuals[c].data();
+      decoded_ptrs[c] = decoded[c].data();
+    }
+    SynthesizeChannels(&pcoefs[0][0], kOrders, num_channels, quant,
+                       residual_ptrs, decoded_ptrs);
+    for (size_t c = 0; c < num_channels; ++c) {
+      for (size_t i = 0; i < kRingliBlockSize; ++i) {
+        ASSERT_EQ(decoded[c][i], expected[c][i])
+            << "quant=" << quant << " c=" << c << " i=" << i;
+      }
+    }
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+
 namespace ringli {
 
+HWY_BEFORE_TEST(BlockPredictorTargetTest);
+HWY_EXPORT_AND_TEST_P(BlockPredictorTargetTest,
+                      TestFilterHistoryMatchesPredict);
+HWY_EXPORT_AND_TEST_P(BlockPredictorTargetTest,
+                      TestSynthesizeChannelsMatchesPredict);
+HWY_AFTER_TEST();
+
 TEST(BlockPredictorTest, DefaultLineSpectralFrequencies) {
   constexpr int kOrder = 8;
   uint16_t quant_lsf[kOrder];
@@ -63,3 +180,7 @@ TEST(BlockPredictorTest, Roundtrip) {
 }
 
 }  // namespace ringli
+
+HWY_TEST_MAIN();
+
+#endif  // HWY_ONCE
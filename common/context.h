@@ -120,8 +120,29 @@ class PredictiveContextModel {
     return num;
   }
 
- private:
+  // Returns twice the log2 of the typical absolute value of the value before
+  // the last i values in context ctx, or -2 if that value is zero.
+  int PreviousMagnitude(int ctx, int i) const {
+    DCHECK_LT(i, kOrder);
+    const int num_classes = nbits_context_map_[i][kMaxNumBits] + 1;
+    const int nbits_ctx =
+        ((ctx / context_mul_[i]) % (2 * num_classes - 1) + 1) / 2;
+    if (nbits_ctx == 0) return -2;
+    int min_nbits = kMaxNumBits;
+    int max_nbits = 0;
+    for (int nbits = 0; nbits <= kMaxNumBits; ++nbits) {
+      if (nbits_context_map_[i][nbits] == nbits_ctx) {
+        min_nbits = std::min(min_nbits, nbits);
+        max_nbits = nbits;
+      }
+    }
+    // The values with nbits bits are in [2^(nbits - 1), 2^nbits).
+    return min_nbits - 1 + max_nbits;
+  }
+
   static constexpr int kOrder = 3;
+
+ private:
   static constexpr int kMaxNumBits = 11;
   const int nbits_context_map_[kOrder][kMaxNumBits + 1] = {
       {0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6},
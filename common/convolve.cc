@@ -0,0 +1,76 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/convolve.h"
+
+#include <stddef.h>
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/convolve.cc"
+#include "hwy/foreach_target.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+using DD = hn::ScalableTag<double>;
+constexpr DD dd;
+
+// The taps are accumulated in the same order and with separate multiplies and
+// additions as in the scalar clamped loop, so the results are identical.
+void ConvolveUnclamped(const double* HWY_RESTRICT input, size_t num_outputs,
+                       const double* HWY_RESTRICT kernel, size_t width,
+                       double* HWY_RESTRICT output) {
+  const double* start = input - width / 2;
+  const size_t lanes = hn::Lanes(dd);
+  size_t i = 0;
+  for (; i + lanes <= num_outputs; i += lanes) {
+    auto sum = hn::Zero(dd);
+    for (size_t j = 0; j < width; ++j) {
+      const auto tap = hn::Set(dd, kernel[j]);
+      sum = hn::Add(sum, hn::Mul(hn::LoadU(dd, start + i + j), tap));
+    }
+    hn::StoreU(sum, dd, output + i);
+  }
+  for (; i < num_outputs; ++i) {
+    double sum = 0;
+    for (size_t j = 0; j < width; ++j) {
+      sum += start[i + j] * kernel[j];
+    }
+    output[i] = sum;
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+
+namespace ringli {
+
+HWY_EXPORT(ConvolveUnclamped);
+
+void ConvolveUnclamped(const double* input, size_t num_outputs,
+                       const double* kernel, size_t width, double* output) {
+  HWY_DYNAMIC_DISPATCH(ConvolveUnclamped)(input, num_outputs, kernel, width,
+                                          output);
+}
+
+}  // namespace ringli
+
+#endif  // HWY_ONCE
@@ -15,8 +15,13 @@
 #ifndef COMMON_CONVOLVE_H_
 #define COMMON_CONVOLVE_H_
 
+#include <stddef.h>
+
 #include <algorithm>
 #include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
 
 #include "common/data_defs/data_vector.h"
 
@@ -37,6 +42,29 @@ DataVector<double, 2 * K + 1> GaussianKernel(double sigma) {
   return res;
 }
 
+// Same as GaussianKernel(), but computes each distinct kernel only once per
+// process. The returned reference stays valid until the end of the process.
+template <int K>
+const DataVector<double, 2 * K + 1>& CachedGaussianKernel(double sigma) {
+  static std::mutex* mutex = new std::mutex();
+  static auto* cache =
+      new std::map<double, std::unique_ptr<DataVector<double, 2 * K + 1>>>();
+  std::lock_guard<std::mutex> lock(*mutex);
+  auto& kernel = (*cache)[sigma];
+  if (!kernel) {
+    kernel = std::make_unique<DataVector<double, 2 * K + 1>>(
+        GaussianKernel<K>(sigma));
+  }
+  return *kernel;
+}
+
+// Computes output[i] for num_outputs consecutive outputs without clamping,
+// i.e. input[i - width / 2, i + width / 2] must all be valid.
+void ConvolveUnclamped(const double* input, size_t num_outputs,
+                       const double* kernel, size_t width, double* output);
+
+// Convolves data with kernel, the samples outside of data are taken to be
+// equal to the nearest sample in data.
 template <int W, int SIZE>
 DataVector<double, SIZE> Convolve(const DataVector<double, W>& kernel,
                                   const DataVector<double, SIZE>& data) {
@@ -44,13 +72,23 @@ DataVector<double, SIZE> Convolve(const DataVector<double, W>& kernel,
   static_assert(W % 2 == 1);
   constexpr int K = W / 2;
   DataVector<double, SIZE> res;
-  for (int i = 0; i < SIZE; ++i) {
+  const auto clamped_sum = [&](int i) {
     double sum = 0;
     for (int j = -K; j <= K; ++j) {
       int idx = std::max(0, std::min(SIZE - 1, i + j));
       sum += data[idx] * kernel[K + j];
     }
-    res[i] = sum;
+    return sum;
+  };
+  for (int i = 0; i < K; ++i) {
+    res[i] = clamped_sum(i);
+  }
+  // The interior, where no sample is clamped, must not be empty, otherwise
+  // its size below wraps around.
+  static_assert(SIZE >= 2 * K);
+  ConvolveUnclamped(&data[K], SIZE - 2 * K, &kernel[0], W, &res[K]);
+  for (int i = SIZE - K; i < SIZE; ++i) {
+    res[i] = clamped_sum(i);
   }
   return res;
 }
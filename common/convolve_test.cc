@@ -0,0 +1,54 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/convolve.h"
+
+#include <algorithm>
+#include <random>
+
+#include "common/data_defs/data_vector.h"
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+TEST(ConvolveTest, MatchesClampedDirectConvolution) {
+  constexpr int K = 64;
+  constexpr int kSize = 1408;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  DataVector<double, kSize> data;
+  for (int i = 0; i < kSize; ++i) {
+    data[i] = dist(rng);
+  }
+  const DataVector<double, 2 * K + 1> kernel = GaussianKernel<K>(4.0);
+  const DataVector<double, kSize> result = Convolve(kernel, data);
+  for (int i = 0; i < kSize; ++i) {
+    double expected = 0;
+    for (int j = -K; j <= K; ++j) {
+      expected += data[std::max(0, std::min(kSize - 1, i + j))] * kernel[K + j];
+    }
+    EXPECT_NEAR(result[i], expected, 1e-9) << "i=" << i;
+  }
+}
+
+TEST(ConvolveTest, CachedGaussianKernel) {
+  const auto& kernel = CachedGaussianKernel<8>(2.0);
+  EXPECT_EQ(&kernel, &CachedGaussianKernel<8>(2.0));
+  EXPECT_NE(&kernel, &CachedGaussianKernel<8>(3.0));
+  EXPECT_TRUE(kernel == GaussianKernel<8>(2.0));
+}
+
+}  // namespace
+}  // namespace ringli
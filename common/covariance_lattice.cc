@@ -0,0 +1,76 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/covariance_lattice.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/covariance_lattice.cc"
+#include "hwy/foreach_target.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+using DD = hn::ScalableTag<double>;
+using DI = hn::Rebind<int32_t, DD>;
+
+// The samples are converted to double, where their products and the sums of
+// the products are exact, so the summation order does not change the result.
+double LaggedProductSum(const int32_t* HWY_RESTRICT data, size_t begin,
+                        size_t end, size_t lag) {
+  const DD dd;
+  const DI di;
+  const size_t lanes = hn::Lanes(dd);
+  auto sum0 = hn::Zero(dd);
+  auto sum1 = hn::Zero(dd);
+  size_t n = begin;
+  for (; n + 2 * lanes <= end; n += 2 * lanes) {
+    const auto x0 = hn::PromoteTo(dd, hn::LoadU(di, data + n));
+    const auto y0 = hn::PromoteTo(dd, hn::LoadU(di, data + n - lag));
+    const auto x1 = hn::PromoteTo(dd, hn::LoadU(di, data + n + lanes));
+    const auto y1 = hn::PromoteTo(dd, hn::LoadU(di, data + n + lanes - lag));
+    sum0 = hn::MulAdd(x0, y0, sum0);
+    sum1 = hn::MulAdd(x1, y1, sum1);
+  }
+  double sum = hn::ReduceSum(dd, hn::Add(sum0, sum1));
+  for (; n < end; ++n) {
+    sum += static_cast<double>(data[n]) * data[n - lag];
+  }
+  return sum;
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+
+namespace ringli {
+
+HWY_EXPORT(LaggedProductSum);
+
+double LaggedProductSum(const int32_t* data, size_t begin, size_t end,
+                        size_t lag) {
+  return HWY_DYNAMIC_DISPATCH(LaggedProductSum)(data, begin, end, lag);
+}
+
+}  // namespace ringli
+
+#endif  // HWY_ONCE
@@ -15,17 +15,36 @@
 #ifndef COMMON_COVARIANCE_LATTICE_H_
 #define COMMON_COVARIANCE_LATTICE_H_
 
-#include <cstddef>
-#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
 
 #include "Eigen/Core"
 #include "absl/log/check.h"
+#include "common/data_defs/constants.h"
+
 namespace ringli {
 
+// Returns the sum of data[n] * data[n - lag] for n in [begin, end), which is
+// exact for 16-bit samples.
+double LaggedProductSum(const int32_t* data, size_t begin, size_t end,
+                        size_t lag);
+
+template <typename T>
+double LaggedProductSum(const T* data, size_t begin, size_t end, size_t lag) {
+  double sum = 0;
+  for (size_t n = begin; n < end; ++n) {
+    sum += data[n] * data[n - lag];
+  }
+  return sum;
+}
+
 // Implementation of the "covariance lattice method" for computing optimal
 // linear predictor parameters, as described in the following paper:
 // J. Makhoul, "New lattice methods for linear prediction", in IEEE Int. Conf.
 // Acoust., Speech Signal Process., pp 462-465
+// All state is stored inline, the order is limited to kMaxPredictorOrder.
 template <typename T>
 class CovarianceLattice {
  public:
@@ -35,21 +54,17 @@ class CovarianceLattice {
         len_(len),
         max_order_(max_order),
         last_order_(0),
-        covariance_(Eigen::MatrixXd::Zero(max_order_ + 1, max_order_ + 1)),
-        reflection_coeffs_(max_order_ + 1),
-        a_(max_order_ + 1) {
-    for (int n = max_order_; n < len_; ++n) {
-      covariance_(0, 0) += data_[n] * data_[n];
-    }
+        covariance_(CovarianceMatrix::Zero(max_order_ + 1, max_order_ + 1)) {
+    CHECK_LE(max_order, kMaxPredictorOrder);
+    covariance_(0, 0) = LaggedProductSum(data_, max_order_, len_, 0);
     covariance_(0, 0) += regulariser * (len_ - max_order_);
+    residual_energy_[0] = covariance_(0, 0);
   }
 
   void FitCoeffsCommon(int order) {
     CHECK_GT(order, last_order_);
     for (int i = last_order_ + 1; i <= order; ++i) {
-      for (int n = max_order_; n < len_; ++n) {
-        covariance_(0, i) += data_[n] * data_[n - i];
-      }
+      covariance_(0, i) = LaggedProductSum(data_, max_order_, len_, i);
     }
     for (int i = 0; i < order; ++i) {
       const int prev_i = max_order_ - 1 - i;
@@ -94,40 +109,81 @@ class CovarianceLattice {
       }
       CHECK_GE(denom, 0);
       reflection_coeffs_[m + 1] = denom > 1e-3 ? -2 * num / denom : 0.0;
-      std::vector<double> next_a(max_order_ + 1);
-      next_a[m + 1] = reflection_coeffs_[m + 1];
-      for (int j = 1; j <= m; ++j) {
-        next_a[j] = a_[j] + reflection_coeffs_[m + 1] * a_[m + 1 - j];
+      StepUp(m, &a_);
+      double energy = covariance_(0, 0);
+      for (int k = 1; k <= m + 1; ++k) {
+        double row = covariance_(0, k);
+        for (int i = 1; i < k; ++i) {
+          row += a_[i] * covariance_(i, k);
+        }
+        energy += a_[k] * (2 * row + a_[k] * covariance_(k, k));
       }
-      a_ = next_a;
+      residual_energy_[m + 1] = energy;
     }
     last_order_ = order;
   }
 
+  // Returns the regularised energy of the forward prediction error of the
+  // predictor of the given order over the samples [max_order, len), which
+  // must not be larger than the last fitted order.
+  double ResidualEnergy(int order) const {
+    DCHECK_LE(order, last_order_);
+    return residual_energy_[order];
+  }
+
+  // Orders that are not larger than the last fitted order are recomputed from
+  // the reflection coefficients instead of being fitted again.
   template <typename TCoef>
   void FitPredictorCoeffs(TCoef* pcoefs, int order) {
-    FitCoeffsCommon(order);
+    Coeffs a = {};
+    if (order > last_order_) {
+      FitCoeffsCommon(order);
+      a = a_;
+    } else {
+      for (int m = 0; m < order; ++m) {
+        StepUp(m, &a);
+      }
+    }
     for (int p = 0; p < order; ++p) {
-      pcoefs[p] = -a_[p + 1];
+      pcoefs[p] = -a[p + 1];
     }
   }
 
   template <typename TCoef>
   void FitReflectionCoeffs(TCoef* k, int order) {
-    FitCoeffsCommon(order);
+    if (order > last_order_) FitCoeffsCommon(order);
     for (int p = 0; p <= order; ++p) {
       k[p] = reflection_coeffs_[p];
     }
   }
 
  private:
+  typedef std::array<double, kMaxPredictorOrder + 1> Coeffs;
+
+  // Extends the predictor coefficients a of order m to order m + 1 with the
+  // reflection coefficient of order m + 1 (Levinson step-up recursion).
+  void StepUp(int m, Coeffs* a) const {
+    const double k = reflection_coeffs_[m + 1];
+    Coeffs next_a = {};
+    next_a[m + 1] = k;
+    for (int j = 1; j <= m; ++j) {
+      next_a[j] = (*a)[j] + k * (*a)[m + 1 - j];
+    }
+    *a = next_a;
+  }
+
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor,
+                        kMaxPredictorOrder + 1, kMaxPredictorOrder + 1>
+      CovarianceMatrix;
+
   const T* const data_;
   const int len_;
   const int max_order_;
   int last_order_;
-  Eigen::MatrixXd covariance_;
-  std::vector<double> reflection_coeffs_;
-  std::vector<double> a_;
+  CovarianceMatrix covariance_;
+  Coeffs reflection_coeffs_ = {};
+  Coeffs a_ = {};
+  Coeffs residual_energy_ = {};
 };
 
 }  // namespace ringli
@@ -0,0 +1,123 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/covariance_lattice.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "common/data_defs/constants.h"
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+std::vector<int32_t> RandomSamples(size_t len) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int32_t> dist(-32768, 32767);
+  std::vector<int32_t> data(len);
+  for (int32_t& x : data) x = dist(rng);
+  return data;
+}
+
+TEST(CovarianceLatticeTest, LaggedProductSumIsExact) {
+  const std::vector<int32_t> data = RandomSamples(kRingliBlockSize);
+  for (size_t begin : {kMaxPredictorOrder, kMaxPredictorOrder + 3}) {
+    for (size_t end : {kRingliBlockSize, kRingliBlockSize - 5}) {
+      for (size_t lag = 0; lag <= kMaxPredictorOrder; ++lag) {
+        int64_t expected = 0;
+        for (size_t n = begin; n < end; ++n) {
+          expected += int64_t{data[n]} * data[n - lag];
+        }
+        EXPECT_EQ(LaggedProductSum(data.data(), begin, end, lag),
+                  static_cast<double>(expected))
+            << "begin=" << begin << " end=" << end << " lag=" << lag;
+      }
+    }
+  }
+}
+
+TEST(CovarianceLatticeTest, IntegerAndDoubleSamplesGiveSameCoeffs) {
+  const std::vector<int32_t> data = RandomSamples(kRingliBlockSize);
+  const std::vector<double> double_data(data.begin(), data.end());
+  CovarianceLattice<int32_t> int_lattice(data.data(), data.size(),
+                                         kMaxPredictorOrder, 1.0);
+  CovarianceLattice<double> double_lattice(
+      double_data.data(), double_data.size(), kMaxPredictorOrder, 1.0);
+  for (int order = 2; order <= kMaxPredictorOrder; order += 2) {
+    double int_coeffs[kMaxPredictorOrder];
+    double double_coeffs[kMaxPredictorOrder];
+    int_lattice.FitPredictorCoeffs(int_coeffs, order);
+    double_lattice.FitPredictorCoeffs(double_coeffs, order);
+    for (int p = 0; p < order; ++p) {
+      EXPECT_EQ(int_coeffs[p], double_coeffs[p]) << "order=" << order;
+    }
+  }
+}
+
+TEST(CovarianceLatticeTest, LowerOrdersAfterHigherOrderGiveSameCoeffs) {
+  const std::vector<int32_t> data = RandomSamples(kRingliBlockSize);
+  CovarianceLattice<int32_t> increasing(data.data(), data.size(),
+                                        kMaxPredictorOrder, 1.0);
+  CovarianceLattice<int32_t> decreasing(data.data(), data.size(),
+                                        kMaxPredictorOrder, 1.0);
+  decreasing.FitCoeffsCommon(kMaxPredictorOrder);
+  for (int order = 2; order <= kMaxPredictorOrder; order += 2) {
+    double expected[kMaxPredictorOrder];
+    double coeffs[kMaxPredictorOrder];
+    increasing.FitPredictorCoeffs(expected, order);
+    decreasing.FitPredictorCoeffs(coeffs, order);
+    for (int p = 0; p < order; ++p) {
+      EXPECT_EQ(coeffs[p], expected[p]) << "order=" << order;
+    }
+  }
+}
+
+TEST(CovarianceLatticeTest, ResidualEnergyMatchesResiduals) {
+  // First order autoregressive signal, so that the energy depends on the
+  // order.
+  const std::vector<int32_t> noise = RandomSamples(kRingliBlockSize);
+  std::vector<int32_t> data(kRingliBlockSize);
+  double state = 0;
+  for (size_t n = 0; n < data.size(); ++n) {
+    state = 0.9 * state + 0.1 * noise[n];
+    data[n] = std::round(state);
+  }
+  const double regulariser = 0.5;
+  CovarianceLattice<int32_t> lattice(data.data(), data.size(),
+                                     kMaxPredictorOrder, regulariser);
+  lattice.FitCoeffsCommon(kMaxPredictorOrder);
+  for (int order = 0; order <= kMaxPredictorOrder; ++order) {
+    double coeffs[kMaxPredictorOrder];
+    lattice.FitPredictorCoeffs(coeffs, order);
+    double sum_squares = 1;
+    for (int p = 0; p < order; ++p) sum_squares += coeffs[p] * coeffs[p];
+    double expected =
+        regulariser * (kRingliBlockSize - kMaxPredictorOrder) * sum_squares;
+    for (size_t n = kMaxPredictorOrder; n < data.size(); ++n) {
+      double residual = data[n];
+      for (int p = 0; p < order; ++p) residual -= coeffs[p] * data[n - 1 - p];
+      expected += residual * residual;
+    }
+    EXPECT_NEAR(lattice.ResidualEnergy(order), expected, 1e-9 * expected)
+        << "order=" << order;
+  }
+}
+
+}  // namespace
+}  // namespace ringli
@@ -22,7 +22,11 @@
 #include "common/data_defs/data_vector.h"
 namespace ringli {
 
-constexpr char kRingliId[8] = "RINGLI ";
+constexpr char kRingliId[8] = "RINGLI1";
+// Id of the streams of the original format, whose header has no other entropy
+// coding parameters than arithmetic_only, and whose online predictors round
+// differently, see RingliLegacyHeader.
+constexpr char kRingliLegacyId[8] = "RINGLI ";
 
 constexpr size_t kRingliBlockSize = 1024;
 constexpr size_t kOnlinePredictorBufferSize = 512;
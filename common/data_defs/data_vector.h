@@ -15,46 +15,28 @@
 #ifndef COMMON_DATA_DEFS_DATA_VECTOR_H_
 #define COMMON_DATA_DEFS_DATA_VECTOR_H_
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <vector>
 
 namespace ringli {
 
+// Fixed-size vector with inline storage, so that creating, copying and moving
+// it never touches the heap.
 template <typename T, int SIZE>
 class DataVector {
  public:
-  explicit DataVector(const T* data) {
-    AllocateData();
-    CopyData(data);
-  }
-
-  explicit DataVector(const std::vector<T>& data) {
-    AllocateData();
-    CopyData(data.data());
-  }
-
-  DataVector(const DataVector<T, SIZE>& other_vector) {
-    AllocateData();
-    CopyData(other_vector.data_);
-  }
+  explicit DataVector(const T* data) { CopyData(data); }
 
-  DataVector(DataVector<T, SIZE>&& other_vector) {
-    AllocateData();
-    CopyData(other_vector.data_);
-  }
+  explicit DataVector(const std::vector<T>& data) { CopyData(data.data()); }
 
-  ~DataVector() { delete[] data_; }
+  DataVector(const DataVector<T, SIZE>& other_vector) = default;
 
-  DataVector() {
-    AllocateData();
-    memset(data_, 0, SIZE * sizeof(T));
-  }
+  DataVector() { memset(data_, 0, SIZE * sizeof(T)); }
 
-  DataVector<T, SIZE>& operator=(const DataVector<T, SIZE>& other_vector) {
-    CopyData(other_vector.data_);
-    return *this;
-  }
+  DataVector<T, SIZE>& operator=(const DataVector<T, SIZE>& other_vector) =
+      default;
 
   bool operator==(const DataVector<T, SIZE>& other_vector) const {
     return 0 == std::memcmp(data_, other_vector.data_, SIZE * sizeof(T));
@@ -108,9 +90,8 @@ class DataVector {
   }
 
  private:
-  void AllocateData() { data_ = new T[SIZE]; }
   void CopyData(const T* data) { std::copy(data, data + SIZE, data_); }
-  T* data_ = nullptr;
+  T data_[SIZE];
 };
 
 template <typename T, int SIZE>
@@ -0,0 +1,205 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/dct.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "absl/log/check.h"
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/dct.cc"
+#include "hwy/foreach_target.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+using DD = hn::ScalableTag<double>;
+constexpr DD dd;
+
+// Multipliers 1 / (2 * cos((2 * i + 1) * pi / (2 * n))) of the odd half of
+// the length n transforms, the table of length n starts at index n / 2.
+struct DCTMultipliers {
+  DCTMultipliers() {
+    for (size_t n = 2; n <= kMaxFastDCTLength; n *= 2) {
+      for (size_t i = 0; i < n / 2; ++i) {
+        values[n / 2 + i] = 0.5 / cos((2 * i + 1) * M_PI / (2 * n));
+      }
+    }
+  }
+  HWY_ALIGN double values[kMaxFastDCTLength];
+};
+
+const double* GetDCTMultipliers() {
+  static const DCTMultipliers* multipliers = new DCTMultipliers();
+  return multipliers->values;
+}
+
+// In-place unnormalised DCT-II, x[k] = sum_j x[j] * cos(pi * (j + 0.5) * k / n)
+// where n is a power of two, using scratch[0, n) as temporary storage.
+//
+// The even outputs are the length n / 2 transform of a[j] = x[j] + x[n-1-j],
+// and with b[j] = (x[j] - x[n-1-j]) / (2 * cos(pi * (j + 0.5) / n)) and B its
+// length n / 2 transform, the odd outputs are x[2 * k + 1] = B[k] + B[k + 1].
+void DirectDCT(const double* HWY_RESTRICT multipliers, double* HWY_RESTRICT x,
+               double* HWY_RESTRICT scratch, size_t n) {
+  if (n == 1) return;
+  const size_t half = n / 2;
+  const double* HWY_RESTRICT mult = multipliers + half;
+  if (n == 2) {
+    const double sum = x[0] + x[1];
+    x[1] = (x[0] - x[1]) * mult[0];
+    x[0] = sum;
+    return;
+  }
+  const size_t lanes = hn::Lanes(dd);
+  size_t i = 0;
+  if (half >= lanes) {
+    for (; i < half; i += lanes) {
+      const auto lo = hn::LoadU(dd, x + i);
+      const auto hi = hn::Reverse(dd, hn::LoadU(dd, x + n - i - lanes));
+      hn::StoreU(hn::Add(lo, hi), dd, scratch + i);
+      hn::StoreU(hn::Mul(hn::Sub(lo, hi), hn::LoadU(dd, mult + i)), dd,
+                 scratch + half + i);
+    }
+  }
+  for (; i < half; ++i) {
+    scratch[i] = x[i] + x[n - 1 - i];
+    scratch[half + i] = (x[i] - x[n - 1 - i]) * mult[i];
+  }
+  DirectDCT(multipliers, scratch, x, half);
+  DirectDCT(multipliers, scratch + half, x + half, half);
+  for (size_t k = 0; k + 1 < half; ++k) {
+    x[2 * k] = scratch[k];
+    x[2 * k + 1] = scratch[half + k] + scratch[half + k + 1];
+  }
+  x[n - 2] = scratch[half - 1];
+  x[n - 1] = scratch[n - 1];
+}
+
+// In-place transpose of DirectDCT(), i.e. an unnormalised DCT-III, where
+// x[k] is known to be zero for k >= num_coeffs. The sub-transforms inherit the
+// truncation, and a transform with at most the DC coefficient is a constant.
+void InverseDCT(const double* HWY_RESTRICT multipliers,
+                double* HWY_RESTRICT x, double* HWY_RESTRICT scratch,
+                size_t n, size_t num_coeffs) {
+  if (num_coeffs <= 1) {
+    for (size_t i = 1; i < n; ++i) {
+      x[i] = x[0];
+    }
+    return;
+  }
+  const size_t half = n / 2;
+  const double* HWY_RESTRICT mult = multipliers + half;
+  if (n == 2) {
+    const double v = x[1] * mult[0];
+    x[1] = x[0] - v;
+    x[0] = x[0] + v;
+    return;
+  }
+  scratch[0] = x[0];
+  scratch[half] = x[1];
+  for (size_t k = 1; k < half; ++k) {
+    scratch[k] = x[2 * k];
+    scratch[half + k] = x[2 * k + 1] + x[2 * k - 1];
+  }
+  const size_t num_even = std::min(half, (num_coeffs + 1) / 2);
+  const size_t num_odd = std::min(half, num_coeffs / 2 + 1);
+  InverseDCT(multipliers, scratch, x, half, num_even);
+  InverseDCT(multipliers, scratch + half, x + half, half, num_odd);
+  const size_t lanes = hn::Lanes(dd);
+  size_t i = 0;
+  if (half >= lanes) {
+    for (; i < half; i += lanes) {
+      const auto u = hn::LoadU(dd, scratch + i);
+      const auto v =
+          hn::Mul(hn::LoadU(dd, scratch + half + i), hn::LoadU(dd, mult + i));
+      hn::StoreU(hn::Add(u, v), dd, x + i);
+      hn::StoreU(hn::Reverse(dd, hn::Sub(u, v)), dd, x + n - i - lanes);
+    }
+  }
+  for (; i < half; ++i) {
+    const double v = scratch[half + i] * mult[i];
+    x[i] = scratch[i] + v;
+    x[n - 1 - i] = scratch[i] - v;
+  }
+}
+
+void ComputeDCT(const double* HWY_RESTRICT input, size_t n, size_t num_coeffs,
+                bool inverse, double* HWY_RESTRICT output) {
+  HWY_ALIGN double scratch[kMaxFastDCTLength];
+  const double* multipliers = GetDCTMultipliers();
+  const double dc_scale = sqrt(1.0 / n);
+  const double ac_scale = sqrt(2.0 / n);
+  if (inverse) {
+    output[0] = num_coeffs > 0 ? input[0] * dc_scale : 0.0;
+    for (size_t k = 1; k < num_coeffs; ++k) {
+      output[k] = input[k] * ac_scale;
+    }
+    for (size_t k = std::max<size_t>(num_coeffs, 1); k < n; ++k) {
+      output[k] = 0.0;
+    }
+    InverseDCT(multipliers, output, scratch, n, num_coeffs);
+  } else {
+    memcpy(output, input, n * sizeof(output[0]));
+    DirectDCT(multipliers, output, scratch, n);
+    output[0] *= dc_scale;
+    for (size_t k = 1; k < n; ++k) {
+      output[k] *= ac_scale;
+    }
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+
+namespace ringli {
+
+HWY_EXPORT(ComputeDCT);
+
+void ComputeDirectDCT(const double* input, size_t n, double* output) {
+  DCHECK_LE(n, kMaxFastDCTLength);
+  DCHECK_EQ(n & (n - 1), 0u);
+  HWY_DYNAMIC_DISPATCH(ComputeDCT)(input, n, n, /*inverse=*/false, output);
+}
+
+void ComputeInverseDCT(const double* input, size_t n, double* output) {
+  DCHECK_LE(n, kMaxFastDCTLength);
+  DCHECK_EQ(n & (n - 1), 0u);
+  HWY_DYNAMIC_DISPATCH(ComputeDCT)(input, n, n, /*inverse=*/true, output);
+}
+
+void ComputeTruncatedInverseDCT(const double* input, size_t n,
+                                size_t num_coeffs, double* output) {
+  DCHECK_LE(n, kMaxFastDCTLength);
+  DCHECK_EQ(n & (n - 1), 0u);
+  DCHECK_LE(num_coeffs, n);
+  HWY_DYNAMIC_DISPATCH(ComputeDCT)
+  (input, n, num_coeffs, /*inverse=*/true, output);
+}
+
+}  // namespace ringli
+
+#endif  // HWY_ONCE
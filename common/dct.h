@@ -16,26 +16,85 @@
 #define COMMON_DCT_H_
 
 #include <math.h>
+#include <stddef.h>
+
+#include <type_traits>
 
 #include "common/data_defs/data_matrix.h"
 #include "common/data_defs/data_vector.h"
 
 namespace ringli {
 
+constexpr size_t kMaxFastDCTLength = 1024;
+
+// Orthonormal DCT-II and its inverse (DCT-III) of length n, computed with a
+// SIMD butterfly algorithm in O(n log n). The length n must be a power of two
+// not larger than kMaxFastDCTLength.
+void ComputeDirectDCT(const double* input, size_t n, double* output);
+void ComputeInverseDCT(const double* input, size_t n, double* output);
+
+// Same as ComputeInverseDCT(), but input[k] for k >= num_coeffs is treated as
+// zero and never read. The work shrinks roughly with log(n / num_coeffs).
+void ComputeTruncatedInverseDCT(const double* input, size_t n,
+                                size_t num_coeffs, double* output);
+
 template <int SIZE>
 class DCT {
  public:
   DataVector<double, SIZE> ApplyDirectDCT(
       const DataVector<double, SIZE>& input) const {
-    return direct_matrix_ * input;
+    if constexpr (kUseFastDCT) {
+      DataVector<double, SIZE> output;
+      ComputeDirectDCT(input.Data(), SIZE, output.Data());
+      return output;
+    } else {
+      return matrices_.direct * input;
+    }
   }
 
   DataVector<double, SIZE> ApplyInverseDCT(
       const DataVector<double, SIZE>& input) const {
-    return inverse_matrix_ * input;
+    if constexpr (kUseFastDCT) {
+      DataVector<double, SIZE> output;
+      ComputeInverseDCT(input.Data(), SIZE, output.Data());
+      return output;
+    } else {
+      return matrices_.inverse * input;
+    }
+  }
+
+  // Inverse transform of an input whose coefficients from num_coeffs on are
+  // all zero, e.g. because they were quantized to zero.
+  DataVector<double, SIZE> ApplyInverseDCT(
+      const DataVector<double, SIZE>& input, size_t num_coeffs) const {
+    DataVector<double, SIZE> output;
+    if constexpr (kUseFastDCT) {
+      ComputeTruncatedInverseDCT(input.Data(), SIZE, num_coeffs, output.Data());
+    } else {
+      for (int i = 0; i < SIZE; ++i) {
+        const double* row = matrices_.inverse[i];
+        double sum = 0.0;
+        for (size_t k = 0; k < num_coeffs; ++k) {
+          sum += row[k] * input[k];
+        }
+        output[i] = sum;
+      }
+    }
+    return output;
+  }
+
+  // Returns the number of coefficients up to and including the last non-zero
+  // one, which is the smallest valid num_coeffs argument of ApplyInverseDCT().
+  static size_t NumCoefficients(const DataVector<double, SIZE>& input) {
+    size_t num_coeffs = SIZE;
+    while (num_coeffs > 0 && input[num_coeffs - 1] == 0.0) --num_coeffs;
+    return num_coeffs;
   }
 
  private:
+  static constexpr bool kUseFastDCT =
+      SIZE > 0 && (SIZE & (SIZE - 1)) == 0 && SIZE <= kMaxFastDCTLength;
+
   static DataMatrix<double, SIZE> CreateDirectMatrix() {
     DataMatrix<double, SIZE> directDataMatrix;
     for (int i = 0; i < SIZE; i++) {
@@ -48,8 +107,15 @@ class DCT {
     return directDataMatrix;
   }
 
-  const DataMatrix<double, SIZE> direct_matrix_ = CreateDirectMatrix();
-  const DataMatrix<double, SIZE> inverse_matrix_ = direct_matrix_.Transposed();
+  // The dense transform matrices, which only the lengths without a fast DCT
+  // use.
+  struct DenseMatrices {
+    const DataMatrix<double, SIZE> direct = CreateDirectMatrix();
+    const DataMatrix<double, SIZE> inverse = direct.Transposed();
+  };
+  struct NoMatrices {};
+
+  const std::conditional_t<kUseFastDCT, NoMatrices, DenseMatrices> matrices_{};
 };
 
 }  // namespace ringli
@@ -14,10 +14,14 @@
 
 #include "common/dct.h"
 
+#include <math.h>
+
 #include <cmath>
 #include <functional>
+#include <random>
 
 #include "common/data_defs/constants.h"
+#include "common/data_defs/data_matrix.h"
 #include "common/data_defs/data_vector.h"
 #include "gtest/gtest.h"
 
@@ -54,4 +58,66 @@ TEST(DCTTest, VerifyOrthogonal) {
   }
 }
 
+template <int SIZE>
+void VerifyAgainstDefinition() {
+  DCT<SIZE> dct;
+  std::mt19937 rng(SIZE);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  DataVector<double, SIZE> input;
+  for (int i = 0; i < SIZE; ++i) {
+    input[i] = dist(rng);
+  }
+  DataVector<double, SIZE> expected_direct;
+  DataVector<double, SIZE> expected_inverse;
+  for (int k = 0; k < SIZE; ++k) {
+    const double scale = k == 0 ? sqrt(1.0 / SIZE) : sqrt(2.0 / SIZE);
+    for (int j = 0; j < SIZE; ++j) {
+      const double c = scale * cos(M_PI / SIZE * (j + 0.5) * k);
+      expected_direct[k] += c * input[j];
+      expected_inverse[j] += c * input[k];
+    }
+  }
+  EXPECT_LT((dct.ApplyDirectDCT(input) - expected_direct).AbsMax(), 1e-9);
+  EXPECT_LT((dct.ApplyInverseDCT(input) - expected_inverse).AbsMax(), 1e-9);
+}
+
+TEST(DCTTest, MatchesDefinition) {
+  VerifyAgainstDefinition<1>();
+  VerifyAgainstDefinition<2>();
+  VerifyAgainstDefinition<8>();
+  VerifyAgainstDefinition<kDctLength>();
+  VerifyAgainstDefinition<256>();
+  VerifyAgainstDefinition<24>();
+}
+
+template <int SIZE>
+void VerifyTruncatedInverse() {
+  DCT<SIZE> dct;
+  std::mt19937 rng(SIZE);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  for (size_t num_coeffs = 0; num_coeffs <= SIZE; ++num_coeffs) {
+    DataVector<double, SIZE> input;
+    for (size_t k = 0; k < num_coeffs; ++k) {
+      input[k] = dist(rng);
+    }
+    EXPECT_LE(DCT<SIZE>::NumCoefficients(input), num_coeffs);
+    const DataVector<double, SIZE> expected = dct.ApplyInverseDCT(input);
+    EXPECT_LT((dct.ApplyInverseDCT(input, num_coeffs) - expected).AbsMax(),
+              1e-9)
+        << "num_coeffs=" << num_coeffs;
+  }
+}
+
+TEST(DCTTest, TruncatedInverse) {
+  VerifyTruncatedInverse<1>();
+  VerifyTruncatedInverse<2>();
+  VerifyTruncatedInverse<kDctLength>();
+  VerifyTruncatedInverse<24>();
+}
+
+TEST(DCTTest, FastLengthsHaveNoMatrices) {
+  EXPECT_LT(sizeof(DCT<kDctLength>), sizeof(double));
+  EXPECT_GE(sizeof(DCT<24>), 2 * sizeof(DataMatrix<double, 24>));
+}
+
 }  // namespace ringli
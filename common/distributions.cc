@@ -0,0 +1,100 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/distributions.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/log/check.h"
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "common/distributions.cc"
+#include "hwy/foreach_target.h"
+#include "hwy/highway.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace ringli {
+namespace HWY_NAMESPACE {
+
+namespace hn = hwy::HWY_NAMESPACE;
+using DU = hn::CappedTag<uint16_t, AdaptiveDistribution::kMaxLanes>;
+
+// Returns the number of leading entries of the non-increasing, zero terminated
+// tail that are at least threshold, which must be positive.
+size_t CountAtLeast(const uint16_t* HWY_RESTRICT tail, uint16_t threshold) {
+  const DU du;
+  const size_t lanes = hn::Lanes(du);
+  const auto below = hn::Set(du, threshold - 1);
+  size_t count = 0;
+  for (size_t i = 0;; i += lanes) {
+    const size_t n = hn::CountTrue(du, hn::Gt(hn::LoadU(du, tail + i), below));
+    count += n;
+    if (n < lanes) return count;
+  }
+}
+
+// Adds increment to the first n entries of tail.
+void AddToPrefix(uint16_t* HWY_RESTRICT tail, size_t n, uint16_t increment) {
+  const DU du;
+  const size_t lanes = hn::Lanes(du);
+  const auto inc = hn::Set(du, increment);
+  size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    hn::StoreU(hn::Add(hn::LoadU(du, tail + i), inc), du, tail + i);
+  }
+  if (i < n) {
+    const auto masked_inc = hn::IfThenElseZero(hn::FirstN(du, n - i), inc);
+    hn::StoreU(hn::Add(hn::LoadU(du, tail + i), masked_inc), du, tail + i);
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ringli
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+
+namespace ringli {
+
+HWY_EXPORT(CountAtLeast);
+HWY_EXPORT(AddToPrefix);
+
+int AdaptiveDistribution::FindSymbol(uint32_t value) const {
+  DCHECK_LT(value, total());
+  return HWY_DYNAMIC_DISPATCH(CountAtLeast)(tail_, total() - value) - 1;
+}
+
+void AdaptiveDistribution::Add(int symbol) {
+  if (total() + kIncrement > kMaxTotal) {
+    Rescale();
+  }
+  HWY_DYNAMIC_DISPATCH(AddToPrefix)(tail_, symbol + 1, kIncrement);
+}
+
+void AdaptiveDistribution::Rescale() {
+  uint32_t sum = 0;
+  uint16_t next = 0;
+  for (int s = MAX_SYMBOLS - 1; s >= 0; --s) {
+    const uint16_t tail = tail_[s];
+    sum += (tail - next + 1) >> 1;
+    tail_[s] = sum;
+    next = tail;
+  }
+}
+
+}  // namespace ringli
+
+#endif  // HWY_ONCE
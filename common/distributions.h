@@ -23,6 +23,8 @@
 
 #include <algorithm>
 
+#include "common/entropy_coding.h"
+
 namespace ringli {
 
 // An adaptive binary distribution with 8-bit precision.
@@ -93,6 +95,68 @@ struct Prob {
   uint16_t count;
 };
 
+// The gamma binarization of a symbol in [0, 2^log_alphabet_size) is the
+// Elias-gamma code of symbol + 1: the number k of bits after its leading one
+// bit in unary, i.e. k one bits and a zero bit if k < log_alphabet_size,
+// followed by those k bits. Small symbols take a few binary decisions instead
+// of log_alphabet_size ones, e.g. symbol 0 takes one, symbols 1 and 2 three.
+// Each inner node of the binarization tree has its own adaptive Prob, there
+// are 2^log_alphabet_size - 1 of them, as with the balanced binarization: the
+// first log_alphabet_size ones are the unary decisions, and they are followed
+// by the binary trees of the k bits for each k.
+//
+// Returns the index of the Prob of the bits after the unary part, where node
+// is the number formed by the leading one bit and the bits read so far.
+inline int GammaBitIndex(int log_alphabet_size, int k, int node) {
+  return log_alphabet_size + (1 << k) - k - 2 + node;
+}
+
+// An adaptive distribution of the symbols of the MAX_SYMBOLS alphabet for
+// multi-symbol range coding. Each symbol starts with frequency one, and each
+// coded symbol adds kIncrement to its frequency. The frequencies are halved
+// before their sum would exceed kMaxTotal, so the distribution follows the
+// recent symbols.
+class AdaptiveDistribution {
+ public:
+  static constexpr int kIncrement = 32;
+  static constexpr int kMaxTotal = (1 << 16) - 1;
+  // Upper bound of the vector lanes of the symbol search and update.
+  static constexpr int kMaxLanes = 32;
+
+  AdaptiveDistribution() {
+    for (int s = 0; s <= MAX_SYMBOLS; ++s) {
+      tail_[s] = MAX_SYMBOLS - s;
+    }
+    std::fill(tail_ + MAX_SYMBOLS + 1, tail_ + kSize, 0);
+  }
+
+  uint32_t total() const { return tail_[0]; }
+
+  // Sets [*start, *start + *size) to the interval of symbol within
+  // [0, total()).
+  void GetInterval(int symbol, uint32_t* start, uint32_t* size) const {
+    *start = tail_[0] - tail_[symbol];
+    *size = tail_[symbol] - tail_[symbol + 1];
+  }
+
+  // Returns the symbol whose interval contains value, which must be less
+  // than total().
+  int FindSymbol(uint32_t value) const;
+
+  void Add(int symbol);
+
+ private:
+  static constexpr int kSize = MAX_SYMBOLS + kMaxLanes;
+
+  void Rescale();
+
+  // The sums of the frequencies of the symbols from each symbol to the end of
+  // the alphabet, followed by zeros. Finding a symbol and adding to its
+  // frequency only touch the entries up to the symbol, which are the first
+  // few for the typical, mostly small symbols.
+  uint16_t tail_[kSize];
+};
+
 }  // namespace ringli
 
 #endif  // COMMON_DISTRIBUTIONS_H_
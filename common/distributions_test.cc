@@ -0,0 +1,74 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "common/distributions.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+
+#include "common/entropy_coding.h"
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+void ExpectConsistentIntervals(const AdaptiveDistribution& dist) {
+  uint32_t next_start = 0;
+  for (int s = 0; s < MAX_SYMBOLS; ++s) {
+    uint32_t start, size;
+    dist.GetInterval(s, &start, &size);
+    ASSERT_EQ(start, next_start) << "s=" << s;
+    ASSERT_GT(size, 0u) << "s=" << s;
+    EXPECT_EQ(dist.FindSymbol(start), s);
+    EXPECT_EQ(dist.FindSymbol(start + size - 1), s);
+    next_start = start + size;
+  }
+  EXPECT_EQ(next_start, dist.total());
+}
+
+TEST(AdaptiveDistributionTest, InitialDistributionIsUniform) {
+  AdaptiveDistribution dist;
+  EXPECT_EQ(dist.total(), MAX_SYMBOLS);
+  ExpectConsistentIntervals(dist);
+}
+
+TEST(AdaptiveDistributionTest, IntervalsStayConsistentWhenRescaled) {
+  AdaptiveDistribution dist;
+  std::mt19937 rng(1);
+  std::geometric_distribution<int> geometric(0.3);
+  for (int i = 0; i < 10000; ++i) {
+    const int symbol =
+        i % 100 == 0 ? MAX_SYMBOLS - 1 : std::min(geometric(rng), 80);
+    const uint32_t total = dist.total();
+    uint32_t start, size;
+    dist.GetInterval(symbol, &start, &size);
+    dist.Add(symbol);
+    uint32_t new_start, new_size;
+    dist.GetInterval(symbol, &new_start, &new_size);
+    if (dist.total() == total + AdaptiveDistribution::kIncrement) {
+      EXPECT_EQ(new_size, size + AdaptiveDistribution::kIncrement);
+    }
+    EXPECT_LE(dist.total(), AdaptiveDistribution::kMaxTotal);
+  }
+  ExpectConsistentIntervals(dist);
+  uint32_t start, size;
+  dist.GetInterval(0, &start, &size);
+  EXPECT_GT(size, dist.total() / 4);
+}
+
+}  // namespace
+}  // namespace ringli
@@ -15,6 +15,7 @@
 #ifndef COMMON_ENTROPY_CODING_H_
 #define COMMON_ENTROPY_CODING_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace ringli {
@@ -23,11 +24,56 @@ namespace ringli {
 // different ones based on coding method and stream statistics.
 constexpr int NUM_DIRECT_CODES = 4;
 constexpr int MAX_SYMBOLS = 256;
+constexpr int LOG_MAX_SYMBOLS = 8;
 
 constexpr int kPredNumDirectAbsval = 4;
 
 struct EntropyCodingParams {
   uint8_t arithmetic_only = 0;
+  // Number of blocks per segment of the stream, zero means that the whole
+  // stream is one segment. In ANS mode each segment has its own histograms, or
+  // reuses the ones of the previous segment. In arithmetic-only mode the
+  // arithmetic coder and its adaptive probabilities restart at each segment,
+  // so every segment can be decoded on its own.
+  uint16_t segment_size = 0;
+  // Number of segments between the seek points of a segmented stream. The
+  // segments at the seek points can be decoded on their own, and the byte
+  // offsets of the seek points are written to a seek table at the end of the
+  // stream. Zero means that there is no seek table.
+  uint16_t seek_interval = 0;
+  // If set, each channel of the segments of a segmented predictive stream is
+  // entropy coded to a separate substream, which is preceded by its size. The
+  // ANS coded substreams share the histograms of the segment.
+  uint8_t channel_substreams = 0;
+  // Number of interleaved ANS states, the ANS coded symbols use them in
+  // round-robin order. Must be a power of two not larger than kMaxANSStates,
+  // zero means one state.
+  uint8_t num_ans_states = 0;
+  // If set, the arithmetic coded symbols of the MAX_SYMBOLS alphabet use the
+  // gamma binarization instead of the balanced one, see GammaBitIndex().
+  uint8_t gamma_symbols = 0;
+  // If set, the fully streaming mode, i.e. the online predictive
+  // arithmetic-only mode, codes the residuals with the multi-symbol range
+  // coder and an AdaptiveDistribution per context instead of the binary
+  // arithmetic coder.
+  uint8_t range_coding = 0;
+  // If set, the predictive arithmetic-only modes use BinaryArithmeticEncoder64
+  // with 64-bit bounds and 32-bit words instead of BinaryArithmeticEncoder.
+  // The DCT mode multiplexes the 16-bit words of its arithmetic coder with the
+  // ANS coded data and ignores it.
+  uint8_t wide_arithmetic_coding = 0;
+  // If set, the histogram data of the predictive ANS mode starts with a byte
+  // that is either zero, followed by the context map and the histograms, or
+  // one plus the index of the built-in entropy code that the segment uses,
+  // see GetEntropyPreset(). The DCT mode ignores it.
+  uint8_t entropy_presets = 0;
+  // If set, the binary arithmetic coders code the extra bits of the residuals
+  // and of the LSF parameters with AddBits(), i.e. as many equiprobable bits
+  // at once as the range allows, instead of with one AddBit(128, ...) per
+  // bit. The range coder of range_coding always codes them at once.
+  uint8_t bypass_bits = 0;
+
+  size_t NumANSStates() const { return num_ans_states ? num_ans_states : 1; }
 } __attribute__((packed));
 
 }  // namespace ringli
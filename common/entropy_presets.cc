@@ -0,0 +1,193 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/entropy_presets.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "common/ans_params.h"
+#include "common/context.h"
+#include "common/data_defs/constants.h"
+#include "common/entropy_coding.h"
+
+namespace ringli {
+
+namespace {
+
+// All magnitudes are twice the log2 of a mean absolute value.
+//
+// Weights of the magnitudes of the last three residuals and of the scale of
+// the preset in the magnitude of a residual, for the more and the less
+// adaptive presets. The weights of each set sum to kMagnitudeWeightTotal.
+constexpr int kMagnitudeWeights[2][PredictiveContextModel::kOrder + 1] = {
+    {9, 4, 2, 1},
+    {6, 3, 1, 6},
+};
+constexpr int kMagnitudeWeightTotal = 16;
+// Number of scales of the presets, and the scale of the first one.
+constexpr int kNumScales = kNumEntropyPresets / 2;
+constexpr int kMinScale = -4;
+// Magnitude of the line spectral frequency residuals.
+constexpr int kLSFMagnitude = 6;
+// Largest absolute values of the residuals and the line spectral frequency
+// residuals that the codes have symbols for.
+constexpr int kMaxResidual = 1 << 17;
+constexpr int kMaxLSFResidual = 256;
+
+constexpr uint64_t kOne = uint64_t{1} << 32;
+
+// Returns a / b rounded down, b must be positive.
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((b - 1 - a) / b); }
+
+// Returns the parameter in 32-bit fixed point of the geometric distribution
+// P(x) = (1 - theta) * theta^x with mean 2^(magnitude / 2).
+uint64_t GeometricParameter(int magnitude) {
+  // 2^(magnitude / 2) in 16-bit fixed point.
+  const int shift = (magnitude - (magnitude & 1)) / 2;
+  const uint64_t base = (magnitude & 1) ? 92682 : 65536;
+  const uint64_t mean = shift >= 0 ? base << shift : base >> -shift;
+  return kOne - (uint64_t{1} << 48) / (mean + 65536);
+}
+
+// Returns theta^n in 32-bit fixed point.
+uint64_t Power(uint64_t theta, uint64_t n) {
+  uint64_t result = kOne;
+  for (; n > 0; n >>= 1) {
+    if (n & 1) result = (result * theta) >> 32;
+    theta = (theta * theta) >> 32;
+  }
+  return result;
+}
+
+// Sets counts to the weights normalized to ANS_TAB_SIZE, each of the first
+// num_symbols symbols has a non-zero count.
+void NormalizeWeights(const uint64_t* weights, int num_symbols, int* counts) {
+  DCHECK_LE(num_symbols, MAX_SYMBOLS);
+  uint64_t total = 0;
+  for (int s = 0; s < num_symbols; ++s) {
+    total += weights[s];
+  }
+  const uint64_t num_free = ANS_TAB_SIZE - num_symbols;
+  int sum = 0;
+  int max_symbol = 0;
+  for (int s = 0; s < MAX_SYMBOLS; ++s) {
+    counts[s] = s < num_symbols ? 1 + weights[s] * num_free / total : 0;
+    sum += counts[s];
+    if (counts[s] > counts[max_symbol]) max_symbol = s;
+  }
+  counts[max_symbol] += ANS_TAB_SIZE - sum;
+}
+
+// Sets counts to the code of the symbols of EncodeValue() with ndirect direct
+// absolute values, for values with a two-sided geometric distribution with
+// mean absolute value 2^(magnitude / 2). Only the symbols of the absolute
+// values up to max_value have non-zero counts.
+void BuildGeometricCounts(int magnitude, int ndirect, int max_value,
+                          int* counts) {
+  const uint64_t theta = GeometricParameter(magnitude);
+  uint64_t weights[MAX_SYMBOLS];
+  int num_symbols = 0;
+  for (; num_symbols < MAX_SYMBOLS; ++num_symbols) {
+    const int s = num_symbols;
+    // The symbol codes the absolute values in [lo, hi) with one sign, except
+    // for zero.
+    int lo, hi;
+    if (s < 2 * ndirect - 1) {
+      lo = (s + 1) / 2;
+      hi = lo + 1;
+    } else {
+      const int sym = s - (2 * ndirect - 1);
+      const int msb = (sym >> 1) & 1;
+      const int nbits = sym >> 2;
+      lo = ndirect - 2 + ((2 + msb) << nbits);
+      hi = lo + (1 << nbits);
+    }
+    if (lo > max_value) break;
+    weights[s] = Power(theta, lo) - Power(theta, hi);
+    if (lo > 0) weights[s] >>= 1;
+  }
+  NormalizeWeights(weights, num_symbols, counts);
+}
+
+void BuildEntropyPreset(int index, EntropyPreset* preset) {
+  const PredictiveContextModel context_model;
+  const size_t num_contexts = NumPredictiveContexts();
+  preset->context_map.resize(num_contexts);
+  preset->counts.clear();
+  // The unused quantization contexts and the predictor order share a uniform
+  // code of the predictor orders.
+  preset->counts.emplace_back();
+  uint64_t order_weights[kMaxPredictorOrder + 1];
+  std::fill(order_weights, order_weights + kMaxPredictorOrder + 1, 1);
+  NormalizeWeights(order_weights, kMaxPredictorOrder + 1,
+                   preset->counts.back().data());
+  for (int ctx = 0; ctx < 3; ++ctx) {
+    preset->context_map[ctx] = 0;
+  }
+  preset->counts.emplace_back();
+  BuildGeometricCounts(kLSFMagnitude, 16, kMaxLSFResidual,
+                       preset->counts.back().data());
+  for (size_t ctx = 3; ctx < 3 + kNumLSFContexts; ++ctx) {
+    preset->context_map[ctx] = 1;
+  }
+  // The residual contexts with the same magnitude share their code.
+  const int* weights = kMagnitudeWeights[index / kNumScales];
+  const int scale = kMinScale + 2 * (index % kNumScales);
+  std::map<int, uint32_t> magnitude_codes;
+  for (size_t ctx = 3 + kNumLSFContexts; ctx < num_contexts; ++ctx) {
+    const int residual_ctx = ctx - 3 - kNumLSFContexts;
+    int weighted = weights[PredictiveContextModel::kOrder] * scale +
+                   kMagnitudeWeightTotal / 2;
+    for (int i = 0; i < PredictiveContextModel::kOrder; ++i) {
+      weighted += weights[i] * context_model.PreviousMagnitude(residual_ctx, i);
+    }
+    const int magnitude = FloorDiv(weighted, kMagnitudeWeightTotal);
+    auto it = magnitude_codes.find(magnitude);
+    if (it == magnitude_codes.end()) {
+      it = magnitude_codes.emplace(magnitude, preset->counts.size()).first;
+      preset->counts.emplace_back();
+      BuildGeometricCounts(magnitude, kPredNumDirectAbsval, kMaxResidual,
+                           preset->counts.back().data());
+    }
+    preset->context_map[ctx] = it->second;
+  }
+}
+
+}  // namespace
+
+size_t NumPredictiveContexts() {
+  return 3 + kNumLSFContexts + PredictiveContextModel().NumContexts();
+}
+
+const EntropyPreset& GetEntropyPreset(int index) {
+  CHECK_GE(index, 0);
+  CHECK_LT(index, kNumEntropyPresets);
+  static const EntropyPreset* presets = [] {
+    EntropyPreset* presets = new EntropyPreset[kNumEntropyPresets];
+    for (int i = 0; i < kNumEntropyPresets; ++i) {
+      BuildEntropyPreset(i, &presets[i]);
+    }
+    return presets;
+  }();
+  return presets[index];
+}
+
+}  // namespace ringli
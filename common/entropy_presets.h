@@ -0,0 +1,60 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Built-in entropy codes of the predictive ANS mode, which a segment can
+// select by index instead of storing its context map and histograms.
+
+#ifndef COMMON_ENTROPY_PRESETS_H_
+#define COMMON_ENTROPY_PRESETS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <vector>
+
+#include "common/entropy_coding.h"
+
+namespace ringli {
+
+constexpr int kNumEntropyPresets = 32;
+
+// Context map and ANS population counts of a built-in entropy code, the counts
+// of each histogram sum to ANS_TAB_SIZE.
+struct EntropyPreset {
+  std::vector<uint32_t> context_map;
+  std::vector<std::array<int, MAX_SYMBOLS>> counts;
+};
+
+// Returns the number of contexts of the predictive ANS mode: the two unused
+// quantization contexts, the predictor order, the kNumLSFContexts line
+// spectral frequency contexts and the residual contexts of
+// PredictiveContextModel.
+size_t NumPredictiveContexts();
+
+// Returns the built-in entropy code with the given index, which is less than
+// kNumEntropyPresets. The codes are built on first use.
+//
+// The residuals are modelled with two-sided geometric distributions, whose
+// mean absolute value is interpolated in the log domain between the
+// magnitudes of the previous residuals of the context and the scale of the
+// preset. The first and the second half of the presets weight the previous
+// residuals more and less, and within each half the scale doubles with each
+// index. The codes are built with integer arithmetic only, so that the
+// encoder and the decoder agree on them on every platform.
+const EntropyPreset& GetEntropyPreset(int index);
+
+}  // namespace ringli
+
+#endif  // COMMON_ENTROPY_PRESETS_H_
@@ -0,0 +1,77 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/entropy_presets.h"
+
+#include <stddef.h>
+
+#include "common/ans_params.h"
+#include "common/context.h"
+#include "common/entropy_coding.h"
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+// Symbol of EncodeValue() for the largest residual that the presets code,
+// 2^17, with kPredNumDirectAbsval direct absolute values.
+constexpr int kMaxResidualSymbol = 2 * kPredNumDirectAbsval - 1 + 4 * 15 + 3;
+
+TEST(EntropyPresetsTest, PresetsAreValidCodes) {
+  for (int index = 0; index < kNumEntropyPresets; ++index) {
+    const EntropyPreset& preset = GetEntropyPreset(index);
+    ASSERT_EQ(preset.context_map.size(), NumPredictiveContexts());
+    for (uint32_t code : preset.context_map) {
+      EXPECT_LT(code, preset.counts.size()) << "index=" << index;
+    }
+    for (const auto& counts : preset.counts) {
+      int total = 0;
+      for (int count : counts) {
+        EXPECT_GE(count, 0);
+        total += count;
+      }
+      EXPECT_EQ(total, ANS_TAB_SIZE) << "index=" << index;
+    }
+  }
+}
+
+TEST(EntropyPresetsTest, ResidualCodesCoverLargeResiduals) {
+  for (int index = 0; index < kNumEntropyPresets; ++index) {
+    const EntropyPreset& preset = GetEntropyPreset(index);
+    for (size_t ctx = 3 + kNumLSFContexts; ctx < NumPredictiveContexts();
+         ++ctx) {
+      const auto& counts = preset.counts[preset.context_map[ctx]];
+      for (int s = 0; s <= kMaxResidualSymbol; ++s) {
+        ASSERT_GT(counts[s], 0) << "index=" << index << " ctx=" << ctx;
+      }
+    }
+  }
+}
+
+TEST(EntropyPresetsTest, ZeroResidualsAreLessLikelyAtLargerScales) {
+  // The residual context after three zero residuals.
+  const size_t ctx = 3 + kNumLSFContexts;
+  for (int index = 1; index < kNumEntropyPresets / 2; ++index) {
+    for (int half : {0, kNumEntropyPresets / 2}) {
+      const EntropyPreset& smaller = GetEntropyPreset(half + index - 1);
+      const EntropyPreset& larger = GetEntropyPreset(half + index);
+      EXPECT_GE(smaller.counts[smaller.context_map[ctx]][0],
+                larger.counts[larger.context_map[ctx]][0])
+          << "index=" << half + index;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace ringli
@@ -14,6 +14,10 @@
 
 #include "common/fast_online_predictor.h"
 
+#include <stddef.h>
+
+#include <algorithm>
+
 #include "absl/log/check.h"
 #include "common/covariance_lattice.h"
 #include "common/data_defs/constants.h"
@@ -70,6 +74,93 @@ void UpdatePredictorState(float sample, float* __restrict k,
   }
   g[0] = sample;
 }
+
+// Same as PredictFromBackwardErrors() for each channel of the interleaved
+// state of FastOnlinePredictorBank, with at most kLanes channels per vector.
+template <size_t kLanes>
+void PredictChannelsImpl(const float* HWY_RESTRICT k,
+                         const float* HWY_RESTRICT g, size_t num_channels,
+                         size_t stride, float* HWY_RESTRICT predictions) {
+  const hn::CappedTag<float, kLanes> d;
+  for (size_t c = 0; c < num_channels; c += hn::Lanes(d)) {
+    auto vkg = hn::Zero(d);
+    for (size_t m = 0; m < kOnlinePredictorOrder; ++m) {
+      vkg = hn::MulAdd(hn::LoadU(d, k + m * stride + c),
+                       hn::LoadU(d, g + m * stride + c), vkg);
+    }
+    hn::StoreU(hn::Neg(vkg), d, predictions + c);
+  }
+}
+
+// Same as UpdatePredictorState() for each channel of the interleaved state of
+// FastOnlinePredictorBank, with at most kLanes channels per vector. The
+// forward prediction errors are kept in registers, and each stage reads the
+// backward prediction error of the next stage before overwriting it.
+template <size_t kLanes>
+void UpdateChannelsImpl(const float* HWY_RESTRICT samples,
+                        float* HWY_RESTRICT k, float* HWY_RESTRICT g,
+                        float* HWY_RESTRICT d, size_t num_channels,
+                        size_t stride, float beta, float regul) {
+  const hn::CappedTag<float, kLanes> df;
+  const auto vbeta = hn::Set(df, beta);
+  const auto vregul = hn::Set(df, regul);
+  for (size_t c = 0; c < num_channels; c += hn::Lanes(df)) {
+    const auto vsample = hn::LoadU(df, samples + c);
+    auto vf = vsample;
+    auto vg = hn::LoadU(df, g + c);
+    for (size_t m = 0; m < kOnlinePredictorOrder; ++m) {
+      float* HWY_RESTRICT km = k + m * stride + c;
+      float* HWY_RESTRICT dm = d + m * stride + c;
+      float* HWY_RESTRICT gm1 = g + (m + 1) * stride + c;
+      const auto vk = hn::LoadU(df, km);
+      const auto vf1 = hn::MulAdd(vk, vg, vf);
+      const auto vd = hn::Add(hn::MulAdd(hn::LoadU(df, dm), vbeta, vregul),
+                              hn::Add(hn::Mul(vf, vf), hn::Mul(vg, vg)));
+      const auto vg1 = hn::MulAdd(vk, vf, vg);
+      const auto vnum = hn::MulAdd(vf, vg1, hn::Mul(vf1, vg));
+      hn::StoreU(hn::Sub(vk, hn::Div(vnum, vd)), df, km);
+      hn::StoreU(vd, df, dm);
+      const auto vg_next = hn::LoadU(df, gm1);
+      hn::StoreU(vg1, df, gm1);
+      vf = vf1;
+      vg = vg_next;
+    }
+    hn::StoreU(vsample, df, g + c);
+  }
+}
+
+// The vectors are not wider than the number of channels, so that a mono or
+// stereo stream does not pay for padding channels.
+void PredictChannels(const float* HWY_RESTRICT k, const float* HWY_RESTRICT g,
+                     size_t num_channels, size_t stride,
+                     float* HWY_RESTRICT predictions) {
+  static_assert(FastOnlinePredictorBank::kMaxLanes == 8);
+  if (num_channels <= 1) {
+    PredictChannelsImpl<1>(k, g, num_channels, stride, predictions);
+  } else if (num_channels <= 2) {
+    PredictChannelsImpl<2>(k, g, num_channels, stride, predictions);
+  } else if (num_channels <= 4) {
+    PredictChannelsImpl<4>(k, g, num_channels, stride, predictions);
+  } else {
+    PredictChannelsImpl<8>(k, g, num_channels, stride, predictions);
+  }
+}
+
+void UpdateChannels(const float* HWY_RESTRICT samples, float* HWY_RESTRICT k,
+                    float* HWY_RESTRICT g, float* HWY_RESTRICT d,
+                    size_t num_channels, size_t stride, float beta,
+                    float regul) {
+  if (num_channels <= 1) {
+    UpdateChannelsImpl<1>(samples, k, g, d, num_channels, stride, beta, regul);
+  } else if (num_channels <= 2) {
+    UpdateChannelsImpl<2>(samples, k, g, d, num_channels, stride, beta, regul);
+  } else if (num_channels <= 4) {
+    UpdateChannelsImpl<4>(samples, k, g, d, num_channels, stride, beta, regul);
+  } else {
+    UpdateChannelsImpl<8>(samples, k, g, d, num_channels, stride, beta, regul);
+  }
+}
+
 // NOLINTNEXTLINE(google-readability-namespace-comments)
 }  // namespace HWY_NAMESPACE
 }  // namespace ringli
@@ -81,6 +172,8 @@ namespace ringli {
 
 HWY_EXPORT(PredictFromBackwardErrors);
 HWY_EXPORT(UpdatePredictorState);
+HWY_EXPORT(PredictChannels);
+HWY_EXPORT(UpdateChannels);
 
 float FastOnlinePredictor::Predict() {
   float prediction = 0;
@@ -130,5 +223,97 @@ void FastOnlinePredictor::AddNewSample(float sample) {
      regul_);
   }
 }
+
+FastOnlinePredictorBank::FastOnlinePredictorBank(size_t num_channels)
+    : num_channels_(num_channels),
+      stride_((num_channels + kMaxLanes - 1) / kMaxLanes * kMaxLanes),
+      history_(2 * kOnlinePredictorOrder * stride_),
+      k_(kOnlinePredictorOrder * stride_),
+      g_((kOnlinePredictorOrder + 1) * stride_),
+      d_(kOnlinePredictorOrder * stride_),
+      samples_(stride_),
+      predictions_(stride_) {
+  FastOnlinePredictorBank::Reset();
+}
+
+void FastOnlinePredictorBank::Reset() {
+  position_ = 0;
+  std::fill(history_.begin(), history_.end(), 0.0f);
+  std::fill(k_.begin(), k_.end(), 0.0f);
+  std::fill(g_.begin(), g_.end(), 0.0f);
+  std::fill(d_.begin(), d_.end(), 0.0f);
+}
+
+void FastOnlinePredictorBank::Predict(float* predictions) {
+  if (position_ == 0) {
+    std::fill(predictions, predictions + num_channels_, 0.0f);
+  } else if (position_ == 1) {
+    std::copy(history_.begin(), history_.begin() + num_channels_,
+              predictions);
+  } else if (position_ < 2 * kOnlinePredictorOrder) {
+    const float* last = &history_[(position_ - 1) * stride_];
+    const float* second_last = &history_[(position_ - 2) * stride_];
+    for (size_t c = 0; c < num_channels_; ++c) {
+      predictions[c] = kOnlineO2PredictorDefaultCoeffs[0] * last[c] -
+                       kOnlineO2PredictorDefaultCoeffs[1] * second_last[c];
+    }
+  } else {
+    HWY_DYNAMIC_DISPATCH(PredictChannels)
+    (k_.data(), g_.data(), num_channels_, stride_, predictions_.data());
+    std::copy(predictions_.begin(), predictions_.begin() + num_channels_,
+              predictions);
+  }
+}
+
+void FastOnlinePredictorBank::AddNewSamples(const float* samples) {
+  if (position_ < 2 * kOnlinePredictorOrder) {
+    std::copy(samples, samples + num_channels_,
+              &history_[position_ * stride_]);
+  }
+  position_++;
+
+  if (position_ < 2 * kOnlinePredictorOrder) {
+    return;
+  }
+  if (position_ == 2 * kOnlinePredictorOrder) {
+    for (size_t c = 0; c < num_channels_; ++c) {
+      InitChannel(c);
+    }
+  } else {
+    std::copy(samples, samples + num_channels_, samples_.begin());
+    HWY_DYNAMIC_DISPATCH(UpdateChannels)
+    (samples_.data(), k_.data(), g_.data(), d_.data(), num_channels_, stride_,
+     beta_, regul_);
+  }
+}
+
+void FastOnlinePredictorBank::InitChannel(size_t c) {
+  float data[2 * kOnlinePredictorOrder];
+  for (size_t i = 0; i < 2 * kOnlinePredictorOrder; ++i) {
+    data[i] = history_[i * stride_ + c];
+  }
+  float k[kOnlinePredictorOrder + 1] = {0};
+  float f[kOnlinePredictorOrder + 1];
+  float g[kOnlinePredictorOrder + 1] = {0};
+  CovarianceLattice<float> covlattice(data, 2 * kOnlinePredictorOrder,
+                                      kOnlinePredictorOrder, regul_);
+  covlattice.FitReflectionCoeffs(&k[0], kOnlinePredictorOrder);
+  for (size_t i = 0; i < 2 * kOnlinePredictorOrder; ++i) {
+    f[0] = data[i];
+    for (int m = 1; m <= kOnlinePredictorOrder; ++m) {
+      f[m] = f[m - 1] + k[m] * g[m - 1];
+    }
+    for (int m = kOnlinePredictorOrder; m >= 1; --m) {
+      g[m] = k[m] * f[m - 1] + g[m - 1];
+    }
+    g[0] = data[i];
+  }
+  for (size_t m = 0; m < kOnlinePredictorOrder; ++m) {
+    k_[m * stride_ + c] = k[m + 1];
+    g_[m * stride_ + c] = g[m];
+  }
+  g_[kOnlinePredictorOrder * stride_ + c] = g[kOnlinePredictorOrder];
+}
+
 }  // namespace ringli
 #endif  // HWY_ONCE
@@ -19,6 +19,7 @@
 #include <stdint.h>
 
 #include <cstring>
+#include <vector>
 
 #include "common/data_defs/constants.h"
 #include "common/predictor.h"
@@ -57,6 +58,47 @@ class FastOnlinePredictor : public Predictor {
   const float regul_ = 1.0f;
 };
 
+// Runs the adaptive lattice method of FastOnlinePredictor on each channel of
+// a stream. The state of the channels is stored interleaved, so that the
+// channels are updated together in the SIMD lanes.
+class FastOnlinePredictorBank : public MultiChannelPredictor {
+ public:
+  explicit FastOnlinePredictorBank(size_t num_channels);
+
+  void Reset() override;
+
+  void Predict(float* predictions) override;
+
+  void AddNewSamples(const float* samples) override;
+
+  // Number of channels that the SIMD kernels process together at most.
+  static constexpr size_t kMaxLanes = 8;
+
+ private:
+  // Initializes the lattice of channel c from the first samples, as
+  // FastOnlinePredictor::AddNewSample() does.
+  void InitChannel(size_t c);
+
+  const size_t num_channels_;
+  // Length of the rows of the state arrays, num_channels_ rounded up to a
+  // multiple of kMaxLanes. The padding channels stay zero.
+  const size_t stride_;
+  uint32_t position_ = 0;
+  // Row i holds the i-th sample of each channel, for the first
+  // 2 * kOnlinePredictorOrder samples.
+  std::vector<float> history_;
+  // Row m holds k_[m + 1], g_[m] and d_[m + 1] of FastOnlinePredictor for
+  // each channel.
+  std::vector<float> k_;
+  std::vector<float> g_;
+  std::vector<float> d_;
+  // Padded copies of the input samples and the predictions.
+  std::vector<float> samples_;
+  std::vector<float> predictions_;
+  const float beta_ = 0.999f;
+  const float regul_ = 1.0f;
+};
+
 }  // namespace ringli
 
 #endif  // COMMON_FAST_ONLINE_PREDICTOR_H_
@@ -0,0 +1,88 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/fast_online_predictor.h"
+
+#include <stddef.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+// Returns num_samples interleaved samples of num_channels channels, each a
+// different mix of two sines and noise.
+std::vector<float> GenerateSamples(size_t num_channels, size_t num_samples) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> noise(-50, 50);
+  std::vector<float> samples(num_channels * num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    for (size_t c = 0; c < num_channels; ++c) {
+      samples[i * num_channels + c] =
+          std::round(8000 * std::sin(0.02 * (c + 1) * i) +
+                     3000 * std::sin(0.7 * i + c)) +
+          noise(rng);
+    }
+  }
+  return samples;
+}
+
+TEST(FastOnlinePredictorBankTest, MatchesFastOnlinePredictor) {
+  const size_t kNumChannels = 5;
+  const size_t kNumSamples = 4000;
+  const std::vector<float> samples =
+      GenerateSamples(kNumChannels, kNumSamples);
+  FastOnlinePredictorBank bank(kNumChannels);
+  std::vector<FastOnlinePredictor> predictors(kNumChannels);
+  std::vector<float> predictions(kNumChannels);
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    bank.Predict(predictions.data());
+    for (size_t c = 0; c < kNumChannels; ++c) {
+      // Only the rounding of the sums differs.
+      ASSERT_NEAR(predictions[c], predictors[c].Predict(), 1.0f)
+          << "i=" << i << " c=" << c;
+      predictors[c].AddNewSample(samples[i * kNumChannels + c]);
+    }
+    bank.AddNewSamples(&samples[i * kNumChannels]);
+  }
+}
+
+TEST(FastOnlinePredictorBankTest, ChannelsAreIndependent) {
+  const size_t kNumChannels = 3;
+  const size_t kNumSamples = 2000;
+  const std::vector<float> samples =
+      GenerateSamples(kNumChannels, kNumSamples);
+  FastOnlinePredictorBank bank(kNumChannels);
+  FastOnlinePredictorBank mono_bank(1);
+  std::vector<float> predictions(kNumChannels);
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    if (i == kNumSamples / 2) {
+      bank.Reset();
+      mono_bank.Reset();
+    }
+    float mono_prediction;
+    bank.Predict(predictions.data());
+    mono_bank.Predict(&mono_prediction);
+    ASSERT_EQ(predictions[0], mono_prediction) << "i=" << i;
+    bank.AddNewSamples(&samples[i * kNumChannels]);
+    mono_bank.AddNewSamples(&samples[i * kNumChannels]);
+  }
+}
+
+}  // namespace
+}  // namespace ringli
@@ -31,6 +31,16 @@ inline int Log2FloorNonZero(uint32_t n) {
 #endif
 }
 
+inline int Log2FloorNonZero64(uint64_t n) {
+#ifdef __GNUC__
+  return 63 ^ __builtin_clzll(n);
+#else
+  unsigned int result = 0;
+  while (n >>= 1) result++;
+  return result;
+#endif
+}
+
 }  // namespace ringli
 
 #endif  // COMMON_LOG2FLOOR_H_
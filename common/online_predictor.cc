@@ -44,25 +44,56 @@ float OnlinePredictor::Predict() {
 void OnlinePredictor::AddNewSample(float sample) {
   if (position_ >= kOnlinePredictorOrder) {
     // add new feature vector to covariance and gradient
-    Eigen::VectorXd x_in = Eigen::VectorXd::Zero(kOnlinePredictorOrder);
+    Vector x_in;
     for (int j = 0; j < kOnlinePredictorOrder; ++j) {
       x_in(j) = data_buffer_[circular_index(-j - 1)];
     }
-    covariance_ = Rank1Update(covariance_, x_in, 1.0);
-    gradient_ = gradient_ + x_in * sample;
+    Rank1UpdateInPlace(x_in, 1.0, &covariance_);
+    gradient_ += x_in * sample;
 
     if (position_ >= kOnlinePredictorOrder + kOnlinePredictorBufferSize) {
       // remove old feature vector from covariance and gradient
+      Vector x_out;
+      for (int j = 0; j < kOnlinePredictorOrder; ++j) {
+        x_out(j) = data_buffer_[circular_index(kOnlinePredictorOrder - j - 1)];
+      }
+      Rank1UpdateInPlace(x_out, -1.0, &covariance_);
+      gradient_ -= x_out * data_buffer_[circular_index(kOnlinePredictorOrder)];
+    }
+
+    Vector solution;
+    solution.noalias() = covariance_ * gradient_;
+
+    for (int i = 1; i <= kOnlinePredictorOrder; ++i) {
+      coeffs_[i] = solution[i - 1];
+    }
+  }
+
+  data_buffer_[position_ % kOnlinePredictorBufferSize] = sample;
+  position_++;
+}
+
+void LegacyOnlinePredictor::AddNewSample(float sample) {
+  if (position_ >= kOnlinePredictorOrder) {
+    Eigen::VectorXd x_in = Eigen::VectorXd::Zero(kOnlinePredictorOrder);
+    for (int j = 0; j < kOnlinePredictorOrder; ++j) {
+      x_in(j) = data_buffer_[circular_index(-j - 1)];
+    }
+    legacy_covariance_ = Rank1Update(legacy_covariance_, x_in, 1.0);
+    legacy_gradient_ = legacy_gradient_ + x_in * sample;
+
+    if (position_ >= kOnlinePredictorOrder + kOnlinePredictorBufferSize) {
       Eigen::VectorXd x_out = Eigen::VectorXd::Zero(kOnlinePredictorOrder);
       for (int j = 0; j < kOnlinePredictorOrder; ++j) {
         x_out(j) = data_buffer_[circular_index(kOnlinePredictorOrder - j - 1)];
       }
-      covariance_ = Rank1Update(covariance_, x_out, -1.0);
-      gradient_ = gradient_ -
-                  x_out * data_buffer_[circular_index(kOnlinePredictorOrder)];
+      legacy_covariance_ = Rank1Update(legacy_covariance_, x_out, -1.0);
+      legacy_gradient_ =
+          legacy_gradient_ -
+          x_out * data_buffer_[circular_index(kOnlinePredictorOrder)];
     }
 
-    Eigen::VectorXd solution = covariance_ * gradient_;
+    Eigen::VectorXd solution = legacy_covariance_ * legacy_gradient_;
 
     for (int i = 1; i <= kOnlinePredictorOrder; ++i) {
       coeffs_[i] = solution[i - 1];
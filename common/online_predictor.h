@@ -40,6 +40,19 @@ Eigen::MatrixXd Rank1Update(const Eigen::MatrixBase<Derived1>& covariance,
   return covariance - numerator / denominator;
 }
 
+// Same as Rank1Update(), but updates the fixed size covariance in place,
+// without allocating temporaries.
+template <int N>
+void Rank1UpdateInPlace(const Eigen::Matrix<double, N, 1>& data, double sign,
+                        Eigen::Matrix<double, N, N>* covariance) {
+  DCHECK_EQ(std::abs(sign), 1.0);
+  Eigen::Matrix<double, N, 1> cov_u;
+  cov_u.noalias() = *covariance * data;
+  const double denominator = 1.0 + sign * data.dot(cov_u);
+  const Eigen::Matrix<double, N, 1> scaled_cov_u = cov_u * (sign / denominator);
+  covariance->noalias() -= scaled_cov_u * cov_u.transpose();
+}
+
 class OnlinePredictor : public Predictor {
  public:
   explicit OnlinePredictor(float regulariser) : regulariser_(regulariser) {
@@ -50,10 +63,8 @@ class OnlinePredictor : public Predictor {
     position_ = 0;
     memset(coeffs_, 0, sizeof(coeffs_));
     memset(data_buffer_, 0, sizeof(data_buffer_));
-    gradient_ = Eigen::VectorXd::Zero(kOnlinePredictorOrder);
-    covariance_ =
-        Eigen::MatrixXd::Identity(kOnlinePredictorOrder, kOnlinePredictorOrder);
-    covariance_ = covariance_ * (1.0 / regulariser_);
+    gradient_.setZero();
+    covariance_ = Matrix::Identity() * (1.0 / regulariser_);
   }
 
   float Predict() override;
@@ -65,13 +76,45 @@ class OnlinePredictor : public Predictor {
            kOnlinePredictorBufferSize;
   }
 
- private:
+ protected:
+  using Vector = Eigen::Matrix<double, kOnlinePredictorOrder, 1>;
+  using Matrix =
+      Eigen::Matrix<double, kOnlinePredictorOrder, kOnlinePredictorOrder>;
+
   const float regulariser_;
   uint32_t position_ = 0;
   float coeffs_[kOnlinePredictorOrder + 1] = {0};
   float data_buffer_[kOnlinePredictorBufferSize] = {0};
-  Eigen::VectorXd gradient_;
-  Eigen::MatrixXd covariance_;
+  // Sums of the feature vectors times the samples and the inverse of the
+  // regularised sum of the outer products of the feature vectors, over the
+  // last kOnlinePredictorBufferSize samples.
+  Vector gradient_;
+  Matrix covariance_;
+};
+
+// OnlinePredictor of the streams with the kRingliLegacyId id. It keeps the
+// covariance in a dynamic size matrix and updates it with Rank1Update(), which
+// rounds differently from the in-place update of OnlinePredictor.
+class LegacyOnlinePredictor : public OnlinePredictor {
+ public:
+  explicit LegacyOnlinePredictor(float regulariser)
+      : OnlinePredictor(regulariser) {
+    LegacyOnlinePredictor::Reset();
+  }
+
+  void Reset() override {
+    OnlinePredictor::Reset();
+    legacy_gradient_ = Eigen::VectorXd::Zero(kOnlinePredictorOrder);
+    legacy_covariance_ =
+        Eigen::MatrixXd::Identity(kOnlinePredictorOrder, kOnlinePredictorOrder);
+    legacy_covariance_ = legacy_covariance_ * (1.0 / regulariser_);
+  }
+
+  void AddNewSample(float sample) override;
+
+ private:
+  Eigen::VectorXd legacy_gradient_;
+  Eigen::MatrixXd legacy_covariance_;
 };
 
 }  // namespace ringli
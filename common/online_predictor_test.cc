@@ -38,4 +38,19 @@ TEST(Rank1UpdateTest, inverse3x3) {
   EXPECT_LT((updated_inv - rank1_updated_inv).cwiseAbs().maxCoeff(), 1e-6);
 }
 
+TEST(Rank1UpdateTest, InPlaceUpdateMatchesUpdate) {
+  srand((unsigned int)0);
+  Eigen::Matrix<double, 8, 8> X = Eigen::Matrix<double, 8, 8>::Random();
+  Eigen::Matrix<double, 8, 1> u = Eigen::Matrix<double, 8, 1>::Random();
+  Eigen::Matrix<double, 8, 8> H_inv = (X.transpose() * X).inverse();
+
+  for (double sign : {1.0, -1.0}) {
+    Eigen::MatrixXd expected = Rank1Update(H_inv, u, sign);
+    Eigen::Matrix<double, 8, 8> updated = H_inv;
+    Rank1UpdateInPlace(u, sign, &updated);
+    EXPECT_LT((updated - expected).cwiseAbs().maxCoeff(),
+              1e-9 * expected.cwiseAbs().maxCoeff());
+  }
+}
+
 }  // namespace ringli
@@ -15,6 +15,12 @@
 #ifndef COMMON_PREDICTOR_H_
 #define COMMON_PREDICTOR_H_
 
+#include <stddef.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
 namespace ringli {
 
 class Predictor {
@@ -26,6 +32,47 @@ class Predictor {
   virtual void Reset() = 0;
 };
 
+// Predicts the next samples of all channels of a stream at once.
+class MultiChannelPredictor {
+ public:
+  virtual ~MultiChannelPredictor() = default;
+  // Sets predictions[c] to the prediction of the next sample of channel c.
+  virtual void Predict(float* predictions) = 0;
+
+  // Adds the next sample of each channel.
+  virtual void AddNewSamples(const float* samples) = 0;
+  virtual void Reset() = 0;
+};
+
+// Predicts each channel with its own Predictor.
+class PerChannelPredictor : public MultiChannelPredictor {
+ public:
+  explicit PerChannelPredictor(
+      std::vector<std::unique_ptr<Predictor>> predictors)
+      : predictors_(std::move(predictors)) {}
+
+  void Predict(float* predictions) override {
+    for (size_t c = 0; c < predictors_.size(); ++c) {
+      predictions[c] = predictors_[c]->Predict();
+    }
+  }
+
+  void AddNewSamples(const float* samples) override {
+    for (size_t c = 0; c < predictors_.size(); ++c) {
+      predictors_[c]->AddNewSample(samples[c]);
+    }
+  }
+
+  void Reset() override {
+    for (auto& predictor : predictors_) {
+      predictor->Reset();
+    }
+  }
+
+ private:
+  std::vector<std::unique_ptr<Predictor>> predictors_;
+};
+
 }  // namespace ringli
 
 #endif  // COMMON_PREDICTOR_H_
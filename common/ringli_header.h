@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 
+#include <array>
 #include <cstdint>
 #include <vector>
 
@@ -37,6 +38,27 @@ struct RingliDecoderConfig {
   bool use_adaptive_quantization = false;
 
   bool predictor_fast_mode() const { return effort <= 5; }
+
+  // The fully streaming mode, i.e. online predictive coding with arithmetic
+  // coding only, codes sample by sample and has no segments, and so no seek
+  // points either.
+  bool segmented() const {
+    return ecparams.segment_size > 0 &&
+           !(use_online_predictive_coding && ecparams.arithmetic_only);
+  }
+  bool has_seek_table() const {
+    return segmented() && ecparams.seek_interval > 0;
+  }
+  bool channel_substreams() const {
+    return segmented() && use_predictive_coding &&
+           ecparams.channel_substreams;
+  }
+  // Returns true if the segment with the given index can be decoded without
+  // the previous segments.
+  bool independent_segment(size_t segment_idx) const {
+    return ecparams.arithmetic_only ||
+           (has_seek_table() && segment_idx % ecparams.seek_interval == 0);
+  }
 } __attribute__((packed));
 
 struct RingliHeader {
@@ -49,6 +71,25 @@ struct RingliHeader {
   RingliDecoderConfig config;
 } __attribute__((packed));
 
+// Header of the streams with the kRingliLegacyId id. Its config has the fields
+// of RingliDecoderConfig, except that EntropyCodingParams is only the
+// arithmetic_only flag.
+struct RingliLegacyHeader {
+  char ringli_id[8];
+  uint32_t header_length;
+  uint16_t number_of_channels;
+  uint32_t sampling_frequency;
+  uint16_t bits_per_sample;
+  uint32_t data_length;
+  uint8_t arithmetic_only;
+  uint8_t use_predictive_coding;
+  uint8_t use_online_predictive_coding;
+  uint16_t pred_quant;
+  uint8_t effort;
+  bool use_noise_filter;
+  bool use_adaptive_quantization;
+} __attribute__((packed));
+
 struct RingliDCTHeader {
   uint16_t quant[kNumDctBands] = {};
 
@@ -63,10 +104,13 @@ struct RingliDCTHeader {
 } __attribute__((packed));
 
 struct RingliPredictiveHeader {
+  // Order of the linear predictor, only the first order entries of quant_lsf
+  // are used.
+  uint8_t order = 0;
   // Line spectral frequencies normalized in the [0, 1] interval and quantized
   // with a variable-precision quantizer: the pth coefficient is quantized to
   // round(kLSFQuant[p]) + 1 levels.
-  std::vector<uint16_t> quant_lsf;
+  std::array<uint16_t, kMaxPredictorOrder> quant_lsf = {};
 };
 
 struct RingliBlockHeader {
@@ -0,0 +1,109 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/thread_pool.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace ringli {
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  workers_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_tasks_ == tasks_.size()) {
+      // Unwrap the ring buffer into a larger one.
+      std::vector<std::function<void()>> tasks(
+          std::max<size_t>(2 * tasks_.size(), 16));
+      for (size_t i = 0; i < num_tasks_; ++i) {
+        tasks[i] = std::move(tasks_[(first_task_ + i) % tasks_.size()]);
+      }
+      tasks_.swap(tasks);
+      first_task_ = 0;
+    }
+    tasks_[(first_task_ + num_tasks_++) % tasks_.size()] = std::move(task);
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t num_tasks,
+                             const std::function<void(size_t)>& fn) {
+  if (num_tasks == 0) return;
+  std::atomic<size_t> next_task{0};
+  const auto run = [&]() {
+    for (size_t i = next_task++; i < num_tasks; i = next_task++) {
+      fn(i);
+    }
+  };
+  const size_t num_helpers = std::min(NumThreads(), num_tasks - 1);
+  std::mutex done_mutex;
+  std::condition_variable done_cv;
+  size_t num_done = 0;
+  for (size_t i = 0; i < num_helpers; ++i) {
+    Schedule([&]() {
+      run();
+      std::lock_guard<std::mutex> lock(done_mutex);
+      ++num_done;
+      done_cv.notify_one();
+    });
+  }
+  run();
+  std::unique_lock<std::mutex> lock(done_mutex);
+  done_cv.wait(lock, [&]() { return num_done == num_helpers; });
+}
+
+void ThreadPool::WorkerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return shutdown_ || num_tasks_ > 0; });
+      if (num_tasks_ == 0) return;
+      task = std::move(tasks_[first_task_]);
+      tasks_[first_task_] = nullptr;
+      first_task_ = (first_task_ + 1) % tasks_.size();
+      --num_tasks_;
+    }
+    task();
+    ++num_completed_tasks_;
+  }
+}
+
+}  // namespace ringli
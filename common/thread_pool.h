@@ -0,0 +1,69 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMMON_THREAD_POOL_H_
+#define COMMON_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace ringli {
+
+// Fixed number of worker threads running scheduled tasks in FIFO order. The
+// destructor waits for all scheduled tasks to finish.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t NumThreads() const { return workers_.size(); }
+
+  // Number of tasks that the worker threads have finished so far.
+  size_t NumCompletedTasks() const { return num_completed_tasks_; }
+
+  // Schedules task to be run on one of the worker threads. The task queue
+  // keeps its storage, so this only allocates when more tasks are waiting
+  // than ever before, or when task does not fit in std::function inline.
+  void Schedule(std::function<void()> task);
+
+  // Runs fn(0), ..., fn(num_tasks - 1) on the worker threads and the calling
+  // thread and returns when all of them are done.
+  void ParallelFor(size_t num_tasks, const std::function<void(size_t)>& fn);
+
+ private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // Ring buffer of the scheduled tasks, the first one is tasks_[first_task_].
+  std::vector<std::function<void()>> tasks_;
+  size_t first_task_ = 0;
+  size_t num_tasks_ = 0;
+  bool shutdown_ = false;
+  std::atomic<size_t> num_completed_tasks_{0};
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace ringli
+
+#endif  // COMMON_THREAD_POOL_H_
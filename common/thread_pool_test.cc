@@ -0,0 +1,57 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/thread_pool.h"
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ringli {
+namespace {
+
+TEST(ThreadPoolTest, ParallelForRunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  std::vector<int> counts(1000);
+  pool.ParallelFor(counts.size(), [&](size_t i) { ++counts[i]; });
+  for (size_t i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(counts[i], 1) << "i=" << i;
+  }
+}
+
+TEST(ThreadPoolTest, ParallelForWithoutWorkers) {
+  ThreadPool pool(0);
+  std::vector<int> counts(10);
+  pool.ParallelFor(counts.size(), [&](size_t i) { ++counts[i]; });
+  for (size_t i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(counts[i], 1) << "i=" << i;
+  }
+}
+
+TEST(ThreadPoolTest, DestructorFinishesScheduledTasks) {
+  std::atomic<int> num_done{0};
+  {
+    ThreadPool pool(3);
+    for (int i = 0; i < 100; ++i) {
+      pool.Schedule([&]() { ++num_done; });
+    }
+  }
+  EXPECT_EQ(num_done, 100);
+}
+
+}  // namespace
+}  // namespace ringli
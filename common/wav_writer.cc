@@ -16,6 +16,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <algorithm>
 #include <limits>
@@ -58,19 +59,32 @@ void WriteWavHeader(const WavHeader& wav_header, std::string* output) {
 
 void WriteWavBlock(const AudioBlock& block, size_t max_samples,
                    std::string* output) {
-  size_t max_time_slots =
-      std::min(kRingliBlockSize, max_samples / block.GetChannels().size());
+  const size_t num_channels = block.GetChannels().size();
+  const size_t max_time_slots =
+      std::min(kRingliBlockSize, max_samples / num_channels);
+  const size_t pos = output->size();
+  output->resize(pos + max_time_slots * num_channels * sizeof(int16_t));
+  WriteWavBlock(block, max_samples, &(*output)[pos]);
+}
+
+size_t WriteWavBlock(const AudioBlock& block, size_t max_samples,
+                     char* output) {
+  const size_t num_channels = block.GetChannels().size();
+  const size_t max_time_slots =
+      std::min(kRingliBlockSize, max_samples / num_channels);
   // TODO(szabadka) Make this work with other wav formats as well.
-  output->reserve(output->size() + max_samples * sizeof(int16_t));
   const int32_t minval = std::numeric_limits<int16_t>::min();
   const int32_t maxval = std::numeric_limits<int16_t>::max();
+  char* out = output;
   for (int i = 0; i < max_time_slots; i++) {
     for (const RingliVector& raw_block : block.GetChannels()) {
       const int32_t raw_value = raw_block[i];
       const int16_t clamped_value = std::clamp(raw_value, minval, maxval);
-      Write(clamped_value, output);
+      memcpy(out, &clamped_value, sizeof(clamped_value));
+      out += sizeof(clamped_value);
     }
   }
+  return out - output;
 }
 
 void WriteSamples(const int16_t* samples, size_t num_samples,
@@ -28,6 +28,10 @@ void WriteWavHeader(const WavHeader& wav_header, std::string* output);
 void WriteWavBlock(const AudioBlock& block, size_t max_samples,
                    std::string* output);
 
+// Writes the samples of block like the function above to output, which has
+// room for them, and returns the number of bytes written.
+size_t WriteWavBlock(const AudioBlock& block, size_t max_samples, char* output);
+
 void WriteSamples(const int16_t* samples, size_t num_samples,
                   std::string* output);
 
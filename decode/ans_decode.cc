@@ -48,4 +48,8 @@ bool ANSDecodingData::ReadFromBitStream(RingliBitReader* br) {
           ANSBuildMapTable(counts, map_));
 }
 
+bool ANSDecodingData::InitFromCounts(const int* counts) {
+  return ANSBuildMapTable(counts, map_);
+}
+
 }  // namespace ringli
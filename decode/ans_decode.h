@@ -18,6 +18,7 @@
 #ifndef DECODE_ANS_DECODE_H_
 #define DECODE_ANS_DECODE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "common/ans_params.h"
@@ -37,31 +38,52 @@ struct ANSDecodingData {
 
   bool ReadFromBitStream(RingliBitReader* br);
 
+  // Builds the decoding table from counts that sum to ANS_TAB_SIZE.
+  bool InitFromCounts(const int* counts);
+
   ANSSymbolInfo map_[ANS_TAB_SIZE];
 };
 
 class ANSDecoder {
  public:
-  ANSDecoder() : state_(0) {}
+  ANSDecoder() : state_{}, num_states_(1), idx_(0) {}
 
-  void Init(RingliInput* in) {
-    state_ = in->GetNextWord();
-    state_ = (state_ << 16) | in->GetNextWord();
+  // Reads the initial values of num_states interleaved states, which must be
+  // a power of two not larger than kMaxANSStates.
+  void Init(RingliInput* in, size_t num_states = 1) {
+    num_states_ = num_states;
+    idx_ = 0;
+    for (size_t i = 0; i < num_states_; ++i) {
+      state_[i] = in->GetNextWord();
+      state_[i] = (state_[i] << 16) | in->GetNextWord();
+    }
   }
 
+  // The consecutive symbols use different states, so that the table lookup
+  // of a symbol does not have to wait for the state update of the previous
+  // one.
   int ReadSymbol(const ANSDecodingData& code, RingliInput* in) {
-    const uint32_t res = state_ & (ANS_TAB_SIZE - 1);
+    uint32_t& state = state_[idx_];
+    idx_ = (idx_ + 1) & (num_states_ - 1);
+    const uint32_t res = state & (ANS_TAB_SIZE - 1);
     const ANSSymbolInfo& s = code.map_[res];
-    state_ = s.freq_ * (state_ >> ANS_LOG_TAB_SIZE) + s.offset_;
-    if (state_ < (1u << 16)) {
-      state_ = (state_ << 16) | in->GetNextWord();
+    state = s.freq_ * (state >> ANS_LOG_TAB_SIZE) + s.offset_;
+    if (state < (1u << 16)) {
+      state = (state << 16) | in->GetNextWord();
     }
     return s.symbol_;
   }
-  bool CheckCRC() const { return state_ == (ANS_SIGNATURE << 16); }
+  bool CheckCRC() const {
+    for (size_t i = 0; i < num_states_; ++i) {
+      if (state_[i] != (ANS_SIGNATURE << 16)) return false;
+    }
+    return true;
+  }
 
  private:
-  uint32_t state_;
+  uint32_t state_[kMaxANSStates];
+  size_t num_states_;
+  size_t idx_;
 };
 
 }  // namespace ringli
@@ -18,6 +18,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
+
+#include "common/log2floor.h"
 #include "decode/ringli_input.h"
 
 namespace ringli {
@@ -26,6 +29,9 @@ namespace ringli {
 // skal@ wrote the original version, szabadka@ ported it for brunsli.
 class BinaryArithmeticDecoder {
  public:
+  // The words of the stream that Fill() takes.
+  typedef uint16_t Word;
+
   BinaryArithmeticDecoder() : low_(0), high_(0), value_(0) {}
 
   void Init(RingliInput* in) {
@@ -70,10 +76,50 @@ class BinaryArithmeticDecoder {
     return ReadBitNoFill(prob);
   }
 
-  int ReadBits(int nbits, RingliInput* in) {
+  // Returns the number of the next nbits equiprobable bits that the encoder
+  // coded with one range scaling, i.e. that ReadBitsNoFill() can read at once.
+  // Can be called only when HasBit() returns true.
+  int NumBypassBits(int nbits) const {
+    return std::min(nbits, std::max(1, Log2FloorNonZero(high_ - low_) - 15));
+  }
+
+  // Returns the next n equiprobable bits, where n must be NumBypassBits() of
+  // the number of remaining bits. Can be called only when HasBit() returns
+  // true.
+  uint32_t ReadBitsNoFill(int n) {
+    const uint32_t step = (static_cast<uint64_t>(high_ - low_) + 1) >> n;
+    uint32_t bits = (value_ - low_) / step;
+    // Only corrupted data can point past the last value.
+    if (bits >> n) bits = (1u << n) - 1;
+    low_ += step * bits;
+    high_ = low_ + step - 1;
+    return bits;
+  }
+
+  // Reads the next of the nbits remaining extra bits of a value to *bits and
+  // returns their number. With bypass_bits, these are the bits that the
+  // encoder coded with one range scaling of AddBits(), otherwise one bit coded
+  // with AddBit(128, ...). Can be called only when HasBit() returns true.
+  int ReadExtraBitsNoFill(bool bypass_bits, int nbits, uint32_t* bits) {
+    if (!bypass_bits) {
+      *bits = ReadBitNoFill(128);
+      return 1;
+    }
+    const int n = NumBypassBits(nbits);
+    *bits = ReadBitsNoFill(n);
+    return n;
+  }
+
+  int ReadBits(bool bypass_bits, int nbits, RingliInput* in) {
     int val = 0;
-    for (int b = 0; b < nbits; ++b) {
-      val |= ReadBit(128, in) << b;
+    for (int b = 0; b < nbits;) {
+      while (!HasBit()) {
+        Fill(in->GetNextWord());
+      }
+      uint32_t bits;
+      const int n = ReadExtraBitsNoFill(bypass_bits, nbits - b, &bits);
+      val |= bits << b;
+      b += n;
     }
     return val;
   }
@@ -84,6 +130,94 @@ class BinaryArithmeticDecoder {
   uint32_t value_;
 };
 
+// Decoder of the data of BinaryArithmeticEncoder64, with the same interface
+// as BinaryArithmeticDecoder, except that it is filled with 32-bit words.
+class BinaryArithmeticDecoder64 {
+ public:
+  typedef uint32_t Word;
+
+  BinaryArithmeticDecoder64() : low_(0), high_(0), value_(0) {}
+
+  void Init(RingliInput* in) {
+    value_ = in->GetNextDoubleWord();
+    value_ = (value_ << 32) | in->GetNextDoubleWord();
+    low_ = 0;
+    high_ = ~0ull;
+  }
+
+  bool HasBit() const { return ((low_ ^ high_) >> 32) != 0; }
+
+  void Fill(uint32_t next_word) {
+    value_ = (value_ << 32) | next_word;
+    low_ <<= 32;
+    high_ = (high_ << 32) | 0xffffffff;
+  }
+
+  int ReadBitNoFill(int prob) {
+    const uint64_t split = low_ + ((high_ - low_) >> 8) * prob;
+    if (value_ > split) {
+      low_ = split + 1;
+      return 1;
+    }
+    high_ = split;
+    return 0;
+  }
+
+  int ReadBit(int prob, RingliInput* in) {
+    while (!HasBit()) {
+      Fill(in->GetNextDoubleWord());
+    }
+    return ReadBitNoFill(prob);
+  }
+
+  int NumBypassBits(int nbits) const {
+    return std::min(
+        nbits,
+        std::min(16, std::max(1, Log2FloorNonZero64(high_ - low_) - 15)));
+  }
+
+  uint32_t ReadBitsNoFill(int n) {
+    const uint64_t diff = high_ - low_;
+    const uint64_t mask = (1u << n) - 1;
+    const uint64_t step = (diff >> n) + (((diff & mask) + 1) >> n);
+    uint64_t bits = (value_ - low_) / step;
+    // Only corrupted data can point past the last value.
+    if (bits > mask) bits = mask;
+    low_ += step * bits;
+    high_ = low_ + step - 1;
+    return bits;
+  }
+
+  int ReadExtraBitsNoFill(bool bypass_bits, int nbits, uint32_t* bits) {
+    if (!bypass_bits) {
+      *bits = ReadBitNoFill(128);
+      return 1;
+    }
+    const int n = NumBypassBits(nbits);
+    *bits = ReadBitsNoFill(n);
+    return n;
+  }
+
+  int ReadBits(bool bypass_bits, int nbits, RingliInput* in) {
+    int val = 0;
+    for (int b = 0; b < nbits;) {
+      while (!HasBit()) {
+        Fill(in->GetNextDoubleWord());
+      }
+      uint32_t bits;
+      const int n = ReadExtraBitsNoFill(bypass_bits, nbits - b, &bits);
+      val |= bits << b;
+      b += n;
+    }
+    return val;
+  }
+
+ private:
+  uint64_t low_;
+  uint64_t high_;
+  uint64_t value_;
+};
+
 }  // namespace ringli
 
 #endif  // DECODE_ARITH_DECODE_H_
@@ -17,19 +17,25 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
+#include "absl/log/check.h"
 #include "common/context.h"
 #include "common/data_defs/constants.h"
 #include "common/distributions.h"
 #include "common/entropy_coding.h"
+#include "common/entropy_presets.h"
+#include "common/log2floor.h"
 #include "common/ringli_header.h"
+#include "common/thread_pool.h"
 #include "decode/ans_decode.h"
 #include "decode/arith_decode.h"
 #include "decode/bit_reader.h"
 #include "decode/context_map_decode.h"
 #include "decode/ringli_input.h"
+#include "decode/symbol_reader.h"
 
 namespace ringli {
 
@@ -49,15 +55,6 @@ bool DecodeBase128(const uint8_t* data, const size_t len, size_t* pos,
   return true;
 }
 
-int16_t ConvertToSigned(uint16_t val) {
-  int ux = val;
-  if (ux & 1) {
-    return -1 * ((ux + 1) / 2);
-  } else {
-    return ux / 2;
-  }
-}
-
 bool DecodeDataLength(const uint8_t* data, const size_t len, size_t* pos,
                       size_t* data_len) {
   if (!DecodeBase128(data, len, pos, data_len)) {
@@ -66,70 +63,121 @@ bool DecodeDataLength(const uint8_t* data, const size_t len, size_t* pos,
   return *data_len <= len && *pos <= len - *data_len;
 }
 
-int DecodeSymbol(int alphabet_size, Prob* p, BinaryArithmeticDecoder* ac,
-                 RingliInput* in) {
-  int val0 = 0;
-  int val1 = alphabet_size;
-  while (val0 + 1 < val1) {
-    int mid = (val0 + val1) >> 1;
-    const int bit = ac->ReadBit(p[mid - 1].get_proba(), in);
-    p[mid - 1].Add(bit);
-    if (bit) {
-      val0 = mid;
-    } else {
-      val1 = mid;
+// Reads the size of the histogram data and the context map and entropy codes
+// after it. Empty histogram data means that the current codes are kept, which
+// is only valid after a previous segment. With entropy_presets, the histogram
+// data can select a built-in entropy code instead.
+bool DecodeHistograms(const uint8_t* data, size_t len, size_t num_contexts,
+                      bool entropy_presets, size_t* pos,
+                      ANSEntropyCodes* codes) {
+  size_t histograms_size;
+  if (!DecodeDataLength(data, len, pos, &histograms_size)) {
+    return false;
+  }
+  if (histograms_size == 0) {
+    return !codes->entropy_codes.empty();
+  }
+  RingliBitReader br;
+  RingliBitReaderInit(&br, &data[*pos], histograms_size);
+  *pos += histograms_size;
+  if (entropy_presets) {
+    const int preset_idx = RingliBitReaderReadBits(&br, 8);
+    if (preset_idx > kNumEntropyPresets) {
+      return false;
+    }
+    if (preset_idx > 0) {
+      const EntropyPreset& preset = GetEntropyPreset(preset_idx - 1);
+      DCHECK_EQ(preset.context_map.size(), num_contexts);
+      codes->context_map.assign(preset.context_map.begin(),
+                                preset.context_map.end());
+      codes->entropy_codes.clear();
+      codes->entropy_codes.resize(preset.counts.size());
+      for (size_t i = 0; i < preset.counts.size(); ++i) {
+        if (!codes->entropy_codes[i].InitFromCounts(preset.counts[i].data())) {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  int num_histograms;
+  codes->context_map.resize(num_contexts);
+  if (!DecodeContextMap(num_contexts, &codes->context_map[0], &num_histograms,
+                        &br)) {
+    return false;
+  }
+  codes->entropy_codes.clear();
+  codes->entropy_codes.resize(num_histograms);
+  for (int i = 0; i < num_histograms; ++i) {
+    if (!codes->entropy_codes[i].ReadFromBitStream(&br)) {
+      return false;
     }
   }
-  return val0;
+  return true;
 }
 
-int DecodeValue(int symbol, int ndirect, RingliInput* in,
-                BinaryArithmeticDecoder* ac = nullptr) {
-  const int ndirect_symbols = 2 * ndirect - 1;
-  if (symbol < ndirect_symbols) {
-    return ConvertToSigned(symbol);
-  } else {
-    int sym = symbol - ndirect_symbols;
-    const int sign = sym & 1;
-    sym >>= 1;
-    const int msb = sym & 1;
-    const int nbits = sym >> 1;
-    const int absval = ndirect - 2 + ((2 + msb) << nbits) +
-                       (ac ? ac->ReadBits(nbits, in) : in->ReadBits(nbits));
-    return (1 - 2 * sign) * absval;
+bool FindSegmentSize(const uint8_t* data, size_t len,
+                     const RingliDecoderConfig& config, size_t num_channels,
+                     size_t* segment_size) {
+  // The arithmetic coded segments have no histogram data.
+  const size_t num_parts = (config.ecparams.arithmetic_only ? 0 : 1) +
+                           (config.channel_substreams() ? num_channels : 1);
+  size_t pos = 0;
+  for (size_t i = 0; i < num_parts; ++i) {
+    size_t size;
+    if (!DecodeDataLength(data, len, &pos, &size)) {
+      return false;
+    }
+    pos += size;
   }
+  *segment_size = pos;
+  return true;
+}
+
+bool ReadSeekTable(const uint8_t* data, size_t len,
+                   std::vector<size_t>* offsets, size_t* table_start) {
+  if (len < 4) {
+    return false;
+  }
+  size_t table_size = 0;
+  for (int i = 0; i < 4; ++i) {
+    table_size |= static_cast<size_t>(data[len - 4 + i]) << (8 * i);
+  }
+  if (table_size > len - 4) {
+    return false;
+  }
+  *table_start = len - 4 - table_size;
+  offsets->clear();
+  size_t pos = *table_start;
+  size_t offset = 0;
+  while (pos < len - 4) {
+    size_t delta;
+    if (!DecodeBase128(data, len - 4, &pos, &delta)) {
+      return false;
+    }
+    offset += delta;
+    if (offset >= *table_start) {
+      return false;
+    }
+    offsets->push_back(offset);
+  }
+  return true;
 }
 
 bool DecompressCoefficients(const char* input, size_t input_size,
                             size_t num_channels, size_t num_blocks,
                             const RingliDecoderConfig& config,
+                            ANSEntropyCodes* codes,
                             std::vector<RingliBlock>* ringli_blocks) {
   const uint8_t* data = reinterpret_cast<const uint8_t*>(input);
   const size_t num_contexts = 2 + kNumZeroDensityContexts;
   size_t pos = 0;
-  std::vector<uint8_t> context_map;
-  std::vector<ANSDecodingData> entropy_codes;
-  if (!config.ecparams.arithmetic_only) {
-    size_t histograms_size;
-    if (!DecodeDataLength(data, input_size, &pos, &histograms_size) ||
-        histograms_size == 0) {
-      return false;
-    }
-    RingliBitReader br;
-    RingliBitReaderInit(&br, &data[pos], histograms_size);
-    int num_histograms;
-    context_map.resize(num_contexts);
-    if (!DecodeContextMap(num_contexts, &context_map[0], &num_histograms,
-                          &br)) {
-      return false;
-    }
-    entropy_codes.resize(num_histograms);
-    for (int i = 0; i < num_histograms; ++i) {
-      if (!entropy_codes[i].ReadFromBitStream(&br)) {
-        return false;
-      }
-    }
-    pos += histograms_size;
+  const std::vector<uint8_t>& context_map = codes->context_map;
+  const std::vector<ANSDecodingData>& entropy_codes = codes->entropy_codes;
+  if (!config.ecparams.arithmetic_only &&
+      !DecodeHistograms(data, input_size, num_contexts,
+                        /*entropy_presets=*/false, &pos, codes)) {
+    return false;
   }
   size_t coeff_data_size;
   if (!DecodeDataLength(data, input_size, &pos, &coeff_data_size) ||
@@ -137,13 +185,14 @@ bool DecompressCoefficients(const char* input, size_t input_size,
     return false;
   }
   RingliInput in(&data[pos], coeff_data_size);
-  BinaryArithmeticDecoder ac;
+  SymbolReader<BinaryArithmeticDecoder, RingliInput> reader(config.ecparams,
+                                                            &in);
   ANSDecoder ans;
   if (!config.ecparams.arithmetic_only) {
-    ans.Init(&in);
+    ans.Init(&in, config.ecparams.NumANSStates());
   }
-  in.InitBitReader();
-  ac.Init(&in);
+  reader.InitBitReader();
+  reader.InitArithmeticDecoder();
   std::vector<Prob> last_nz_prob(kDctLength - 1);
   std::vector<Prob> is_zero_prob(kNumZeronessContexts);
   std::vector<Prob> sign_prob(kDctLength);
@@ -156,9 +205,8 @@ bool DecompressCoefficients(const char* input, size_t input_size,
     for (int band = 0; band < kNumDctBands; ++band) {
       int quant_msb, quant_lsb;
       if (config.ecparams.arithmetic_only) {
-        quant_msb = DecodeSymbol(MAX_SYMBOLS, &symbol_prob[0], &ac, &in);
-        quant_lsb =
-            DecodeSymbol(MAX_SYMBOLS, &symbol_prob[MAX_SYMBOLS - 1], &ac, &in);
+        reader.ReadByteSymbol(&symbol_prob[0], &quant_msb);
+        reader.ReadByteSymbol(&symbol_prob[MAX_SYMBOLS - 1], &quant_lsb);
       } else {
         quant_msb = ans.ReadSymbol(entropy_codes[context_map[0]], &in);
         quant_lsb = ans.ReadSymbol(entropy_codes[context_map[1]], &in);
@@ -168,29 +216,26 @@ bool DecompressCoefficients(const char* input, size_t input_size,
     for (size_t c = 0; c < num_channels; ++c) {
       for (size_t b = 0; b < kDctNumber; ++b) {
         auto& block = ringli_block.channels[c];
-        int last_nz = DecodeSymbol(kDctLength, &last_nz_prob[0], &ac, &in);
+        int last_nz;
+        reader.ReadSymbol(kDctLength, &last_nz_prob[0], &last_nz);
         int num_nzeros = 0;
         for (int k = last_nz; k >= 0; --k) {
           int is_zero = 0;
           if (k == 0 || k < last_nz) {
             const int is_zero_ctx = ZeronessContext(num_nzeros, k);
-            Prob* const p = &is_zero_prob[is_zero_ctx];
-            is_zero = ac.ReadBit(p->get_proba(), &in);
-            p->Add(is_zero);
+            reader.ReadAdaptiveBit(&is_zero_prob[is_zero_ctx], &is_zero);
           }
           total_num_zeros += is_zero;
           if (!is_zero) {
             int absval = 1;
             const int sign_ctx = k;
-            Prob* const sign_p = &sign_prob[sign_ctx];
-            int sign = ac.ReadBit(sign_p->get_proba(), &in);
-            sign_p->Add(sign);
+            int sign;
+            reader.ReadAdaptiveBit(&sign_prob[sign_ctx], &sign);
             const int absval_ctx = 2 + ZeroDensityContext(num_nzeros, k);
             int code = 0;
             if (config.ecparams.arithmetic_only) {
-              code = DecodeSymbol(MAX_SYMBOLS,
-                                  &symbol_prob[absval_ctx * (MAX_SYMBOLS - 1)],
-                                  &ac, &in);
+              reader.ReadByteSymbol(
+                  &symbol_prob[absval_ctx * (MAX_SYMBOLS - 1)], &code);
             } else {
               const int entropy_ix = context_map[absval_ctx];
               code = ans.ReadSymbol(entropy_codes[entropy_ix], &in);
@@ -199,7 +244,8 @@ bool DecompressCoefficients(const char* input, size_t input_size,
               absval = code + 1;
             } else {
               int nbits = code - NUM_DIRECT_CODES + 1;
-              int extra_bits_val = in.ReadBits(nbits);
+              int extra_bits_val;
+              reader.ReadBits(nbits, &extra_bits_val);
               absval = NUM_DIRECT_CODES - 1 + (1 << nbits) + extra_bits_val;
               total_extra_bits += nbits;
             }
@@ -220,147 +266,552 @@ bool DecompressCoefficients(const char* input, size_t input_size,
   return true;
 }
 
-bool DecompressPredictiveRingliBlocks(const char* input, size_t input_size,
-                                      size_t num_channels, size_t num_blocks,
-                                      const RingliDecoderConfig& config,
-                                      std::vector<RingliBlock>* ringli_blocks) {
-  const uint8_t* data = reinterpret_cast<const uint8_t*>(input);
-  size_t pos = 0;
+// Decodes the predictor parameters and residuals of one channel of a block.
+template <typename ArithmeticDecoder>
+bool DecodePredictiveChannel(
+    const RingliDecoderConfig& config, const ANSEntropyCodes& codes,
+    ANSDecoder* ans, SymbolReader<ArithmeticDecoder, RingliInput>* reader,
+    RingliInput* in, Prob* symbol_prob, PredictiveContextModel* context_model,
+    RingliPredictiveHeader* header, RingliVector* block) {
+  const std::vector<uint8_t>& context_map = codes.context_map;
+  const std::vector<ANSDecodingData>& entropy_codes = codes.entropy_codes;
+  const bool aconly = config.ecparams.arithmetic_only;
+  if (!config.use_online_predictive_coding) {
+    int order;
+    if (aconly) {
+      reader->ReadByteSymbol(&symbol_prob[2 * (MAX_SYMBOLS - 1)], &order);
+    } else {
+      order = ans->ReadSymbol(entropy_codes[context_map[2]], in);
+    }
+    if (order > kMaxPredictorOrder) {
+      return false;
+    }
+    header->order = order;
+    for (int p = 0; p < order; ++p) {
+      const int pred_lsf = p * (kLSFQuant[p] / order);
+      const int ctx = 3 + LSFContext(p, order);
+      int symbol, val;
+      if (aconly) {
+        reader->ReadByteSymbol(&symbol_prob[ctx * (MAX_SYMBOLS - 1)], &symbol);
+      } else {
+        symbol = ans->ReadSymbol(entropy_codes[context_map[ctx]], in);
+      }
+      reader->ReadValue(symbol, 16, /*raw_bits=*/!aconly, &val);
+      header->quant_lsf[p] = pred_lsf + val;
+    }
+  }
+  context_model->Reset();
+  for (int i = 0; i < kRingliBlockSize; ++i) {
+    const int ctx = 3 + kNumLSFContexts + context_model->Context();
+    int symbol, val;
+    if (aconly) {
+      reader->ReadByteSymbol(&symbol_prob[ctx * (MAX_SYMBOLS - 1)], &symbol);
+    } else {
+      symbol = ans->ReadSymbol(entropy_codes[context_map[ctx]], in);
+    }
+    reader->ReadValue(symbol, kPredNumDirectAbsval, /*raw_bits=*/!aconly,
+                      &val);
+    context_model->Add(val);
+    (*block)[i] = val;
+  }
+  return true;
+}
 
+// Decodes the given channels of the blocks from the code words in
+// data[0, data_size), which is either the whole data of a segment, or the
+// substream of one channel.
+template <typename ArithmeticDecoder>
+bool DecodePredictiveChannels(const uint8_t* data, size_t data_size,
+                              size_t first_channel, size_t num_channels,
+                              const RingliDecoderConfig& config,
+                              const ANSEntropyCodes& codes,
+                              RingliBlock* ringli_blocks, size_t num_blocks) {
   PredictiveContextModel context_model;
   const size_t num_contexts = 3 + kNumLSFContexts + context_model.NumContexts();
   std::vector<Prob> symbol_prob;
   if (config.ecparams.arithmetic_only) {
     symbol_prob.resize(num_contexts * (MAX_SYMBOLS - 1));
   }
-  std::vector<uint8_t> context_map;
-  std::vector<ANSDecodingData> entropy_codes;
+  RingliInput in(data, data_size);
+  SymbolReader<ArithmeticDecoder, RingliInput> reader(config.ecparams, &in);
+  ANSDecoder ans;
   if (!config.ecparams.arithmetic_only) {
-    size_t histograms_size;
-    if (!DecodeDataLength(data, input_size, &pos, &histograms_size) ||
-        histograms_size == 0) {
-      return false;
-    }
-    RingliBitReader br;
-    RingliBitReaderInit(&br, &data[pos], histograms_size);
-    int num_histograms;
-    context_map.resize(num_contexts);
-    if (!DecodeContextMap(num_contexts, &context_map[0], &num_histograms,
-                          &br)) {
-      return false;
-    }
-    entropy_codes.resize(num_histograms);
-    for (int i = 0; i < num_histograms; ++i) {
-      if (!entropy_codes[i].ReadFromBitStream(&br)) {
+    ans.Init(&in, config.ecparams.NumANSStates());
+    reader.InitBitReader();
+  }
+  reader.InitArithmeticDecoder();
+  for (size_t bi = 0; bi < num_blocks; ++bi) {
+    RingliBlock& ringli_block = ringli_blocks[bi];
+    for (size_t ci = first_channel; ci < first_channel + num_channels; ++ci) {
+      if (!DecodePredictiveChannel(config, codes, &ans, &reader, &in,
+                                   symbol_prob.data(), &context_model,
+                                   &ringli_block.header.pred[ci],
+                                   &ringli_block.channels[ci])) {
         return false;
       }
     }
-    pos += histograms_size;
   }
+  if (!config.ecparams.arithmetic_only && !ans.CheckCRC()) {
+    return false;
+  }
+  return true;
+}
 
-  RingliInput in(&data[pos], input_size - pos);
-  BinaryArithmeticDecoder ac;
-  ANSDecoder ans;
-  if (!config.ecparams.arithmetic_only) {
-    ans.Init(&in);
-    in.InitBitReader();
+bool DecodePredictiveChannels(const uint8_t* data, size_t data_size,
+                              size_t first_channel, size_t num_channels,
+                              const RingliDecoderConfig& config,
+                              const ANSEntropyCodes& codes,
+                              RingliBlock* ringli_blocks, size_t num_blocks) {
+  if (config.ecparams.arithmetic_only &&
+      config.ecparams.wide_arithmetic_coding) {
+    return DecodePredictiveChannels<BinaryArithmeticDecoder64>(
+        data, data_size, first_channel, num_channels, config, codes,
+        ringli_blocks, num_blocks);
   }
-  ac.Init(&in);
+  return DecodePredictiveChannels<BinaryArithmeticDecoder>(
+      data, data_size, first_channel, num_channels, config, codes,
+      ringli_blocks, num_blocks);
+}
 
+bool DecompressPredictiveRingliBlocks(const char* input, size_t input_size,
+                                      size_t num_channels, size_t num_blocks,
+                                      const RingliDecoderConfig& config,
+                                      ANSEntropyCodes* codes,
+                                      std::vector<RingliBlock>* ringli_blocks,
+                                      ThreadPool* pool) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input);
+  size_t pos = 0;
+  PredictiveContextModel context_model;
+  const size_t num_contexts = 3 + kNumLSFContexts + context_model.NumContexts();
+  if (!config.ecparams.arithmetic_only &&
+      !DecodeHistograms(data, input_size, num_contexts,
+                        config.ecparams.entropy_presets, &pos, codes)) {
+    return false;
+  }
+  const size_t first_block = ringli_blocks->size();
   for (size_t bi = 0; bi < num_blocks; ++bi) {
-    RingliBlock ringli_block(num_channels);
+    ringli_blocks->emplace_back(num_channels);
+  }
+  RingliBlock* blocks = &(*ringli_blocks)[first_block];
+  if (!config.channel_substreams()) {
+    size_t data_size;
+    // Only the segments of a segmented stream have an explicit data size.
+    if (config.segmented()) {
+      if (!DecodeDataLength(data, input_size, &pos, &data_size)) {
+        return false;
+      }
+    } else {
+      data_size = input_size - pos;
+    }
+    return DecodePredictiveChannels(&data[pos], data_size, 0, num_channels,
+                                    config, *codes, blocks, num_blocks);
+  }
+  std::vector<size_t> substream_pos(num_channels);
+  std::vector<size_t> substream_size(num_channels);
+  for (size_t ci = 0; ci < num_channels; ++ci) {
+    if (!DecodeDataLength(data, input_size, &pos, &substream_size[ci])) {
+      return false;
+    }
+    substream_pos[ci] = pos;
+    pos += substream_size[ci];
+  }
+  std::vector<char> ok(num_channels);
+  const auto decode_substream = [&](size_t ci) {
+    ok[ci] = DecodePredictiveChannels(&data[substream_pos[ci]],
+                                      substream_size[ci], ci, 1, config,
+                                      *codes, blocks, num_blocks);
+  };
+  if (pool) {
+    pool->ParallelFor(num_channels, decode_substream);
+  } else {
     for (size_t ci = 0; ci < num_channels; ++ci) {
-      auto& header = ringli_block.header.pred[ci];
-      if (!config.use_online_predictive_coding) {
-        uint8_t order;
-        if (config.ecparams.arithmetic_only) {
-          order = DecodeSymbol(MAX_SYMBOLS, &symbol_prob[2 * (MAX_SYMBOLS - 1)],
-                               &ac, &in);
-        } else {
-          order = ans.ReadSymbol(entropy_codes[context_map[2]], &in);
-        }
-        header.quant_lsf.resize(order);
-        for (int p = 0; p < order; ++p) {
-          const int pred_lsf = p * (kLSFQuant[p] / order);
-          const int ctx = 3 + LSFContext(p, order);
-          if (config.ecparams.arithmetic_only) {
-            const int symbol = DecodeSymbol(
-                MAX_SYMBOLS, &symbol_prob[ctx * (MAX_SYMBOLS - 1)], &ac, &in);
-            header.quant_lsf[p] = pred_lsf + DecodeValue(symbol, 16, &in, &ac);
-          } else {
-            const int symbol =
-                ans.ReadSymbol(entropy_codes[context_map[ctx]], &in);
-            header.quant_lsf[p] = pred_lsf + DecodeValue(symbol, 16, &in);
-          }
+      decode_substream(ci);
+    }
+  }
+  return std::all_of(ok.begin(), ok.end(), [](char c) { return c; });
+}
+
+StreamingBlockDecoder::StreamingBlockDecoder(
+    const RingliDecoderConfig& config, size_t num_channels, size_t num_blocks,
+    void* opaque, ProcessBlock process_block)
+    : predictive_(config.use_predictive_coding),
+      wide_(predictive_ && config.ecparams.wide_arithmetic_coding),
+      num_channels_(num_channels),
+      num_blocks_(num_blocks),
+      opaque_(opaque),
+      process_block_(process_block),
+      reader_(config.ecparams, &input_),
+      reader64_(config.ecparams, &input_),
+      error_(false),
+      block_(num_channels),
+      block_idx_(0),
+      state_(predictive_ ? INIT : DATA_LENGTH),
+      data_length_(0),
+      shift_(0),
+      channel_idx_(0),
+      idx_(0),
+      sub_block_(0),
+      last_nz_(0),
+      num_nzeros_(0),
+      sign_(0),
+      symbol_(0) {
+  if (predictive_) {
+    const size_t num_contexts =
+        3 + kNumLSFContexts + context_model_.NumContexts();
+    symbol_prob_.resize(num_contexts * (MAX_SYMBOLS - 1));
+  } else {
+    const size_t num_contexts = 2 + kNumZeroDensityContexts;
+    last_nz_prob_.resize(kDctLength - 1);
+    is_zero_prob_.resize(kNumZeronessContexts);
+    sign_prob_.resize(kDctLength);
+    symbol_prob_.resize(num_contexts * (MAX_SYMBOLS - 1));
+    // The coefficient data has an explicit length, which is read first.
+    input_.set_data_end(0);
+  }
+}
+
+bool StreamingBlockDecoder::ProcessInput(const uint8_t* data, size_t len) {
+  input_.Append(data, len);
+  return Decode();
+}
+
+bool StreamingBlockDecoder::Flush() {
+  input_.Finish();
+  return Decode() && block_idx_ == num_blocks_;
+}
+
+bool StreamingBlockDecoder::Decode() {
+  while (!error_ && block_idx_ < num_blocks_) {
+    if (!(predictive_ ? DecodePredictive() : DecodeCoefficients())) {
+      break;
+    }
+  }
+  return !error_;
+}
+
+bool StreamingBlockDecoder::DecodePredictive() {
+  auto& header = block_.header.pred[channel_idx_];
+  switch (state_) {
+    case INIT:
+      if (!InitArithmeticDecoder()) return false;
+      state_ = ORDER;
+      return true;
+    case ORDER: {
+      int order;
+      if (!ReadByteSymbol(&symbol_prob_[2 * (MAX_SYMBOLS - 1)], &order)) {
+        return false;
+      }
+      if (order > kMaxPredictorOrder) {
+        error_ = true;
+        return false;
+      }
+      header.order = order;
+      idx_ = 0;
+      context_model_.Reset();
+      state_ = order > 0 ? LSF_SYMBOL : RESIDUAL_SYMBOL;
+      return true;
+    }
+    case LSF_SYMBOL: {
+      const int ctx = 3 + LSFContext(idx_, header.order);
+      if (!ReadByteSymbol(&symbol_prob_[ctx * (MAX_SYMBOLS - 1)], &symbol_)) {
+        return false;
+      }
+      state_ = LSF_VALUE;
+      return true;
+    }
+    case LSF_VALUE: {
+      int val;
+      if (!ReadValue(symbol_, 16, &val)) return false;
+      const int pred_lsf = idx_ * (kLSFQuant[idx_] / header.order);
+      header.quant_lsf[idx_] = pred_lsf + val;
+      if (++idx_ == header.order) {
+        idx_ = 0;
+        state_ = RESIDUAL_SYMBOL;
+      } else {
+        state_ = LSF_SYMBOL;
+      }
+      return true;
+    }
+    case RESIDUAL_SYMBOL: {
+      const int ctx = 3 + kNumLSFContexts + context_model_.Context();
+      if (!ReadByteSymbol(&symbol_prob_[ctx * (MAX_SYMBOLS - 1)], &symbol_)) {
+        return false;
+      }
+      state_ = RESIDUAL_VALUE;
+      return true;
+    }
+    case RESIDUAL_VALUE: {
+      int val;
+      if (!ReadValue(symbol_, kPredNumDirectAbsval, &val)) return false;
+      context_model_.Add(val);
+      block_.channels[channel_idx_][idx_] = val;
+      state_ = RESIDUAL_SYMBOL;
+      if (++idx_ == kRingliBlockSize) {
+        state_ = ORDER;
+        if (++channel_idx_ == num_channels_) {
+          return BlockDone();
         }
       }
-      auto& block = ringli_block.channels[ci];
-      context_model.Reset();
-      for (int i = 0; i < kRingliBlockSize; ++i) {
-        const int ctx = 3 + kNumLSFContexts + context_model.Context();
-        const int entropy_ix = context_map[ctx];
-        int val;
-        if (config.ecparams.arithmetic_only) {
-          const int symbol = DecodeSymbol(
-              MAX_SYMBOLS, &symbol_prob[ctx * (MAX_SYMBOLS - 1)], &ac, &in);
-          val = DecodeValue(symbol, kPredNumDirectAbsval, &in, &ac);
-        } else {
-          const int symbol = ans.ReadSymbol(entropy_codes[entropy_ix], &in);
-          val = DecodeValue(symbol, kPredNumDirectAbsval, &in);
+      return true;
+    }
+    default:
+      error_ = true;
+      return false;
+  }
+}
+
+bool StreamingBlockDecoder::DecodeCoefficients() {
+  switch (state_) {
+    case DATA_LENGTH: {
+      uint8_t byte;
+      if (!input_.NextByte(&byte)) {
+        if (input_.finished()) error_ = true;
+        return false;
+      }
+      data_length_ |= static_cast<size_t>(byte & 0x7f) << shift_;
+      shift_ += 7;
+      if (byte & 0x80) {
+        if (shift_ > 57) error_ = true;
+        return !error_;
+      }
+      if (data_length_ == 0) {
+        error_ = true;
+        return false;
+      }
+      input_.set_data_end(input_.num_read() + data_length_);
+      state_ = INIT;
+      return true;
+    }
+    case INIT:
+      if (!input_.HasWords(3)) return false;
+      reader_.InitBitReader();
+      reader_.InitArithmeticDecoder();
+      state_ = QUANT;
+      return true;
+    case QUANT: {
+      const int ctx = idx_ & 1;
+      int quant;
+      if (!reader_.ReadByteSymbol(&symbol_prob_[ctx * (MAX_SYMBOLS - 1)],
+                                  &quant)) {
+        return false;
+      }
+      if (ctx == 0) {
+        symbol_ = quant;
+      } else {
+        block_.header.dct.quant[idx_ / 2] = (symbol_ << 8) + quant;
+      }
+      if (++idx_ == 2 * kNumDctBands) {
+        state_ = LAST_NZ;
+      }
+      return true;
+    }
+    case LAST_NZ:
+      if (!reader_.ReadSymbol(kDctLength, &last_nz_prob_[0], &last_nz_)) {
+        return false;
+      }
+      idx_ = last_nz_;
+      num_nzeros_ = 0;
+      state_ = ZERO_FLAG;
+      return true;
+    case ZERO_FLAG: {
+      int is_zero = 0;
+      if (idx_ == 0 || idx_ < last_nz_) {
+        const int is_zero_ctx = ZeronessContext(num_nzeros_, idx_);
+        if (!reader_.ReadAdaptiveBit(&is_zero_prob_[is_zero_ctx], &is_zero)) {
+          return false;
         }
-        context_model.Add(val);
-        block[i] = val;
       }
+      if (is_zero) return NextCoefficient();
+      state_ = SIGN;
+      return true;
     }
-    ringli_blocks->emplace_back(std::move(ringli_block));
+    case SIGN:
+      if (!reader_.ReadAdaptiveBit(&sign_prob_[idx_], &sign_)) return false;
+      state_ = ABSVAL;
+      return true;
+    case ABSVAL: {
+      const int absval_ctx = 2 + ZeroDensityContext(num_nzeros_, idx_);
+      if (!reader_.ReadByteSymbol(&symbol_prob_[absval_ctx * (MAX_SYMBOLS - 1)],
+                                  &symbol_)) {
+        return false;
+      }
+      state_ = EXTRA_BITS;
+      return true;
+    }
+    case EXTRA_BITS: {
+      int absval = symbol_ + 1;
+      if (symbol_ >= NUM_DIRECT_CODES) {
+        const int nbits = symbol_ - NUM_DIRECT_CODES + 1;
+        int extra_bits_val;
+        if (!reader_.ReadBits(nbits, &extra_bits_val)) return false;
+        absval = NUM_DIRECT_CODES - 1 + (1 << nbits) + extra_bits_val;
+      }
+      block_.channels[channel_idx_][sub_block_ * kDctLength + idx_] =
+          (1 - 2 * sign_) * absval;
+      ++num_nzeros_;
+      return NextCoefficient();
+    }
+    default:
+      error_ = true;
+      return false;
   }
-  if (!config.ecparams.arithmetic_only && !ans.CheckCRC()) {
+}
+
+bool StreamingBlockDecoder::NextCoefficient() {
+  if (idx_ > 0) {
+    --idx_;
+    state_ = ZERO_FLAG;
+    return true;
+  }
+  state_ = LAST_NZ;
+  if (++sub_block_ < kDctNumber) return true;
+  sub_block_ = 0;
+  if (++channel_idx_ < num_channels_) return true;
+  idx_ = 0;
+  state_ = QUANT;
+  return BlockDone();
+}
+
+bool StreamingBlockDecoder::BlockDone() {
+  // Reading past the end of the coefficient data is an error, but the block
+  // predictive stream has no explicit length.
+  if (!predictive_ && input_.overrun()) {
+    error_ = true;
     return false;
   }
+  if (!process_block_(opaque_, block_)) {
+    error_ = true;
+    return false;
+  }
+  ++block_idx_;
+  channel_idx_ = 0;
+  if (!predictive_) {
+    for (auto& channel : block_.channels.GetChannels()) {
+      std::fill(channel.begin(), channel.end(), 0);
+    }
+  }
   return true;
 }
 
 IntegerArithmeticDecoder::IntegerArithmeticDecoder(int ndirect, int max_sym,
+                                                   bool gamma, bool wide,
+                                                   bool bypass_bits,
                                                    void* opaque,
                                                    ProcessOutput output_cb)
     : ndirect_absval_(ndirect),
       ndirect_symbols_(2 * ndirect - 1),
       max_symbols_(max_sym),
+      gamma_(gamma),
+      wide_(wide),
+      bypass_bits_(bypass_bits),
+      log_max_symbols_(Log2FloorNonZero(max_sym)),
       opaque_(opaque),
       output_cb_(output_cb),
+      has_low_word_(false),
+      low_word_(0),
       state_(SYMBOL_DECODING),
       val0_(0),
       val1_(max_symbols_),
+      k_(0),
+      node_(0),
       distribution_(nullptr) {}
 
+template <typename ArithmeticDecoder>
+bool IntegerArithmeticDecoder::ReadSymbolBit(ArithmeticDecoder* ac,
+                                             int* symbol) {
+  if (gamma_) {
+    if (node_ == 0) {
+      const int bit = ReadAdaptiveBit(ac, &distribution_[k_]);
+      if (bit) ++k_;
+      if (bit && k_ < log_max_symbols_) return false;
+      node_ = 1;
+    } else {
+      const int bit = ReadAdaptiveBit(
+          ac, &distribution_[GammaBitIndex(log_max_symbols_, k_, node_)]);
+      node_ = 2 * node_ + bit;
+    }
+    if (node_ < (1 << k_)) return false;
+    *symbol = node_ - 1;
+    return true;
+  }
+  const int mid = (val0_ + val1_) >> 1;
+  if (ReadAdaptiveBit(ac, &distribution_[mid - 1])) {
+    val0_ = mid;
+  } else {
+    val1_ = mid;
+  }
+  if (val0_ + 1 < val1_) return false;
+  *symbol = val0_;
+  return true;
+}
+
 bool IntegerArithmeticDecoder::ProcessInput(uint16_t next_word) {
+  if (wide_) {
+    // The 32-bit words arrive as two 16-bit words, the low half first.
+    if (!has_low_word_) {
+      low_word_ = next_word;
+      has_low_word_ = true;
+      return true;
+    }
+    has_low_word_ = false;
+    ac64_.Fill(low_word_ | (static_cast<uint32_t>(next_word) << 16));
+    return DecodeAvailableBits(&ac64_);
+  }
   ac_.Fill(next_word);
-  while (ac_.HasBit()) {
+  return DecodeAvailableBits(&ac_);
+}
+
+bool IntegerArithmeticDecoder::ProcessWords(const uint8_t* data,
+                                            size_t num_words) {
+  size_t i = 0;
+  if (wide_) {
+    if (has_low_word_ && num_words > 0) {
+      if (!ProcessInput(data[0] | (data[1] << 8))) {
+        return false;
+      }
+      i = 1;
+    }
+    for (; i + 2 <= num_words; i += 2) {
+      const uint8_t* p = data + 2 * i;
+      ac64_.Fill(p[0] | (p[1] << 8) | (p[2] << 16) |
+                 (static_cast<uint32_t>(p[3]) << 24));
+      if (!DecodeAvailableBits(&ac64_)) {
+        return false;
+      }
+    }
+    if (i < num_words) {
+      return ProcessInput(data[2 * i] | (data[2 * i + 1] << 8));
+    }
+    return true;
+  }
+  for (; i < num_words; ++i) {
+    ac_.Fill(data[2 * i] | (data[2 * i + 1] << 8));
+    if (!DecodeAvailableBits(&ac_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename ArithmeticDecoder>
+bool IntegerArithmeticDecoder::DecodeAvailableBits(ArithmeticDecoder* ac) {
+  while (ac->HasBit()) {
     if (state_ == SYMBOL_DECODING) {
       if (!distribution_) {
         return false;
       }
-      const int mid = (val0_ + val1_) >> 1;
-      Prob& p = distribution_[mid - 1];
-      const uint8_t prob = p.get_proba();
-      const int bit = ac_.ReadBitNoFill(prob);
-      p.Add(bit);
-      if (bit) {
-        val0_ = mid;
-      } else {
-        val1_ = mid;
-      }
-      if (val0_ + 1 == val1_) {
-        if (val0_ < ndirect_symbols_) {
-          if (!Output(ConvertToSigned(val0_))) {
+      int symbol;
+      if (ReadSymbolBit(ac, &symbol)) {
+        if (symbol < ndirect_symbols_) {
+          if (!Output(ConvertToSigned(symbol))) {
             return false;
           }
         } else {
-          val0_ -= ndirect_symbols_;
-          sign_ = 1 - 2 * (val0_ & 1);
-          val0_ >>= 1;
-          msb_ = val0_ & 1;
-          nbits_ = val0_ >> 1;
+          symbol -= ndirect_symbols_;
+          sign_ = 1 - 2 * (symbol & 1);
+          symbol >>= 1;
+          msb_ = symbol & 1;
+          nbits_ = symbol >> 1;
           if (nbits_ == 0) {
             if (!Output(sign_ * (ndirect_absval_ + msb_))) {
               return false;
@@ -373,8 +824,11 @@ bool IntegerArithmeticDecoder::ProcessInput(uint16_t next_word) {
         }
       }
     } else if (state_ == EXTRA_BITS_DECODING) {
-      extra_bits_val_ += ac_.ReadBitNoFill(128) << bitpos_;
-      ++bitpos_;
+      uint32_t bits;
+      const int n =
+          ac->ReadExtraBitsNoFill(bypass_bits_, nbits_ - bitpos_, &bits);
+      extra_bits_val_ += bits << bitpos_;
+      bitpos_ += n;
       if (bitpos_ == nbits_) {
         const int absval =
             ndirect_absval_ - 2 + ((2 + msb_) << nbits_) + extra_bits_val_;
@@ -391,49 +845,147 @@ bool IntegerArithmeticDecoder::Output(int value) {
   state_ = SYMBOL_DECODING;
   val0_ = 0;
   val1_ = max_symbols_;
+  k_ = 0;
+  node_ = 0;
+  return output_cb_(opaque_, value);
+}
+
+IntegerRangeDecoder::IntegerRangeDecoder(int ndirect, void* opaque,
+                                         ProcessOutput output_cb)
+    : ndirect_absval_(ndirect),
+      ndirect_symbols_(2 * ndirect - 1),
+      opaque_(opaque),
+      output_cb_(output_cb),
+      state_(SYMBOL_DECODING),
+      distribution_(nullptr) {}
+
+bool IntegerRangeDecoder::ProcessWords(const uint8_t* data,
+                                       size_t num_words) {
+  for (size_t i = 0; i < num_words; ++i) {
+    if (!ProcessInput(data[2 * i] | (data[2 * i + 1] << 8))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IntegerRangeDecoder::ProcessInput(uint16_t next_word) {
+  rc_.Fill(next_word);
+  while (!rc_.NeedsWord()) {
+    if (state_ == SYMBOL_DECODING) {
+      if (!distribution_) {
+        return false;
+      }
+      int symbol = rc_.ReadSymbolNoFill(distribution_);
+      if (symbol < ndirect_symbols_) {
+        if (!Output(ConvertToSigned(symbol))) {
+          return false;
+        }
+      } else {
+        symbol -= ndirect_symbols_;
+        sign_ = 1 - 2 * (symbol & 1);
+        symbol >>= 1;
+        msb_ = symbol & 1;
+        nbits_ = symbol >> 1;
+        if (nbits_ == 0) {
+          if (!Output(sign_ * (ndirect_absval_ + msb_))) {
+            return false;
+          }
+        } else {
+          bitpos_ = 0;
+          extra_bits_val_ = 0;
+          state_ = EXTRA_BITS_DECODING;
+        }
+      }
+    } else if (state_ == EXTRA_BITS_DECODING) {
+      const int n = std::min(16, nbits_ - bitpos_);
+      extra_bits_val_ += rc_.ReadBitsNoFill(n) << bitpos_;
+      bitpos_ += n;
+      if (bitpos_ == nbits_) {
+        const int absval =
+            ndirect_absval_ - 2 + ((2 + msb_) << nbits_) + extra_bits_val_;
+        if (!Output(sign_ * absval)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool IntegerRangeDecoder::Output(int value) {
+  state_ = SYMBOL_DECODING;
   return output_cb_(opaque_, value);
 }
 
-EntropyDecoder::EntropyDecoder(size_t num_channels, void* opaque,
-                               ProcessSamples process_samples)
+EntropyDecoder::EntropyDecoder(size_t num_channels, size_t num_samples,
+                               const EntropyCodingParams& ecparams,
+                               void* opaque, ProcessSamples process_samples)
     : num_channels_(num_channels),
       opaque_(opaque),
       process_samples_(process_samples),
-      int_decoder_(kPredNumDirectAbsval, MAX_SYMBOLS, this, ProcessOutputCb),
+      range_coding_(ecparams.range_coding),
+      int_decoder_(kPredNumDirectAbsval, MAX_SYMBOLS, ecparams.gamma_symbols,
+                   ecparams.wide_arithmetic_coding, ecparams.bypass_bits, this,
+                   ProcessOutputCb),
+      range_decoder_(kPredNumDirectAbsval, this, ProcessOutputCb),
       context_model_(num_channels_),
-      next_word_(0),
-      input_shift_(0),
-      samples_(num_channels),
+      has_low_byte_(false),
+      low_byte_(0),
+      samples_(kMaxBatchTicks * num_channels),
+      sample_pos_(0),
       channel_idx_(0),
-      idx_(0) {
-  symbol_prob_.resize(context_model_[0].NumContexts() * (MAX_SYMBOLS - 1));
+      idx_(0),
+      num_remaining_samples_(num_samples) {
+  if (range_coding_) {
+    symbol_dist_.resize(context_model_[0].NumContexts());
+  } else {
+    symbol_prob_.resize(context_model_[0].NumContexts() * (MAX_SYMBOLS - 1));
+  }
   SetContext();
 }
 
 bool EntropyDecoder::ProcessInput(const uint8_t* data, size_t len) {
-  for (size_t i = 0; i < len; ++i) {
-    next_word_ |= data[i] << input_shift_;
-    input_shift_ += 8;
-    if (input_shift_ == 16) {
-      if (!int_decoder_.ProcessInput(next_word_)) {
-        return false;
-      }
-      input_shift_ = 0;
-      next_word_ = 0;
+  if (len == 0) {
+    return true;
+  }
+  if (has_low_byte_) {
+    const uint8_t word[2] = {low_byte_, data[0]};
+    has_low_byte_ = false;
+    ++data;
+    --len;
+    if (!ProcessWords(word, 1)) {
+      return false;
     }
   }
-  return true;
+  if (!ProcessWords(data, len / 2)) {
+    return false;
+  }
+  if (len & 1) {
+    has_low_byte_ = true;
+    low_byte_ = data[len - 1];
+  }
+  return FlushSamples();
+}
+
+bool EntropyDecoder::ProcessWords(const uint8_t* data, size_t num_words) {
+  return range_coding_ ? range_decoder_.ProcessWords(data, num_words)
+                       : int_decoder_.ProcessWords(data, num_words);
 }
 
 bool EntropyDecoder::ProcessOutput(int value) {
-  samples_[channel_idx_] = value;
+  if (num_remaining_samples_ == 0) {
+    return true;
+  }
+  samples_[sample_pos_++] = value;
   context_model_[channel_idx_].Add(value);
   ++channel_idx_;
   if (channel_idx_ == num_channels_) {
     channel_idx_ = 0;
-    if (!process_samples_(opaque_, samples_.data())) {
+    if (sample_pos_ == samples_.size() && !FlushSamples()) {
       return false;
     }
+    --num_remaining_samples_;
     ++idx_;
     if (idx_ == kRingliBlockSize) {
       idx_ = 0;
@@ -446,9 +998,29 @@ bool EntropyDecoder::ProcessOutput(int value) {
   return true;
 }
 
+bool EntropyDecoder::FlushSamples() {
+  const size_t num_ticks = sample_pos_ / num_channels_;
+  if (num_ticks == 0) {
+    return true;
+  }
+  if (!process_samples_(opaque_, samples_.data(), num_ticks)) {
+    return false;
+  }
+  // Keeps the samples of the incomplete time slot.
+  const size_t num_complete = num_ticks * num_channels_;
+  std::copy(samples_.begin() + num_complete, samples_.begin() + sample_pos_,
+            samples_.begin());
+  sample_pos_ -= num_complete;
+  return true;
+}
+
 void EntropyDecoder::SetContext() {
   const int ctx = context_model_[channel_idx_].Context();
-  int_decoder_.set_distribution(&symbol_prob_[ctx * (MAX_SYMBOLS - 1)]);
+  if (range_coding_) {
+    range_decoder_.set_distribution(&symbol_dist_[ctx]);
+  } else {
+    int_decoder_.set_distribution(&symbol_prob_[ctx * (MAX_SYMBOLS - 1)]);
+  }
 }
 
 }  // namespace ringli
@@ -16,6 +16,7 @@
 #define DECODE_ENTROPY_DECODE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <vector>
 
@@ -24,7 +25,12 @@
 #include "common/distributions.h"
 #include "common/entropy_coding.h"
 #include "common/ringli_header.h"
+#include "common/thread_pool.h"
+#include "decode/ans_decode.h"
 #include "decode/arith_decode.h"
+#include "decode/range_decode.h"
+#include "decode/ringli_input.h"
+#include "decode/symbol_reader.h"
 
 namespace ringli {
 
@@ -32,25 +38,58 @@ class IntegerArithmeticDecoder {
  public:
   typedef bool (*ProcessOutput)(void* opaque, int val);
 
-  IntegerArithmeticDecoder(int ndirect, int max_sym, void* opaque,
+  // If gamma is set, the symbols use the gamma binarization, see
+  // GammaBitIndex(), and max_sym must be a power of two. If wide is set, the
+  // data is that of BinaryArithmeticEncoder64. If bypass_bits is set, the
+  // extra bits are coded with AddBits(), otherwise one by one.
+  IntegerArithmeticDecoder(int ndirect, int max_sym, bool gamma, bool wide,
+                           bool bypass_bits, void* opaque,
                            ProcessOutput output_cb);
 
   void set_distribution(Prob* p) { distribution_ = p; }
 
   bool ProcessInput(uint16_t next_word);
+  // Same as ProcessInput() on each of the num_words little endian 16-bit words
+  // at data, with one arithmetic decoder fill per word or 32-bit word.
+  bool ProcessWords(const uint8_t* data, size_t num_words);
 
  private:
+  // Decodes the values until ac needs the next word.
+  template <typename ArithmeticDecoder>
+  bool DecodeAvailableBits(ArithmeticDecoder* ac);
+  // Reads the next binary decision of the current symbol, returns true and
+  // sets *symbol if it was the last one.
+  template <typename ArithmeticDecoder>
+  bool ReadSymbolBit(ArithmeticDecoder* ac, int* symbol);
+  template <typename ArithmeticDecoder>
+  static int ReadAdaptiveBit(ArithmeticDecoder* ac, Prob* p) {
+    const int bit = ac->ReadBitNoFill(p->get_proba());
+    p->Add(bit);
+    return bit;
+  }
   bool Output(int value);
 
   const int ndirect_absval_;
   const int ndirect_symbols_;
   const int max_symbols_;
+  const bool gamma_;
+  const bool wide_;
+  const bool bypass_bits_;
+  const int log_max_symbols_;
   void* const opaque_;
   ProcessOutput const output_cb_;
   BinaryArithmeticDecoder ac_;
+  BinaryArithmeticDecoder64 ac64_;
+  // The first half of the next 32-bit word of ac64_.
+  bool has_low_word_;
+  uint16_t low_word_;
   enum { SYMBOL_DECODING, EXTRA_BITS_DECODING } state_;
   int val0_;
   int val1_;
+  // Number of unary one bits and the node of the bits read after them, zero
+  // while reading the unary part, of the gamma binarization.
+  int k_;
+  int node_;
   int sign_;
   int msb_;
   int nbits_;
@@ -59,42 +98,210 @@ class IntegerArithmeticDecoder {
   Prob* distribution_;
 };
 
+// Decodes the range coded values of the fully streaming mode, see
+// EntropyCodingParams::range_coding, in the same way as
+// IntegerArithmeticDecoder does the binary arithmetic coded ones.
+class IntegerRangeDecoder {
+ public:
+  typedef bool (*ProcessOutput)(void* opaque, int val);
+
+  IntegerRangeDecoder(int ndirect, void* opaque, ProcessOutput output_cb);
+
+  void set_distribution(AdaptiveDistribution* d) { distribution_ = d; }
+
+  bool ProcessInput(uint16_t next_word);
+  // Same as ProcessInput() on each of the num_words little endian 16-bit words
+  // at data.
+  bool ProcessWords(const uint8_t* data, size_t num_words);
+
+ private:
+  bool Output(int value);
+
+  const int ndirect_absval_;
+  const int ndirect_symbols_;
+  void* const opaque_;
+  ProcessOutput const output_cb_;
+  RangeDecoder rc_;
+  enum { SYMBOL_DECODING, EXTRA_BITS_DECODING } state_;
+  int sign_;
+  int msb_;
+  int nbits_;
+  int bitpos_;
+  int extra_bits_val_;
+  AdaptiveDistribution* distribution_;
+};
+
+// Decodes the fully streaming mode. The decoded samples are collected and
+// passed to the callback in batches of whole time slots, at the latest at the
+// end of each ProcessInput() call, so the output only depends on the input
+// that has arrived and not on how it was split.
 class EntropyDecoder {
  public:
-  typedef bool (*ProcessSamples)(void* opaque, const int* samples);
-  EntropyDecoder(size_t num_channels, void* opaque,
+  // samples has num_channels interleaved values for each of the num_ticks time
+  // slots.
+  typedef bool (*ProcessSamples)(void* opaque, const int* samples,
+                                 size_t num_ticks);
+  // The values that the entropy decoder reads from the end of the data after
+  // the num_samples samples of each channel are ignored.
+  EntropyDecoder(size_t num_channels, size_t num_samples,
+                 const EntropyCodingParams& ecparams, void* opaque,
                  ProcessSamples process_samples);
 
   bool ProcessInput(const uint8_t* data, size_t len);
 
  private:
+  static constexpr size_t kMaxBatchTicks = 256;
+
+  bool ProcessWords(const uint8_t* data, size_t num_words);
   bool ProcessOutput(int value);
   static bool ProcessOutputCb(void* opaque, int value) {
     return reinterpret_cast<EntropyDecoder*>(opaque)->ProcessOutput(value);
   }
+  // Passes the complete time slots of samples_ to the callback.
+  bool FlushSamples();
   void SetContext();
 
   const size_t num_channels_;
   void* const opaque_;
   ProcessSamples const process_samples_;
+  const bool range_coding_;
   IntegerArithmeticDecoder int_decoder_;
+  IntegerRangeDecoder range_decoder_;
   std::vector<PredictiveContextModel> context_model_;
   std::vector<Prob> symbol_prob_;
-  uint16_t next_word_;
-  int input_shift_;
+  std::vector<AdaptiveDistribution> symbol_dist_;
+  // The first byte of the next word if the input so far had an odd length.
+  bool has_low_byte_;
+  uint8_t low_byte_;
+  // Samples of up to kMaxBatchTicks time slots, and the position of the next
+  // one.
   std::vector<int> samples_;
+  size_t sample_pos_;
   size_t channel_idx_;
   size_t idx_;
+  size_t num_remaining_samples_;
 };
 
+// Decodes the arithmetic-only block streams, i.e. the block predictive mode
+// and the DCT coefficients, while the input arrives, and passes each block to
+// the callback as soon as all of its symbols are decoded. The symbols are read
+// with the same SymbolReader as the whole stream decoders use, which stops at
+// the first read of a word that has not arrived yet, so decoding continues
+// from there on the next ProcessInput() call.
+class StreamingBlockDecoder {
+ public:
+  typedef bool (*ProcessBlock)(void* opaque, const RingliBlock& block);
+  StreamingBlockDecoder(const RingliDecoderConfig& config, size_t num_channels,
+                        size_t num_blocks, void* opaque,
+                        ProcessBlock process_block);
+  // The readers point to input_.
+  StreamingBlockDecoder(const StreamingBlockDecoder&) = delete;
+  StreamingBlockDecoder& operator=(const StreamingBlockDecoder&) = delete;
+
+  bool ProcessInput(const uint8_t* data, size_t len);
+
+  // Decodes the remaining blocks with the words past the end of the stream
+  // read as zero, and returns true if all blocks were decoded.
+  bool Flush();
+
+ private:
+  bool Decode();
+  bool DecodePredictive();
+  bool DecodeCoefficients();
+  bool NextCoefficient();
+  bool BlockDone();
+
+  // The reads of the predictive mode, with the wide arithmetic decoder if
+  // wide_ is set.
+  bool InitArithmeticDecoder() {
+    return wide_ ? reader64_.InitArithmeticDecoder()
+                 : reader_.InitArithmeticDecoder();
+  }
+  bool ReadByteSymbol(Prob* p, int* symbol) {
+    return wide_ ? reader64_.ReadByteSymbol(p, symbol)
+                 : reader_.ReadByteSymbol(p, symbol);
+  }
+  bool ReadValue(int symbol, int ndirect, int* value) {
+    return wide_ ? reader64_.ReadValue(symbol, ndirect, false, value)
+                 : reader_.ReadValue(symbol, ndirect, false, value);
+  }
+
+  const bool predictive_;
+  const bool wide_;
+  const size_t num_channels_;
+  const size_t num_blocks_;
+  void* const opaque_;
+  ProcessBlock const process_block_;
+  StreamingInput input_;
+  SymbolReader<BinaryArithmeticDecoder, StreamingInput> reader_;
+  SymbolReader<BinaryArithmeticDecoder64, StreamingInput> reader64_;
+  bool error_;
+  PredictiveContextModel context_model_;
+  std::vector<Prob> last_nz_prob_;
+  std::vector<Prob> is_zero_prob_;
+  std::vector<Prob> sign_prob_;
+  std::vector<Prob> symbol_prob_;
+  RingliBlock block_;
+  size_t block_idx_;
+  enum {
+    DATA_LENGTH,
+    INIT,
+    QUANT,
+    LAST_NZ,
+    ZERO_FLAG,
+    SIGN,
+    ABSVAL,
+    EXTRA_BITS,
+    ORDER,
+    LSF_SYMBOL,
+    LSF_VALUE,
+    RESIDUAL_SYMBOL,
+    RESIDUAL_VALUE
+  } state_;
+  // Length of the coefficient data and the shift of its next base-128 digit.
+  size_t data_length_;
+  int shift_;
+  size_t channel_idx_;
+  int idx_;
+  int sub_block_;
+  int last_nz_;
+  int num_nzeros_;
+  int sign_;
+  int symbol_;
+};
+
+// Context map and entropy codes of the ANS coded data. A segment of a
+// segmented stream can reuse the ones of the previous segment.
+struct ANSEntropyCodes {
+  std::vector<uint8_t> context_map;
+  std::vector<ANSDecodingData> entropy_codes;
+};
+
+// Returns true if data starts with a complete segment of a segmented stream,
+// and sets *segment_size to its size in bytes.
+bool FindSegmentSize(const uint8_t* data, size_t len,
+                     const RingliDecoderConfig& config, size_t num_channels,
+                     size_t* segment_size);
+
+// Reads the seek table at the end of the complete segmented stream in data,
+// sets *offsets to the byte offsets of the seek points, and *table_start to
+// the byte offset of the seek table, i.e. the end of the last segment.
+bool ReadSeekTable(const uint8_t* data, size_t len,
+                   std::vector<size_t>* offsets, size_t* table_start);
+
+// Appends the num_blocks decoded blocks to ringli_blocks. If pool is not
+// null, the channel substreams are decoded on it.
 bool DecompressPredictiveRingliBlocks(const char* input, size_t input_size,
                                       size_t num_channels, size_t num_blocks,
                                       const RingliDecoderConfig& config,
-                                      std::vector<RingliBlock>* ringli_blocks);
+                                      ANSEntropyCodes* codes,
+                                      std::vector<RingliBlock>* ringli_blocks,
+                                      ThreadPool* pool = nullptr);
 
 bool DecompressCoefficients(const char* input, size_t input_size,
                             size_t num_channels, size_t num_blocks,
                             const RingliDecoderConfig& config,
+                            ANSEntropyCodes* codes,
                             std::vector<RingliBlock>* ringli_blocks);
 
 }  // namespace ringli
@@ -0,0 +1,91 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef DECODE_RANGE_DECODE_H_
+#define DECODE_RANGE_DECODE_H_
+
+#include <stdint.h>
+
+#include "common/distributions.h"
+
+namespace ringli {
+
+// Decoder of the multi-symbol range coded data of RangeEncoder. The 16-bit
+// words of the data are passed to Fill() while NeedsWord() returns true, and
+// the symbols can be read while it returns false.
+class RangeDecoder {
+ public:
+  RangeDecoder() : low_(0), high_(0), value_(0), step_(0) {}
+
+  // Cuts a short interval down as the encoder does, and returns true if the
+  // next word of the data is needed before the next symbol can be read.
+  bool NeedsWord() {
+    if (((low_ ^ high_) >> 48) != 0 && high_ - low_ < kMinRange) {
+      high_ = (high_ & ~((1ull << 48) - 1)) - 1;
+    }
+    return ((low_ ^ high_) >> 48) == 0;
+  }
+
+  void Fill(uint16_t next_word) {
+    value_ = (value_ << 16) | next_word;
+    low_ <<= 16;
+    high_ = (high_ << 16) | 0xffff;
+  }
+
+  // Reads a symbol of the adaptive distribution and adds it to the
+  // distribution. Can be called only when NeedsWord() returns false.
+  int ReadSymbolNoFill(AdaptiveDistribution* distribution) {
+    const uint32_t total = distribution->total();
+    const int symbol = distribution->FindSymbol(GetValue(total));
+    uint32_t start, size;
+    distribution->GetInterval(symbol, &start, &size);
+    distribution->Add(symbol);
+    Consume(start, size);
+    return symbol;
+  }
+
+  // Reads at most 16 bits coded with equal probabilities. Can be called only
+  // when NeedsWord() returns false.
+  uint32_t ReadBitsNoFill(int nbits) {
+    const uint32_t bits = GetValue(1u << nbits);
+    Consume(bits, 1);
+    return bits;
+  }
+
+ private:
+  static constexpr uint64_t kMinRange = 1ull << 32;
+
+  // Returns the value in [0, total) that the data points to.
+  uint32_t GetValue(uint32_t total) {
+    step_ = (high_ - low_) / total;
+    const uint64_t value = (value_ - low_) / step_;
+    // Only corrupted data can point past the last symbol.
+    return value < total ? value : total - 1;
+  }
+
+  void Consume(uint32_t start, uint32_t size) {
+    high_ = low_ + step_ * (start + size) - 1;
+    low_ += step_ * start;
+  }
+
+  uint64_t low_;
+  uint64_t high_;
+  uint64_t value_;
+  uint64_t step_;
+};
+
+}  // namespace ringli
+
+#endif  // DECODE_RANGE_DECODE_H_
@@ -25,11 +25,13 @@
 #include <cstdlib>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/log/check.h"
+#include "common/ac_prediction.h"
+#include "common/ans_params.h"
 #include "common/block_predictor.h"
-#include "common/convolve.h"
 #include "common/data_defs/constants.h"
 #include "common/data_defs/data_vector.h"
 #include "common/dct.h"
@@ -45,47 +47,54 @@
 namespace ringli {
 namespace {
 
-std::unique_ptr<Predictor> GetPredictor(const RingliDecoderConfig& config,
-                                        const RingliPredictiveHeader& header) {
-  if (config.use_online_predictive_coding) {
-    const bool fast_mode = config.predictor_fast_mode();
-    if (fast_mode) {
-      return std::make_unique<FastOnlinePredictor>();
-    } else {
-      return std::make_unique<OnlinePredictor>(kOnlinePredictorRegulariser);
-    }
-  } else {
-    return BlockPredictor<kRingliBlockSize>::CreateForDecoder(&header);
+template <typename PredictorType>
+void DecodePredictiveChannel(const RingliDecoderConfig& config,
+                             const RingliVector& residuals,
+                             PredictorType* predictor, RingliVector* output) {
+  const int quant = config.pred_quant;
+  for (int i = 0; i < kRingliBlockSize; i++) {
+    float prediction = predictor->Predict();
+    if (quant == 1) prediction = std::round(prediction);
+    const float residual = quant * residuals[i];
+    const float sample_deq = prediction + residual;
+    predictor->AddNewSample(sample_deq);
+    (*output)[i] = std::round(sample_deq);
   }
 }
 
-AudioBlock DecodePredictive(const RingliDecoderConfig& config,
-                            const RingliBlock& encoded_block) {
+// The online predictors of legacy streams round as in the original format.
+void DecodePredictive(const RingliDecoderConfig& config, bool legacy_stream,
+                      const RingliBlock& encoded_block,
+                      AudioBlock* decoded_block) {
+  if (!config.use_online_predictive_coding) {
+    DecodeBlockPredictive(encoded_block, config.pred_quant, decoded_block);
+    return;
+  }
   const size_t num_channels = encoded_block.channels.GetChannels().size();
-  AudioBlock decoded_block(num_channels);
   for (size_t c = 0; c < num_channels; ++c) {
-    const RingliPredictiveHeader& header = encoded_block.header.pred[c];
-    const int quant = config.pred_quant;
-    std::unique_ptr<Predictor> predictor = GetPredictor(config, header);
-    for (int i = 0; i < kRingliBlockSize; i++) {
-      float prediction = predictor->Predict();
-      if (quant == 1) prediction = std::round(prediction);
-      const float residual = quant * encoded_block.channels[c][i];
-      const float sample_deq = prediction + residual;
-      predictor->AddNewSample(sample_deq);
-      decoded_block[c][i] = std::round(sample_deq);
+    const RingliVector& residuals = encoded_block.channels[c];
+    RingliVector* output = &(*decoded_block)[c];
+    if (config.predictor_fast_mode()) {
+      FastOnlinePredictor predictor;
+      DecodePredictiveChannel(config, residuals, &predictor, output);
+    } else if (legacy_stream) {
+      LegacyOnlinePredictor predictor(kOnlinePredictorRegulariser);
+      DecodePredictiveChannel(config, residuals, &predictor, output);
+    } else {
+      OnlinePredictor predictor(kOnlinePredictorRegulariser);
+      DecodePredictiveChannel(config, residuals, &predictor, output);
     }
   }
-  return decoded_block;
 }
 
-AudioBlock DecodeWithDCT(const RingliDecoderConfig& config,
-                         const DCT<kDctLength>& dct, const RingliBlock& prev,
-                         const RingliBlock& current, const RingliBlock& next) {
+void DecodeWithDCT(const RingliDecoderConfig& config,
+                   const DCT<kDctLength>& dct, const RingliBlock& prev,
+                   const RingliBlock& current, const RingliBlock& next,
+                   AudioBlock* decoded_result) {
   const size_t num_channels = current.channels.GetChannels().size();
-  AudioBlock decoded_result(num_channels);
+  const ACPredictionOperator& ac_prediction = GetACPredictionOperator();
   for (size_t c = 0; c < num_channels; ++c) {
-    DataVector<double, kACPredictionWindowSize> coeff_window;
+    ACPredictionWindow coeff_window;
     for (int i = 0; i < kACPredictionWindowSize; ++i) {
       const int k = i % kDctLength;
       if (i < kACPredictionBorder) {
@@ -101,74 +110,71 @@ AudioBlock DecodeWithDCT(const RingliDecoderConfig& config,
             next.header.dct.GetQuantizationCoef(k);
       }
     }
-    DataVector<double, kACPredictionWindowSize> output_window;
-    for (int step = 0; step <= kNumACPredictionSteps; ++step) {
-      int k_limit = step == kNumACPredictionSteps ? kDctLength
-                                                  : kACPredictionStart << step;
-      for (int i = 0; i < kACPredictionWindowSize; i += kDctLength) {
-        DataVector<double, kDctLength> dct_data;
-        for (int k = 0; k < k_limit; ++k) {
-          dct_data[k] = coeff_window[i + k];
-        }
-        const DataVector<double, kDctLength> signal_data =
-            dct.ApplyInverseDCT(dct_data);
-        for (int k = 0; k < kDctLength; ++k) {
-          output_window[i + k] = signal_data[k];
-        }
-      }
-      if (step == kNumACPredictionSteps) {
-        break;
-      }
-      output_window =
-          Convolve(GaussianKernel<kDctLength>(kACPredictionSigma / k_limit),
-                   output_window);
+    ACPredictionWindow prediction;
+    for (int step = 0; step < kNumACPredictionSteps; ++step) {
+      const int k_limit = kACPredictionStart << step;
+      ac_prediction.Apply(step, coeff_window, &prediction);
       for (int i = 0; i < kACPredictionWindowSize; i += kDctLength) {
-        DataVector<double, kDctLength> signal_data;
-        for (int k = 0; k < kDctLength; ++k) {
-          signal_data[k] = output_window[i + k];
-        }
-        DataVector<double, kDctLength> dct_data =
-            dct.ApplyDirectDCT(signal_data);
         for (int k = k_limit; k < 2 * k_limit; ++k) {
-          coeff_window[i + k] += dct_data[k];
+          coeff_window[i + k] += prediction[i + k];
         }
       }
     }
-    for (int i = 0; i < kRingliBlockSize; i++) {
-      decoded_result[c][i] = std::round(output_window[i + kACPredictionBorder]);
+    // Only the sub-blocks of the current block need the inverse transform.
+    for (int i = 0; i < kRingliBlockSize; i += kDctLength) {
+      DataVector<double, kDctLength> dct_data(
+          &coeff_window[kACPredictionBorder + i]);
+      const DataVector<double, kDctLength> signal_data = dct.ApplyInverseDCT(
+          dct_data, DCT<kDctLength>::NumCoefficients(dct_data));
+      for (int k = 0; k < kDctLength; ++k) {
+        (*decoded_result)[c][i + k] = std::round(signal_data[k]);
+      }
     }
   }
-  return decoded_result;
 }
 
 }  // namespace
 
 void StreamingRingliDecoder::Reset() {
+  entropy_decoder_.reset();
+  predictor_.reset();
+  block_decoder_.reset();
   ringli_data_.clear();
   wav_data_.clear();
   idx_ = 0;
   samples_written_ = 0;
   num_blocks_ = 0;
+  num_decoded_blocks_ = 0;
+  total_blocks_ = 0;
+  decode_segments_ = false;
+  header_size_ = 0;
+  legacy_stream_ = false;
   input_pos_ = 0;
   output_pos_ = 0;
 }
 
 bool StreamingRingliDecoder::ProcessInput(const uint8_t* data, size_t len) {
-  const size_t header_size = sizeof(RingliHeader);
-  if (input_pos_ == 0 && len >= header_size) {
-    if (!ProcessHeader(data, header_size)) {
+  if (input_pos_ == 0 && len > 0) {
+    // The first input has to contain the complete header.
+    if (!ProcessHeader(data, len)) {
       return false;
     }
-    input_pos_ = header_size;
-    data += header_size;
-    len -= header_size;
+    input_pos_ = header_size_;
+    data += header_size_;
+    len -= header_size_;
   }
-  if (input_pos_ >= header_size && len > 0) {
-    if (ringli_header_.config.use_online_predictive_coding &&
-        ringli_header_.config.ecparams.arithmetic_only) {
+  if (input_pos_ >= header_size_ && len > 0) {
+    if (entropy_decoder_) {
       entropy_decoder_->ProcessInput(data, len);
+    } else if (block_decoder_) {
+      if (!block_decoder_->ProcessInput(data, len)) {
+        return false;
+      }
     } else {
       ringli_data_.append(reinterpret_cast<const char*>(data), len);
+      if (decode_segments_ && !DecodeSegments()) {
+        return false;
+      }
     }
     input_pos_ += len;
   }
@@ -176,19 +182,121 @@ bool StreamingRingliDecoder::ProcessInput(const uint8_t* data, size_t len) {
 }
 
 bool StreamingRingliDecoder::ProcessHeader(const uint8_t* data, size_t len) {
-  CHECK_EQ(len, sizeof(ringli_header_));
-  memcpy(&ringli_header_, data, len);
-  if (memcmp(ringli_header_.ringli_id, kRingliId, sizeof(kRingliId)) != 0) {
+  if (len >= sizeof(kRingliLegacyId) &&
+      memcmp(data, kRingliLegacyId, sizeof(kRingliLegacyId)) == 0) {
+    RingliLegacyHeader legacy_header;
+    if (len < sizeof(legacy_header)) {
+      fprintf(stderr, "Truncated ringli header\n");
+      return false;
+    }
+    memcpy(&legacy_header, data, sizeof(legacy_header));
+    ringli_header_ = RingliHeader();
+    memcpy(ringli_header_.ringli_id, kRingliLegacyId, sizeof(kRingliLegacyId));
+    ringli_header_.header_length = legacy_header.header_length;
+    ringli_header_.number_of_channels = legacy_header.number_of_channels;
+    ringli_header_.sampling_frequency = legacy_header.sampling_frequency;
+    ringli_header_.bits_per_sample = legacy_header.bits_per_sample;
+    ringli_header_.data_length = legacy_header.data_length;
+    RingliDecoderConfig& config = ringli_header_.config;
+    config.ecparams.arithmetic_only = legacy_header.arithmetic_only;
+    config.use_predictive_coding = legacy_header.use_predictive_coding;
+    config.use_online_predictive_coding =
+        legacy_header.use_online_predictive_coding;
+    config.pred_quant = legacy_header.pred_quant;
+    config.effort = legacy_header.effort;
+    config.use_noise_filter = legacy_header.use_noise_filter;
+    config.use_adaptive_quantization = legacy_header.use_adaptive_quantization;
+    header_size_ = sizeof(legacy_header);
+    legacy_stream_ = true;
+  } else if (len >= sizeof(kRingliId) &&
+             memcmp(data, kRingliId, sizeof(kRingliId)) == 0) {
+    if (len < sizeof(ringli_header_)) {
+      fprintf(stderr, "Truncated ringli header\n");
+      return false;
+    }
+    memcpy(&ringli_header_, data, sizeof(ringli_header_));
+    header_size_ = sizeof(ringli_header_);
+    legacy_stream_ = false;
+  } else {
     fprintf(stderr, "Unsupported ringli stream version\n");
     return false;
   }
+  const size_t num_ans_states = ringli_header_.config.ecparams.NumANSStates();
+  if (num_ans_states > kMaxANSStates ||
+      (num_ans_states & (num_ans_states - 1)) != 0) {
+    fprintf(stderr, "Invalid number of ANS states\n");
+    return false;
+  }
   const size_t num_channels = ringli_header_.number_of_channels;
   const size_t bytes_per_sample = ringli_header_.bits_per_sample / 8;
+  WriteHeader(ringli_header_.data_length);
+  const bool arithmetic_only = ringli_header_.config.ecparams.arithmetic_only;
+  decode_segments_ = ringli_header_.config.segmented();
+  if (!arithmetic_only && !decode_segments_) {
+    // The whole stream is decoded in Flush().
+    wav_data_.reserve(wav_data_.size() + ringli_header_.data_length);
+  }
+  const size_t block_size = kRingliBlockSize * bytes_per_sample * num_channels;
+  total_blocks_ = (ringli_header_.data_length + block_size - 1) / block_size;
+  if (!ringli_header_.config.use_predictive_coding) {
+    dct_ = std::make_unique<DCT<kDctLength>>();
+    prev_ = std::make_unique<RingliBlock>(num_channels);
+    current_ = std::make_unique<RingliBlock>(num_channels);
+    next_ = std::make_unique<RingliBlock>(num_channels);
+    decoded_block_ = std::make_unique<AudioBlock>(num_channels);
+  } else if (arithmetic_only &&
+             ringli_header_.config.use_online_predictive_coding) {
+    entropy_decoder_ = std::make_unique<EntropyDecoder>(
+        num_channels,
+        ringli_header_.data_length / (bytes_per_sample * num_channels),
+        ringli_header_.config.ecparams, this, ProcessSamplesCb);
+    decoded_samples_.resize(num_channels);
+    if (ringli_header_.config.predictor_fast_mode() && !legacy_stream_) {
+      predictor_ = std::make_unique<FastOnlinePredictorBank>(num_channels);
+    } else {
+      // The predictors of legacy streams round as in the original format.
+      std::vector<std::unique_ptr<Predictor>> predictors;
+      for (int i = 0; i < num_channels; ++i) {
+        if (ringli_header_.config.predictor_fast_mode()) {
+          predictors.emplace_back(std::make_unique<FastOnlinePredictor>());
+        } else if (legacy_stream_) {
+          predictors.emplace_back(std::make_unique<LegacyOnlinePredictor>(
+              kOnlinePredictorRegulariser));
+        } else {
+          predictors.emplace_back(
+              std::make_unique<OnlinePredictor>(kOnlinePredictorRegulariser));
+        }
+      }
+      predictor_ = std::make_unique<PerChannelPredictor>(std::move(predictors));
+    }
+    predictions_.resize(num_channels);
+    dequantized_samples_.resize(num_channels);
+
+    noise_filters_.resize(num_channels);
+    adaptive_quantizers_.resize(num_channels);
+    for (size_t c = 0; c < num_channels; ++c) {
+      noise_filters_[c].Reset();
+      adaptive_quantizers_[c].Reset();
+    }
+  } else {
+    decoded_block_ = std::make_unique<AudioBlock>(num_channels);
+  }
+  if (arithmetic_only && !entropy_decoder_ && !decode_segments_) {
+    block_decoder_ = std::make_unique<StreamingBlockDecoder>(
+        ringli_header_.config, num_channels, total_blocks_, this,
+        ProcessBlockCb);
+  }
+  remaining_samples_ = ringli_header_.data_length / bytes_per_sample;
+  return true;
+}
+
+void StreamingRingliDecoder::WriteHeader(uint32_t data_length) {
+  const size_t num_channels = ringli_header_.number_of_channels;
   // Generate wav header based on ringli header.
   WavHeader wav_header;
   // RIFF chunk
   memcpy(wav_header.riff_chunk.riff_chunk_id, "RIFF", 4);
-  wav_header.riff_chunk.riff_chunk_size = ringli_header_.data_length + 36;
+  wav_header.riff_chunk.riff_chunk_size = data_length + 36;
   memcpy(wav_header.riff_chunk.wave_format, "WAVE", 4);
   // Format chunk
   memcpy(wav_header.format_chunk.format_chunk_id, "fmt ", 4);
@@ -204,100 +312,242 @@ bool StreamingRingliDecoder::ProcessHeader(const uint8_t* data, size_t len) {
   wav_header.format_chunk.bits_per_sample = ringli_header_.bits_per_sample;
   // Data chunk
   memcpy(wav_header.channel_id, "data", 4);
-  wav_header.channel_data_length = ringli_header_.data_length;
+  wav_header.channel_data_length = data_length;
   WriteWavHeader(wav_header, &wav_data_);
-  wav_data_.reserve(wav_data_.size() + wav_header.channel_data_length);
-  if (!ringli_header_.config.use_predictive_coding) {
-    dct_ = std::make_unique<DCT<kDctLength>>();
-    prev_ = std::make_unique<RingliBlock>(num_channels);
-    current_ = std::make_unique<RingliBlock>(num_channels);
-    next_ = std::make_unique<RingliBlock>(num_channels);
-  } else if (ringli_header_.config.ecparams.arithmetic_only &&
-             ringli_header_.config.use_online_predictive_coding) {
-    entropy_decoder_ =
-        std::make_unique<EntropyDecoder>(num_channels, this, ProcessSamplesCb);
-    const bool fast_mode = ringli_header_.config.predictor_fast_mode();
-    for (int i = 0; i < num_channels; ++i) {
-      if (fast_mode) {
-        predictors_.emplace_back(std::make_unique<FastOnlinePredictor>());
+}
+
+bool StreamingRingliDecoder::ProcessSamples(const int* samples,
+                                            size_t num_ticks) {
+  const size_t num_channels = ringli_header_.number_of_channels;
+  const bool adaptive_quantization =
+      ringli_header_.config.use_adaptive_quantization;
+  const bool noise_filter = ringli_header_.config.use_noise_filter;
+  // Legacy streams did not round the predictions of the lossless mode.
+  const bool round_predictions = !adaptive_quantization &&
+                                 ringli_header_.config.pred_quant == 1 &&
+                                 !legacy_stream_;
+  const size_t delay = noise_filter ? noise_filters_[0].get_delay() : 0;
+  int32_t* decoded = decoded_samples_.data();
+  float* predictions = predictions_.data();
+  float* samples_deq = dequantized_samples_.data();
+  for (size_t t = 0; t < num_ticks; ++t, samples += num_channels) {
+    predictor_->Predict(predictions);
+    for (size_t c = 0; c < num_channels; ++c) {
+      float quant;
+      if (adaptive_quantization) {
+        quant = adaptive_quantizers_[c].QuantStep();
       } else {
-        predictors_.emplace_back(
-            std::make_unique<OnlinePredictor>(kOnlinePredictorRegulariser));
+        quant = ringli_header_.config.pred_quant;
+      }
+      float prediction = predictions[c];
+      if (round_predictions) prediction = std::round(prediction);
+      const float residual = quant * samples[c];
+      const float sample_deq = prediction + residual;
+      samples_deq[c] = sample_deq;
+      if (adaptive_quantization) {
+        adaptive_quantizers_[c].ProcessSample(sample_deq);
+      }
+      if (noise_filter) {
+        noise_filters_[c].AddNewSample(sample_deq);
+        decoded[c] = std::round(noise_filters_[c].GetFilteredSample());
+      } else {
+        decoded[c] = std::round(sample_deq);
       }
     }
+    predictor_->AddNewSamples(samples_deq);
 
-    noise_filters_.resize(num_channels);
-    adaptive_quantizers_.resize(num_channels);
-    for (size_t c = 0; c < num_channels; ++c) {
-      predictors_[c]->Reset();
-      noise_filters_[c].Reset();
-      adaptive_quantizers_[c].Reset();
+    if (idx_ >= delay) {
+      CHECK_LT(samples_written_, remaining_samples_);
+      WriteSamples(decoded, num_channels, &wav_data_);
+      samples_written_ += num_channels;
+    }
+    ++idx_;
+    if (idx_ % kRingliBlockSize == 0) {
+      predictor_->Reset();
+      for (size_t ci = 0; ci < num_channels; ++ci) {
+        adaptive_quantizers_[ci].Reset();
+      }
     }
   }
-  remaining_samples_ = ringli_header_.data_length / bytes_per_sample;
   return true;
 }
 
-bool StreamingRingliDecoder::ProcessSamples(const int* samples) {
-  // samples is a array of ints of size num_channels
-  const size_t num_channels = ringli_header_.number_of_channels;
-  std::vector<int32_t> decoded(num_channels);
-  for (size_t c = 0; c < num_channels; ++c) {
-    float quant;
-    if (ringli_header_.config.use_adaptive_quantization) {
-      quant = adaptive_quantizers_[c].QuantStep();
-    } else {
-      quant = ringli_header_.config.pred_quant;
-    }
-    const float prediction = predictors_[c]->Predict();
-    const float residual = quant * samples[c];
-    const float sample_deq = prediction + residual;
-    predictors_[c]->AddNewSample(sample_deq);
-    if (ringli_header_.config.use_adaptive_quantization) {
-      adaptive_quantizers_[c].ProcessSample(sample_deq);
-    }
-    if (ringli_header_.config.use_noise_filter) {
-      noise_filters_[c].AddNewSample(sample_deq);
-      decoded[c] = std::round(noise_filters_[c].GetFilteredSample());
+bool StreamingRingliDecoder::ProcessBlock(const RingliBlock& block) {
+  if (ringli_header_.config.use_predictive_coding) {
+    DecodePredictive(ringli_header_.config, legacy_stream_, block,
+                     decoded_block_.get());
+    WriteBlock(*decoded_block_);
+  } else {
+    if (num_blocks_ == 0) {
+      *current_ = block;
     } else {
-      decoded[c] = std::round(sample_deq);
+      *next_ = block;
+      DecodeWithDCT(ringli_header_.config, *dct_, *prev_, *current_, *next_,
+                    decoded_block_.get());
+      WriteBlock(*decoded_block_);
+      // The next block overwrites the oldest one.
+      prev_.swap(current_);
+      current_.swap(next_);
     }
   }
+  ++num_blocks_;
+  return true;
+}
 
-  if (!ringli_header_.config.use_noise_filter ||
-      idx_ >= noise_filters_[0].get_delay()) {
-    CHECK_LT(samples_written_, remaining_samples_);
-    WriteSamples(decoded.data(), num_channels, &wav_data_);
-    samples_written_ += num_channels;
-  }
-  ++idx_;
-  if (idx_ % kRingliBlockSize == 0) {
-    for (size_t ci = 0; ci < num_channels; ++ci) {
-      predictors_[ci]->Reset();
-      adaptive_quantizers_[ci].Reset();
+bool StreamingRingliDecoder::DecodeSegments() {
+  const RingliDecoderConfig& config = ringli_header_.config;
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(ringli_data_.data());
+  size_t pos = 0;
+  size_t num_blocks = num_decoded_blocks_;
+  size_t segment_bytes;
+  segments_.clear();
+  while (num_blocks < total_blocks_ &&
+         FindSegmentSize(&data[pos], ringli_data_.size() - pos, config,
+                         ringli_header_.number_of_channels, &segment_bytes)) {
+    const size_t segment_blocks = std::min<size_t>(
+        config.ecparams.segment_size, total_blocks_ - num_blocks);
+    segments_.push_back({pos, segment_bytes, segment_blocks});
+    num_blocks += segment_blocks;
+    pos += segment_bytes;
+  }
+  if (pool_ && segments_.size() > 1) {
+    if (!DecodeSegmentsInParallel()) {
+      return false;
+    }
+  } else {
+    for (const Segment& segment : segments_) {
+      segment_blocks_.clear();
+      if (!DecodeSegment(segment.pos, segment.size, segment.num_blocks,
+                         &ans_codes_, &segment_blocks_, pool_.get())) {
+        return false;
+      }
+      for (const RingliBlock& block : segment_blocks_) {
+        ProcessBlock(block);
+      }
+      num_decoded_blocks_ += segment.num_blocks;
     }
   }
+  // Only the incomplete segment is kept.
+  ringli_data_.erase(0, pos);
   return true;
 }
 
-bool StreamingRingliDecoder::ProcessBlock(const RingliBlock& block) {
-  if (ringli_header_.config.use_predictive_coding) {
-    WriteBlock(DecodePredictive(ringli_header_.config, block));
+bool StreamingRingliDecoder::DecodeSegment(size_t pos, size_t size,
+                                           size_t num_blocks,
+                                           ANSEntropyCodes* codes,
+                                           std::vector<RingliBlock>* blocks,
+                                           ThreadPool* pool) {
+  const RingliDecoderConfig& config = ringli_header_.config;
+  const size_t num_channels = ringli_header_.number_of_channels;
+  const char* segment = &ringli_data_[pos];
+  if (config.use_predictive_coding) {
+    return DecompressPredictiveRingliBlocks(
+        segment, size, num_channels, num_blocks, config, codes, blocks, pool);
+  }
+  return DecompressCoefficients(segment, size, num_channels, num_blocks,
+                                config, codes, blocks);
+}
+
+bool StreamingRingliDecoder::DecodeSegmentsInParallel() {
+  const RingliDecoderConfig& config = ringli_header_.config;
+  const size_t first_segment =
+      num_decoded_blocks_ / config.ecparams.segment_size;
+  // The first run continues with the entropy codes of the previous segments,
+  // the other ones start with their own.
+  std::vector<size_t> run_starts = {0};
+  for (size_t i = 1; i < segments_.size(); ++i) {
+    if (config.independent_segment(first_segment + i)) {
+      run_starts.push_back(i);
+    }
+  }
+  const size_t num_runs = run_starts.size();
+  run_starts.push_back(segments_.size());
+  std::vector<ANSEntropyCodes> run_codes(num_runs);
+  std::vector<std::vector<RingliBlock>> run_blocks(num_runs);
+  std::vector<char> run_ok(num_runs);
+  run_codes[0] = std::move(ans_codes_);
+  // The tasks of nested ParallelFor() calls could wait for each other, so the
+  // channel substreams are only decoded in parallel if there is one run.
+  ThreadPool* substream_pool = num_runs > 1 ? nullptr : pool_.get();
+  const auto decode_run = [&](size_t run) {
+    run_ok[run] = true;
+    for (size_t i = run_starts[run]; i < run_starts[run + 1]; ++i) {
+      const Segment& segment = segments_[i];
+      if (!DecodeSegment(segment.pos, segment.size, segment.num_blocks,
+                         &run_codes[run], &run_blocks[run], substream_pool)) {
+        run_ok[run] = false;
+        return;
+      }
+    }
+  };
+  if (num_runs > 1) {
+    pool_->ParallelFor(num_runs, decode_run);
   } else {
-    if (num_blocks_ == 0) {
-      *current_ = block;
-    } else {
-      *next_ = block;
-      WriteBlock(DecodeWithDCT(ringli_header_.config, *dct_, *prev_, *current_,
-                               *next_));
-      *prev_ = *current_;
-      *current_ = *next_;
+    decode_run(0);
+  }
+  ans_codes_ = std::move(run_codes.back());
+  std::vector<const RingliBlock*> blocks;
+  for (size_t run = 0; run < num_runs; ++run) {
+    if (!run_ok[run]) {
+      return false;
+    }
+    for (const RingliBlock& block : run_blocks[run]) {
+      blocks.push_back(&block);
     }
   }
-  ++num_blocks_;
+  ProcessBlocksInParallel(blocks);
+  num_decoded_blocks_ += blocks.size();
   return true;
 }
 
+void StreamingRingliDecoder::ProcessBlocksInParallel(
+    const std::vector<const RingliBlock*>& blocks) {
+  const RingliDecoderConfig& config = ringli_header_.config;
+  const size_t num_channels = ringli_header_.number_of_channels;
+  // The DCT mode decodes each block with its neighbours, so the decoded blocks
+  // lag one block behind the input, as in ProcessBlock().
+  std::vector<const RingliBlock*> window;
+  if (!config.use_predictive_coding) {
+    window.push_back(prev_.get());
+    if (num_blocks_ > 0) {
+      window.push_back(current_.get());
+    }
+  }
+  window.insert(window.end(), blocks.begin(), blocks.end());
+  const size_t begin = config.use_predictive_coding ? 0 : 1;
+  const size_t end =
+      config.use_predictive_coding ? window.size() : window.size() - 1;
+  const size_t samples_per_block = kRingliBlockSize * num_channels;
+  const size_t num_samples =
+      std::min(remaining_samples_, (end - begin) * samples_per_block);
+  const size_t output_start = wav_data_.size();
+  wav_data_.resize(output_start + num_samples * sizeof(int16_t));
+  const size_t num_tasks = std::min(end - begin, pool_->NumThreads() + 1);
+  pool_->ParallelFor(num_tasks, [&](size_t task) {
+    AudioBlock decoded_block(num_channels);
+    for (size_t i = begin + task; i < end; i += num_tasks) {
+      if (config.use_predictive_coding) {
+        DecodePredictive(config, legacy_stream_, *window[i], &decoded_block);
+      } else {
+        DecodeWithDCT(config, *dct_, *window[i - 1], *window[i],
+                      *window[i + 1], &decoded_block);
+      }
+      const size_t offset = (i - begin) * samples_per_block;
+      if (offset < num_samples) {
+        WriteWavBlock(decoded_block, num_samples - offset,
+                      &wav_data_[output_start + offset * sizeof(int16_t)]);
+      }
+    }
+  });
+  remaining_samples_ -= num_samples;
+  if (!config.use_predictive_coding) {
+    // The last two blocks are the neighbours of the next decoded block.
+    *prev_ = *window[window.size() - 2];
+    *current_ = *window[window.size() - 1];
+  }
+  num_blocks_ += blocks.size();
+}
+
 void StreamingRingliDecoder::WriteBlock(const AudioBlock& block) {
   const size_t num_channels = ringli_header_.number_of_channels;
   const size_t samples_per_block = kRingliBlockSize * num_channels;
@@ -307,24 +557,37 @@ void StreamingRingliDecoder::WriteBlock(const AudioBlock& block) {
 }
 
 bool StreamingRingliDecoder::Flush() {
-  if (ringli_header_.config.use_online_predictive_coding &&
-      ringli_header_.config.ecparams.arithmetic_only) {
+  if (block_decoder_) {
+    if (!block_decoder_->Flush()) {
+      return false;
+    }
+    if (!ringli_header_.config.use_predictive_coding) {
+      ProcessBlock(RingliBlock(ringli_header_.number_of_channels));
+    }
+    return true;
+  }
+  if (decode_segments_) {
+    if (num_decoded_blocks_ != total_blocks_) {
+      return false;
+    }
+    if (!ringli_header_.config.use_predictive_coding) {
+      ProcessBlock(RingliBlock(ringli_header_.number_of_channels));
+    }
+    return true;
+  }
+  if (entropy_decoder_) {
     if (ringli_header_.config.use_noise_filter) {
-      const std::vector<int> flush_samples(ringli_header_.number_of_channels);
-      for (int i = 0; i < noise_filters_[0].get_delay(); ++i) {
-        ProcessSamples(flush_samples.data());
-      }
+      const size_t delay = noise_filters_[0].get_delay();
+      const std::vector<int> flush_samples(
+          delay * ringli_header_.number_of_channels);
+      ProcessSamples(flush_samples.data(), delay);
     }
     CHECK_EQ(samples_written_, remaining_samples_);
     return true;
   }
-  // Stream dimensions derived from header
   const size_t num_channels = ringli_header_.number_of_channels;
-  const size_t bytes_per_sample = ringli_header_.bits_per_sample / 8;
-  const size_t vec_size = kRingliBlockSize * bytes_per_sample;
-  const size_t block_size = vec_size * num_channels;
-  const size_t num_blocks =
-      (ringli_header_.data_length + block_size - 1) / block_size;
+  const size_t num_blocks = total_blocks_;
+  ANSEntropyCodes codes;
   std::vector<RingliBlock> ringli_blocks;
   ringli_blocks.reserve(num_blocks);
   size_t ringli_pos = 0;
@@ -332,13 +595,15 @@ bool StreamingRingliDecoder::Flush() {
   if (predictive_coding) {
     if (!DecompressPredictiveRingliBlocks(
             &ringli_data_[ringli_pos], ringli_data_.size() - ringli_pos,
-            num_channels, num_blocks, ringli_header_.config, &ringli_blocks)) {
+            num_channels, num_blocks, ringli_header_.config, &codes,
+            &ringli_blocks)) {
       return false;
     }
   } else {
     if (!DecompressCoefficients(
             &ringli_data_[ringli_pos], ringli_data_.size() - ringli_pos,
-            num_channels, num_blocks, ringli_header_.config, &ringli_blocks)) {
+            num_channels, num_blocks, ringli_header_.config, &codes,
+            &ringli_blocks)) {
       return false;
     }
   }
@@ -351,6 +616,82 @@ bool StreamingRingliDecoder::Flush() {
   return true;
 }
 
+bool StreamingRingliDecoder::DecodeRange(const uint8_t* data, size_t len,
+                                         size_t start_sample,
+                                         size_t end_sample) {
+  Reset();
+  if (!ProcessHeader(data, len)) {
+    return false;
+  }
+  const size_t header_size = header_size_;
+  const size_t wav_header_size = wav_data_.size();
+  const size_t num_channels = ringli_header_.number_of_channels;
+  const size_t frame_size = num_channels * ringli_header_.bits_per_sample / 8;
+  end_sample = std::min<size_t>(end_sample,
+                                ringli_header_.data_length / frame_size);
+  start_sample = std::min(start_sample, end_sample);
+  if (start_sample == end_sample) {
+    wav_data_.clear();
+    WriteHeader(0);
+    return true;
+  }
+  const RingliDecoderConfig& config = ringli_header_.config;
+  size_t first_block = 0;
+  size_t data_start = header_size;
+  size_t data_end = len;
+  std::vector<size_t> offsets;
+  if (config.has_seek_table()) {
+    if (!ReadSeekTable(data, len, &offsets, &data_end)) {
+      return false;
+    }
+    // The DCT decoding of a block also needs the blocks before and after it.
+    const size_t extra = config.use_predictive_coding ? 0 : 1;
+    const size_t start_block = start_sample / kRingliBlockSize;
+    const size_t last_block = (end_sample - 1) / kRingliBlockSize + extra;
+    const size_t seek_blocks =
+        static_cast<size_t>(config.ecparams.segment_size) *
+        config.ecparams.seek_interval;
+    if (!offsets.empty()) {
+      const size_t first = std::min(
+          (start_block - std::min(start_block, extra)) / seek_blocks,
+          offsets.size() - 1);
+      const size_t last = last_block / seek_blocks + 1;
+      first_block = first * seek_blocks;
+      data_start = offsets[first];
+      if (last < offsets.size()) {
+        data_end = offsets[last];
+      }
+    }
+  }
+  if (data_start < header_size || data_start > data_end) {
+    return false;
+  }
+  // Continues as if the blocks before the seek point were already decoded.
+  num_decoded_blocks_ = first_block;
+  remaining_samples_ -= std::min(
+      remaining_samples_, first_block * kRingliBlockSize * num_channels);
+  input_pos_ = header_size;
+  if (!ProcessInput(&data[data_start], data_end - data_start)) {
+    return false;
+  }
+  if ((!decode_segments_ || num_decoded_blocks_ == total_blocks_) &&
+      !Flush()) {
+    return false;
+  }
+  const size_t begin =
+      wav_header_size + (start_sample - first_block * kRingliBlockSize) *
+                            frame_size;
+  const size_t size = (end_sample - start_sample) * frame_size;
+  if (wav_data_.size() < begin + size) {
+    return false;
+  }
+  const std::string samples = wav_data_.substr(begin, size);
+  wav_data_.clear();
+  WriteHeader(size);
+  wav_data_.append(samples);
+  return true;
+}
+
 size_t StreamingRingliDecoder::OutputSize() const {
   return wav_data_.size() - output_pos_;
 }
@@ -360,6 +701,11 @@ size_t StreamingRingliDecoder::CopyOutput(uint8_t* buffer, size_t len) {
   memcpy(buffer, reinterpret_cast<const uint8_t*>(&wav_data_[output_pos_]),
          nbytes);
   output_pos_ += nbytes;
+  if (output_pos_ == wav_data_.size()) {
+    // Keeps the buffer capacity for the output of the next blocks.
+    wav_data_.clear();
+    output_pos_ = 0;
+  }
   return nbytes;
 }
 
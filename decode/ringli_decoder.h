@@ -25,6 +25,7 @@
 #include "common/predictor.h"
 #include "common/ringli_header.h"
 #include "common/streaming.h"
+#include "common/thread_pool.h"
 #include "decode/entropy_decode.h"
 #include "decode/noise_filtering.h"
 
@@ -32,7 +33,15 @@ namespace ringli {
 
 class StreamingRingliDecoder : public StreamingInterface {
  public:
-  StreamingRingliDecoder() { StreamingRingliDecoder::Reset(); }
+  // With a positive num_threads, the independently decodable segments of the
+  // segmented streams are decoded on a thread pool. Does not change the
+  // decoded output.
+  explicit StreamingRingliDecoder(size_t num_threads = 0) {
+    if (num_threads > 0) {
+      pool_ = std::make_unique<ThreadPool>(num_threads);
+    }
+    StreamingRingliDecoder::Reset();
+  }
 
   void Reset() override;
   bool ProcessInput(const uint8_t* data, size_t len) override;
@@ -40,34 +49,101 @@ class StreamingRingliDecoder : public StreamingInterface {
   size_t OutputSize() const override;
   size_t CopyOutput(uint8_t* buffer, size_t len) override;
 
+  // Decodes the samples [start_sample, end_sample) of each channel of the
+  // complete ringli stream in data, and sets the output to a wav file of these
+  // samples. Streams with a seek table are decoded from the last seek point
+  // before start_sample up to the first one after end_sample, other streams
+  // from the beginning.
+  bool DecodeRange(const uint8_t* data, size_t len, size_t start_sample,
+                   size_t end_sample);
+
  private:
+  // Parses the header at the start of the len bytes of data, which may be
+  // followed by the rest of the stream.
   bool ProcessHeader(const uint8_t* data, size_t len);
+  // Appends a wav header for data_length bytes of samples to the output.
+  void WriteHeader(uint32_t data_length);
   bool ProcessBlock(const RingliBlock& block);
-  bool ProcessSamples(const int* samples);
+  // Decodes the complete segments of a segmented stream in ringli_data_.
+  bool DecodeSegments();
+  // Entropy decodes the runs of segments that start with an independently
+  // decodable segment on the thread pool, and then reconstructs their blocks
+  // in parallel.
+  bool DecodeSegmentsInParallel();
+  // Decodes the segment in ringli_data_ at pos with codes, and appends its
+  // blocks to blocks. The channel substreams are decoded on pool if it is not
+  // null.
+  bool DecodeSegment(size_t pos, size_t size, size_t num_blocks,
+                     ANSEntropyCodes* codes, std::vector<RingliBlock>* blocks,
+                     ThreadPool* pool);
+  // Same as ProcessBlock() on each of the blocks, but the blocks are decoded
+  // on the thread pool into disjoint parts of wav_data_.
+  void ProcessBlocksInParallel(const std::vector<const RingliBlock*>& blocks);
+  // Reconstructs num_ticks time slots from their interleaved quantized
+  // residuals.
+  bool ProcessSamples(const int* samples, size_t num_ticks);
   void WriteBlock(const AudioBlock& block);
 
-  static bool ProcessSamplesCb(void* opaque, const int* samples) {
+  static bool ProcessSamplesCb(void* opaque, const int* samples,
+                               size_t num_ticks) {
     return reinterpret_cast<StreamingRingliDecoder*>(opaque)->ProcessSamples(
-        samples);
+        samples, num_ticks);
+  }
+  static bool ProcessBlockCb(void* opaque, const RingliBlock& block) {
+    return reinterpret_cast<StreamingRingliDecoder*>(opaque)->ProcessBlock(
+        block);
   }
 
   std::string ringli_data_;
   std::string wav_data_;
   RingliHeader ringli_header_;
+  // Size of the header in the stream, and whether it is a legacy header, which
+  // ProcessHeader() converted to ringli_header_.
+  size_t header_size_;
+  bool legacy_stream_;
   std::unique_ptr<DCT<kDctLength>> dct_;
   std::unique_ptr<RingliBlock> prev_;
   std::unique_ptr<RingliBlock> current_;
   std::unique_ptr<RingliBlock> next_;
+  // Reused output of the block decoding functions.
+  std::unique_ptr<AudioBlock> decoded_block_;
+  // Decoded samples of the current time slot in the fully streaming mode.
+  std::vector<int32_t> decoded_samples_;
   std::unique_ptr<EntropyDecoder> entropy_decoder_;
-  std::vector<std::unique_ptr<Predictor>> predictors_;
+  // Decodes the arithmetic-only block streams while the input arrives.
+  std::unique_ptr<StreamingBlockDecoder> block_decoder_;
+  // Entropy codes and decoded blocks of the current segment in the segmented
+  // ANS mode.
+  ANSEntropyCodes ans_codes_;
+  std::vector<RingliBlock> segment_blocks_;
+  bool decode_segments_;
+  // Position, size and number of blocks of the complete segments in
+  // ringli_data_.
+  struct Segment {
+    size_t pos;
+    size_t size;
+    size_t num_blocks;
+  };
+  std::vector<Segment> segments_;
+  // Predictor of the fully streaming mode, and its predictions and
+  // dequantized samples of the current time slot.
+  std::unique_ptr<MultiChannelPredictor> predictor_;
+  std::vector<float> predictions_;
+  std::vector<float> dequantized_samples_;
   std::vector<SymNoiseFilter> noise_filters_;
   std::vector<AdaptiveQuantizer> adaptive_quantizers_;
   size_t idx_;
+  // Number of blocks passed to ProcessBlock(), decoded by the entropy
+  // decoder, and in the whole stream.
   size_t num_blocks_;
+  size_t num_decoded_blocks_;
+  size_t total_blocks_;
   size_t input_pos_;
   size_t output_pos_;
   size_t samples_written_;
   size_t remaining_samples_;
+  // Only used by ParallelFor() calls, which wait for all of their tasks.
+  std::unique_ptr<ThreadPool> pool_;
 };
 
 bool RingliDecompress(const std::string& ringli_data, std::string* wav_data);
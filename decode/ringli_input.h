@@ -18,18 +18,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 namespace ringli {
 
 static const int kBitMask[] = {
     0, 1, 3, 7, 15, 31, 63, 127, 255, 511, 1023, 2047, 4095, 8191, 16383, 32767,
 };
 
+// The whole data of a block stream.
 class RingliInput {
  public:
   RingliInput(const uint8_t* data, size_t len)
-      : data_(data), len_(len), pos_(0), val_(0), bit_pos_(0), error_(0) {}
-
-  void InitBitReader() { val_ = GetNextWord(); }
+      : data_(data), len_(len), pos_(0), error_(0) {}
 
   uint16_t GetNextWord() {
     uint16_t val = 0;
@@ -42,18 +43,29 @@ class RingliInput {
     return val;
   }
 
-  int ReadBits(int nbits) {
-    if (bit_pos_ + nbits > 16) {
-      uint32_t new_bits = GetNextWord();
-      val_ |= new_bits << 16;
+  // Returns the next two words as a 32-bit integer with the first word in the
+  // low half, checking the end of the data only once.
+  uint32_t GetNextDoubleWord() {
+    if (pos_ + 3 < len_) {
+      const uint8_t* p = &data_[pos_];
+      pos_ += 4;
+      return p[0] | (p[1] << 8) | (p[2] << 16) |
+             (static_cast<uint32_t>(p[3]) << 24);
     }
-    int retval = (val_ >> bit_pos_) & kBitMask[nbits];
-    bit_pos_ += nbits;
-    if (bit_pos_ > 16) {
-      bit_pos_ -= 16;
-      val_ >>= 16;
-    }
-    return retval;
+    const uint32_t low = GetNextWord();
+    return low | (static_cast<uint32_t>(GetNextWord()) << 16);
+  }
+
+  // The input of SymbolReader, all words are available, and the ones past the
+  // end of the data are read as zero and set the error.
+  bool HasWords(size_t num_words) const { return true; }
+  bool NextWord(uint16_t* word) {
+    *word = GetNextWord();
+    return true;
+  }
+  bool NextWord(uint32_t* word) {
+    *word = GetNextDoubleWord();
+    return true;
   }
 
   bool ok() const { return !error_; }
@@ -62,11 +74,80 @@ class RingliInput {
   const uint8_t* data_;
   size_t len_;
   size_t pos_;
-  uint32_t val_;
-  int bit_pos_;
   int error_;
 };
 
+// The input of SymbolReader while a block stream arrives in chunks. The words
+// past the end of the data, which is either set by set_data_end() or is the
+// end of the stream after Finish(), are read as zero and set overrun().
+class StreamingInput {
+ public:
+  // Upper limit of the bytes that are kept between the Append() calls, the
+  // readers wait for at most four words at a time.
+  static constexpr size_t kMaxKeptBytes = 8;
+
+  // Appends the next chunk of the stream. Only the bytes of the words that are
+  // not complete yet are kept, so the buffer is only reallocated for a longer
+  // chunk.
+  void Append(const uint8_t* data, size_t len) {
+    input_.erase(input_.begin(), input_.begin() + pos_);
+    pos_ = 0;
+    input_.reserve(len + kMaxKeptBytes);
+    input_.insert(input_.end(), data, data + len);
+  }
+
+  // Marks the end of the stream.
+  void Finish() { finished_ = true; }
+  bool finished() const { return finished_; }
+
+  // Number of bytes read from the stream.
+  size_t num_read() const { return num_read_; }
+  void set_data_end(size_t data_end) { data_end_ = data_end; }
+  bool overrun() const { return overrun_; }
+
+  bool NextByte(uint8_t* byte) {
+    if (pos_ == input_.size()) return false;
+    *byte = input_[pos_++];
+    ++num_read_;
+    return true;
+  }
+
+  bool HasWords(size_t num_words) const {
+    return finished_ || pos_ + 2 * num_words <= input_.size();
+  }
+
+  bool NextWord(uint16_t* word) {
+    if (num_read_ + 2 > data_end_ || (finished_ && pos_ + 2 > input_.size())) {
+      // Same as RingliInput::GetNextWord() past the end of the data.
+      *word = 0;
+      overrun_ = true;
+      return true;
+    }
+    if (pos_ + 2 > input_.size()) return false;
+    *word = input_[pos_] + (input_[pos_ + 1] << 8);
+    pos_ += 2;
+    num_read_ += 2;
+    return true;
+  }
+
+  bool NextWord(uint32_t* word) {
+    if (!HasWords(2)) return false;
+    uint16_t low, high;
+    NextWord(&low);
+    NextWord(&high);
+    *word = low | (static_cast<uint32_t>(high) << 16);
+    return true;
+  }
+
+ private:
+  std::vector<uint8_t> input_;
+  size_t pos_ = 0;
+  size_t num_read_ = 0;
+  size_t data_end_ = SIZE_MAX;
+  bool finished_ = false;
+  bool overrun_ = false;
+};
+
 }  // namespace ringli
 
 #endif  // DECODE_RINGLI_INPUT_H_
@@ -0,0 +1,226 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DECODE_SYMBOL_READER_H_
+#define DECODE_SYMBOL_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/distributions.h"
+#include "common/entropy_coding.h"
+#include "decode/ringli_input.h"
+
+namespace ringli {
+
+inline int16_t ConvertToSigned(uint16_t val) {
+  int ux = val;
+  if (ux & 1) {
+    return -1 * ((ux + 1) / 2);
+  } else {
+    return ux / 2;
+  }
+}
+
+// Reads the arithmetic coded symbols and values, and the raw bits of the bit
+// reader, of the block streams. Both take the 16-bit words of the stream from
+// in, in the order in which the encoder wrote them. Input has the functions
+//
+//   bool HasWords(size_t num_words) const;
+//   bool NextWord(uint16_t* word);
+//   bool NextWord(uint32_t* word);
+//
+// where the 32-bit word has the first of two words in the low half, and which
+// return false if the words have not arrived yet. The read functions
+// below then return false too, and calling them again with the same
+// parameters after more input arrived continues the read. RingliInput has the
+// whole data, so the reads from it always succeed.
+template <typename ArithmeticDecoder, typename Input>
+class SymbolReader {
+ public:
+  SymbolReader(const EntropyCodingParams& ecparams, Input* in)
+      : gamma_(ecparams.gamma_symbols),
+        bypass_bits_(ecparams.bypass_bits),
+        in_(in) {}
+
+  // Reads the initial state of the arithmetic decoder.
+  bool InitArithmeticDecoder() {
+    if (!in_->HasWords(2 * sizeof(Word) / sizeof(uint16_t))) return false;
+    ac_ = ArithmeticDecoder();
+    for (int i = 0; i < 2; ++i) {
+      Word word;
+      in_->NextWord(&word);
+      ac_.Fill(word);
+    }
+    return true;
+  }
+
+  // Reads the first word of the bit reader.
+  bool InitBitReader() {
+    uint16_t word;
+    if (!in_->NextWord(&word)) return false;
+    bits_ = word;
+    bit_pos_ = 0;
+    return true;
+  }
+
+  bool ReadBit(int prob, int* bit) {
+    if (!FillArithmeticDecoder()) return false;
+    *bit = ac_.ReadBitNoFill(prob);
+    return true;
+  }
+
+  bool ReadAdaptiveBit(Prob* p, int* bit) {
+    if (!ReadBit(p->get_proba(), bit)) return false;
+    p->Add(*bit);
+    return true;
+  }
+
+  // Reads a symbol of the alphabet with the balanced binarization, p has the
+  // distributions of the alphabet_size - 1 nodes of the binary tree.
+  bool ReadSymbol(int alphabet_size, Prob* p, int* symbol) {
+    if (val1_ == 0) {
+      val0_ = 0;
+      val1_ = alphabet_size;
+    }
+    while (val0_ + 1 < val1_) {
+      const int mid = (val0_ + val1_) >> 1;
+      int bit;
+      if (!ReadAdaptiveBit(&p[mid - 1], &bit)) return false;
+      if (bit) {
+        val0_ = mid;
+      } else {
+        val1_ = mid;
+      }
+    }
+    *symbol = val0_;
+    val0_ = 0;
+    val1_ = 0;
+    return true;
+  }
+
+  // Reads a symbol of the MAX_SYMBOLS alphabet with the gamma or the balanced
+  // binarization, see EntropyCodingParams::gamma_symbols.
+  bool ReadByteSymbol(Prob* p, int* symbol) {
+    return gamma_ ? ReadGammaSymbol(LOG_MAX_SYMBOLS, p, symbol)
+                  : ReadSymbol(MAX_SYMBOLS, p, symbol);
+  }
+
+  // Reads the value of symbol, see EncodeValue(). Its extra bits are the raw
+  // bits of the bit reader if raw_bits is set, otherwise they are coded with
+  // the arithmetic decoder.
+  bool ReadValue(int symbol, int ndirect, bool raw_bits, int* value) {
+    const int ndirect_symbols = 2 * ndirect - 1;
+    if (symbol < ndirect_symbols) {
+      *value = ConvertToSigned(symbol);
+      return true;
+    }
+    int sym = symbol - ndirect_symbols;
+    const int sign = sym & 1;
+    sym >>= 1;
+    const int msb = sym & 1;
+    const int nbits = sym >> 1;
+    if (raw_bits) {
+      if (!ReadBits(nbits, &extra_bits_val_)) return false;
+    } else {
+      while (extra_bits_pos_ < nbits) {
+        if (!FillArithmeticDecoder()) return false;
+        uint32_t bits;
+        const int n = ac_.ReadExtraBitsNoFill(
+            bypass_bits_, nbits - extra_bits_pos_, &bits);
+        extra_bits_val_ |= bits << extra_bits_pos_;
+        extra_bits_pos_ += n;
+      }
+    }
+    const int absval = ndirect - 2 + ((2 + msb) << nbits) + extra_bits_val_;
+    *value = (1 - 2 * sign) * absval;
+    extra_bits_pos_ = 0;
+    extra_bits_val_ = 0;
+    return true;
+  }
+
+  // Reads nbits raw bits from the bit reader.
+  bool ReadBits(int nbits, int* value) {
+    if (bit_pos_ + nbits > 16) {
+      uint16_t word;
+      if (!in_->NextWord(&word)) return false;
+      bits_ |= static_cast<uint32_t>(word) << 16;
+    }
+    *value = (bits_ >> bit_pos_) & kBitMask[nbits];
+    bit_pos_ += nbits;
+    if (bit_pos_ > 16) {
+      bit_pos_ -= 16;
+      bits_ >>= 16;
+    }
+    return true;
+  }
+
+ private:
+  typedef typename ArithmeticDecoder::Word Word;
+
+  bool FillArithmeticDecoder() {
+    while (!ac_.HasBit()) {
+      Word word;
+      if (!in_->NextWord(&word)) return false;
+      ac_.Fill(word);
+    }
+    return true;
+  }
+
+  bool ReadGammaSymbol(int log_alphabet_size, Prob* p, int* symbol) {
+    int bit;
+    while (val1_ == 0) {
+      if (val0_ == log_alphabet_size) {
+        val1_ = 1;
+        break;
+      }
+      if (!ReadAdaptiveBit(&p[val0_], &bit)) return false;
+      if (bit) {
+        ++val0_;
+      } else {
+        val1_ = 1;
+      }
+    }
+    while (val1_ < (1 << val0_)) {
+      if (!ReadAdaptiveBit(&p[GammaBitIndex(log_alphabet_size, val0_, val1_)],
+                           &bit)) {
+        return false;
+      }
+      val1_ = 2 * val1_ + bit;
+    }
+    *symbol = val1_ - 1;
+    val0_ = 0;
+    val1_ = 0;
+    return true;
+  }
+
+  const bool gamma_;
+  const bool bypass_bits_;
+  Input* const in_;
+  ArithmeticDecoder ac_;
+  uint32_t bits_ = 0;
+  int bit_pos_ = 0;
+  // State of the symbol being read: the interval of the balanced
+  // binarization, or the number of unary one bits and the node of the bits
+  // read after them, zero while reading the unary part, of the gamma one.
+  int val0_ = 0;
+  int val1_ = 0;
+  // The extra bits of the value being read, and their number so far.
+  int extra_bits_val_ = 0;
+  int extra_bits_pos_ = 0;
+};
+
+}  // namespace ringli
+
+#endif  // DECODE_SYMBOL_READER_H_
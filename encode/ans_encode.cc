@@ -60,4 +60,8 @@ void BuildAndStoreANSEncodingData(const int* histogram, ANSTable* table,
   EncodeCounts(&counts[0], omit_pos, num_symbols, symbols, storage_ix, storage);
 }
 
+void BuildANSEncodingData(const int* counts, ANSTable* table) {
+  ANSBuildInfoTable(counts, MAX_SYMBOLS, table->info_);
+}
+
 }  // namespace ringli
@@ -78,6 +78,9 @@ class ANSCoder {
 void BuildAndStoreANSEncodingData(const int* histogram, ANSTable* table,
                                   size_t* storage_ix, uint8_t* storage);
 
+// Builds the encoding table from counts that sum to ANS_TAB_SIZE.
+void BuildANSEncodingData(const int* counts, ANSTable* table);
+
 }  // namespace ringli
 
 #endif  // ENCODE_ANS_ENCODE_H_
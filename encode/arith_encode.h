@@ -17,6 +17,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
+#include "common/log2floor.h"
+
 namespace ringli {
 
 class BinaryArithmeticEncoder {
@@ -31,12 +35,7 @@ class BinaryArithmeticEncoder {
   typedef void (*Output)(void* opaque, uint16_t val);
 
   void AddBit(uint8_t prob, int bit, void* opaque, Output output) {
-    while (((low_ ^ high_) >> 16) == 0) {
-      output(opaque, high_ >> 16);
-      low_ <<= 16;
-      high_ <<= 16;
-      high_ |= 0xffff;
-    }
+    Normalize(opaque, output);
     const uint32_t diff = high_ - low_;
     const uint32_t split = low_ + (((uint64_t)diff * prob) >> 8);
     if (bit) {
@@ -46,6 +45,22 @@ class BinaryArithmeticEncoder {
     }
   }
 
+  // Adds the nbits low bits of bits with equal probabilities, coding as many
+  // of them at once as the current range allows, i.e. up to 16 bits with one
+  // range scaling instead of one split per bit.
+  void AddBits(int nbits, uint32_t bits, void* opaque, Output output) {
+    while (nbits > 0) {
+      Normalize(opaque, output);
+      const int n = std::min(
+          nbits, std::max(1, Log2FloorNonZero(high_ - low_) - 15));
+      const uint32_t step = (static_cast<uint64_t>(high_ - low_) + 1) >> n;
+      low_ += step * (bits & ((1u << n) - 1));
+      high_ = low_ + step - 1;
+      bits >>= n;
+      nbits -= n;
+    }
+  }
+
   void Flush(void* opaque, Output output) {
     output(opaque, high_ >> 16);
     output(opaque, high_ & 0xffff);
@@ -53,10 +68,84 @@ class BinaryArithmeticEncoder {
   }
 
  private:
+  void Normalize(void* opaque, Output output) {
+    while (((low_ ^ high_) >> 16) == 0) {
+      output(opaque, high_ >> 16);
+      low_ <<= 16;
+      high_ <<= 16;
+      high_ |= 0xffff;
+    }
+  }
+
   uint32_t low_;
   uint32_t high_;
 };
 
+// Same as BinaryArithmeticEncoder, but with 64-bit bounds that are
+// renormalised 32 bits at a time. Each 32-bit word is written as two 16-bit
+// words with the low half first, i.e. as a little-endian 32-bit integer.
+class BinaryArithmeticEncoder64 {
+ public:
+  BinaryArithmeticEncoder64() { Reset(); }
+
+  void Reset() {
+    low_ = 0;
+    high_ = ~0ull;
+  }
+
+  typedef void (*Output)(void* opaque, uint16_t val);
+
+  void AddBit(uint8_t prob, int bit, void* opaque, Output output) {
+    Normalize(opaque, output);
+    const uint64_t split = low_ + ((high_ - low_) >> 8) * prob;
+    if (bit) {
+      low_ = split + 1;
+    } else {
+      high_ = split;
+    }
+  }
+
+  // Same as BinaryArithmeticEncoder::AddBits().
+  void AddBits(int nbits, uint32_t bits, void* opaque, Output output) {
+    while (nbits > 0) {
+      Normalize(opaque, output);
+      const uint64_t diff = high_ - low_;
+      const int n = std::min(
+          nbits, std::min(16, std::max(1, Log2FloorNonZero64(diff) - 15)));
+      const uint64_t mask = (1u << n) - 1;
+      // The floor of (diff + 1) / 2^n without overflow.
+      const uint64_t step = (diff >> n) + (((diff & mask) + 1) >> n);
+      low_ += step * (bits & mask);
+      high_ = low_ + step - 1;
+      bits >>= n;
+      nbits -= n;
+    }
+  }
+
+  void Flush(void* opaque, Output output) {
+    WriteWord(high_ >> 32, opaque, output);
+    WriteWord(high_ & 0xffffffff, opaque, output);
+    Reset();
+  }
+
+ private:
+  static void WriteWord(uint32_t word, void* opaque, Output output) {
+    output(opaque, word & 0xffff);
+    output(opaque, word >> 16);
+  }
+
+  void Normalize(void* opaque, Output output) {
+    while (((low_ ^ high_) >> 32) == 0) {
+      WriteWord(high_ >> 32, opaque, output);
+      low_ <<= 32;
+      high_ = (high_ << 32) | 0xffffffff;
+    }
+  }
+
+  uint64_t low_;
+  uint64_t high_;
+};
+
 }  // namespace ringli
 
 #endif  // ENCODE_ARITH_ENCODE_H_
@@ -102,9 +102,62 @@ void CompareAndPushToQueue(const HistogramType* out, const int* cluster_size,
   }
 }
 
+// Number of candidate pairs per cluster of the fast clustering, see
+// HistogramCombine().
+static const int kFastClusteringCandidates = 64;
+
+// Returns the entropy per symbol of the histogram, zero for an empty one.
+template <typename HistogramType>
+double EntropyPerSymbol(const HistogramType& histogram) {
+  if (histogram.total_count == 0) {
+    return 0.0;
+  }
+  double bits = histogram.total_count * FastLog2(histogram.total_count);
+  for (const int count : histogram.data) {
+    if (count > 0) {
+      bits -= count * FastLog2(count);
+    }
+  }
+  return bits / histogram.total_count;
+}
+
+// Combines the empty histograms among the clusters into the first one of them,
+// since an empty histogram costs nothing to add to any other.
+template <typename HistogramType>
+void CombineEmptyHistograms(HistogramType* out, int* cluster_size,
+                            uint32_t* symbols, int symbols_size,
+                            std::vector<int>* clusters) {
+  int empty_idx = -1;
+  auto copy_to = clusters->begin();
+  for (const int idx : *clusters) {
+    if (out[idx].total_count == 0) {
+      if (empty_idx >= 0) {
+        cluster_size[empty_idx] += cluster_size[idx];
+        continue;
+      }
+      empty_idx = idx;
+    }
+    *copy_to++ = idx;
+  }
+  clusters->erase(copy_to, clusters->end());
+  for (int i = 0; i < symbols_size; ++i) {
+    if (out[symbols[i]].total_count == 0) {
+      symbols[i] = empty_idx;
+    }
+  }
+}
+
+// Combines the clusters of symbols greedily, always the pair with the largest
+// bit cost reduction, until no pair reduces the cost and at most max_clusters
+// are left. If max_candidates is zero, all pairs of clusters are candidates.
+// Otherwise, the empty histograms are combined up front, and each cluster is
+// only paired with the max_candidates nearest ones in the order of their
+// entropy per symbol, which bounds the number of queued pairs and cost
+// evaluations to linear in the number of clusters.
 template <typename HistogramType>
 int HistogramCombine(HistogramType* out, int* cluster_size, uint32_t* symbols,
-                     int symbols_size, int max_clusters) {
+                     int symbols_size, int max_clusters,
+                     int max_candidates = 0) {
   double cost_diff_threshold = 0.0;
   int min_cluster_size = 1;
 
@@ -118,15 +171,40 @@ int HistogramCombine(HistogramType* out, int* cluster_size, uint32_t* symbols,
   // reduction. For efficiency, only the front of the queue matters, the rest
   // of it is unordered.
   std::vector<HistogramPair> pairs;
-  pairs.reserve(clusters.size() * (clusters.size() + 1) / 2);
-  for (int idx1 = 0; idx1 < clusters.size(); ++idx1) {
-    for (int idx2 = idx1 + 1; idx2 < clusters.size(); ++idx2) {
-      CompareAndPushToQueue(out, cluster_size, clusters[idx1], clusters[idx2],
-                            &pairs);
+  // The clusters in the order of their entropy per symbol, and the number of
+  // neighbours on each side in this order that a cluster is paired with.
+  std::vector<int> order;
+  const int window = max_candidates / 2;
+  const auto by_entropy = [out](int idx1, int idx2) {
+    return out[idx1].entropy < out[idx2].entropy ||
+           (out[idx1].entropy == out[idx2].entropy && idx1 < idx2);
+  };
+  if (max_candidates > 0) {
+    CombineEmptyHistograms(out, cluster_size, symbols, symbols_size,
+                           &clusters);
+    order = clusters;
+    for (const int idx : order) {
+      out[idx].entropy = EntropyPerSymbol(out[idx]);
+    }
+    std::sort(order.begin(), order.end(), by_entropy);
+    pairs.reserve(order.size() * window);
+    for (int i = 0; i < order.size(); ++i) {
+      const int end = std::min<int>(order.size(), i + window + 1);
+      for (int j = i + 1; j < end; ++j) {
+        CompareAndPushToQueue(out, cluster_size, order[i], order[j], &pairs);
+      }
+    }
+  } else {
+    pairs.reserve(clusters.size() * (clusters.size() + 1) / 2);
+    for (int idx1 = 0; idx1 < clusters.size(); ++idx1) {
+      for (int idx2 = idx1 + 1; idx2 < clusters.size(); ++idx2) {
+        CompareAndPushToQueue(out, cluster_size, clusters[idx1],
+                              clusters[idx2], &pairs);
+      }
     }
   }
 
-  while (clusters.size() > min_cluster_size) {
+  while (clusters.size() > min_cluster_size && !pairs.empty()) {
     if (pairs[0].cost_diff >= cost_diff_threshold) {
       cost_diff_threshold = 1e99;
       min_cluster_size = max_clusters;
@@ -173,8 +251,23 @@ int HistogramCombine(HistogramType* out, int* cluster_size, uint32_t* symbols,
     pairs.resize(copy_to - pairs.begin());
 
     // Push new pairs formed with the combined histogram to the queue.
-    for (int i = 0; i < clusters.size(); ++i) {
-      CompareAndPushToQueue(out, cluster_size, best_idx1, clusters[i], &pairs);
+    if (max_candidates > 0) {
+      order.erase(std::find(order.begin(), order.end(), best_idx2));
+      order.erase(std::find(order.begin(), order.end(), best_idx1));
+      out[best_idx1].entropy = EntropyPerSymbol(out[best_idx1]);
+      const int pos =
+          std::lower_bound(order.begin(), order.end(), best_idx1, by_entropy) -
+          order.begin();
+      order.insert(order.begin() + pos, best_idx1);
+      const int end = std::min<int>(order.size(), pos + window + 1);
+      for (int j = std::max(0, pos - window); j < end; ++j) {
+        CompareAndPushToQueue(out, cluster_size, best_idx1, order[j], &pairs);
+      }
+    } else {
+      for (int i = 0; i < clusters.size(); ++i) {
+        CompareAndPushToQueue(out, cluster_size, best_idx1, clusters[i],
+                              &pairs);
+      }
     }
   }
   return clusters.size();
@@ -251,13 +344,15 @@ void HistogramReindex(std::vector<HistogramType>* out,
 
 // Clusters similar histograms in 'in' together, the selected histograms are
 // placed in 'out', and for each index in 'in', *histogram_symbols will
-// indicate which of the 'out' histograms is the best approximation.
+// indicate which of the 'out' histograms is the best approximation. See
+// HistogramCombine() for max_candidates.
 template <typename HistogramType>
 void ClusterHistograms(const std::vector<HistogramType>& in, int num_contexts,
                        int num_blocks,
                        const std::vector<int> block_group_offsets,
                        int max_histograms, std::vector<HistogramType>* out,
-                       std::vector<uint32_t>* histogram_symbols) {
+                       std::vector<uint32_t>* histogram_symbols,
+                       int max_candidates = 0) {
   const int in_size = num_contexts * num_blocks;
   std::vector<int> cluster_size(in_size, 1);
   out->resize(in_size);
@@ -273,7 +368,7 @@ void ClusterHistograms(const std::vector<HistogramType>& in, int num_contexts,
     for (int i = 0; i < num_blocks; ++i) {
       HistogramCombine(&(*out)[0], &cluster_size[0],
                        &(*histogram_symbols)[i * num_contexts], num_contexts,
-                       max_histograms);
+                       max_histograms, max_candidates);
     }
   }
 
@@ -290,7 +385,7 @@ void ClusterHistograms(const std::vector<HistogramType>& in, int num_contexts,
                     offset);
       int nclusters = HistogramCombine(&(*out)[0], &cluster_size[0],
                                        &(*histogram_symbols)[offset], length,
-                                       max_histograms);
+                                       max_histograms, max_candidates);
       // Find the optimal map from original histograms to the final ones.
       if (nclusters >= 2 && nclusters < kMinClustersForHistogramRemap) {
         HistogramRemap(&in[offset], length, &(*out)[0],
@@ -306,7 +401,7 @@ void ClusterHistograms(const std::vector<HistogramType>& in, int num_contexts,
     // clustering.
     num_clusters =
         HistogramCombine(&(*out)[0], &cluster_size[0], &(*histogram_symbols)[0],
-                         in_size, max_histograms);
+                         in_size, max_histograms, max_candidates);
     // Find the optimal map from original histograms to the final ones.
     if (num_clusters >= 2 && num_clusters < kMinClustersForHistogramRemap) {
       HistogramRemap(&in[0], in_size, &(*out)[0], &(*histogram_symbols)[0]);
@@ -19,7 +19,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,17 +29,21 @@
 #include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/types/span.h"
+#include "common/ans_params.h"
 #include "common/context.h"
 #include "common/data_defs/constants.h"
 #include "common/distributions.h"
 #include "common/entropy_coding.h"
+#include "common/entropy_presets.h"
 #include "common/log2floor.h"
 #include "common/logging.h"
 #include "common/ringli_header.h"
+#include "common/thread_pool.h"
 #include "encode/ans_encode.h"
 #include "encode/arith_encode.h"
 #include "encode/cluster.h"
 #include "encode/context_map_encode.h"
+#include "encode/fast_log.h"
 #include "encode/histogram_encode.h"
 #include "encode/write_bits.h"
 
@@ -70,10 +76,23 @@ double HistogramDistance(const Histogram& a, const Histogram& b) {
   return HistogramEntropy(c) - a.entropy - b.entropy;
 }
 
+void EntropySource::ClearHistograms() {
+  for (Histogram& histogram : histograms_) {
+    histogram.Clear();
+  }
+}
+
+void EntropySource::ClearEntropyCodes() {
+  clustered_.clear();
+  context_map_.clear();
+  ans_tables_.clear();
+}
+
 void EntropySource::ClusterHistograms() {
-  ::ringli::ClusterHistograms(histograms_, 1, histograms_.size(),
-                              std::vector<int>(), kMaxNumberOfHistograms,
-                              &clustered_, &context_map_);
+  ::ringli::ClusterHistograms(
+      histograms_, 1, histograms_.size(), std::vector<int>(),
+      kMaxNumberOfHistograms, &clustered_, &context_map_,
+      fast_clustering_ ? kFastClusteringCandidates : 0);
 }
 
 void EntropySource::EncodeContextMap(size_t* storage_ix,
@@ -91,6 +110,138 @@ void EntropySource::BuildAndStoreEntropyCodes(size_t* storage_ix,
   }
 }
 
+bool EntropySource::StoreOrReuseEntropyCodes(bool allow_reuse,
+                                             size_t* storage_ix,
+                                             uint8_t* storage) {
+  const double reuse_cost = allow_reuse
+                                ? EntropyCodesCost()
+                                : std::numeric_limits<double>::infinity();
+  prev_clustered_.swap(clustered_);
+  prev_context_map_.swap(context_map_);
+  prev_ans_tables_.swap(ans_tables_);
+  const size_t start_ix = *storage_ix;
+  // Cost of the new entropy codes and the built-in one that they use, if any.
+  double cost = std::numeric_limits<double>::infinity();
+  int preset_idx = -1;
+  if (entropy_presets_) {
+    const std::vector<HistogramEntry> entries = HistogramEntries();
+    for (int i = 0; i < kNumEntropyPresets; ++i) {
+      const double preset_cost = 8 + EntropyPresetCost(entries, i);
+      if (preset_cost < cost) {
+        cost = preset_cost;
+        preset_idx = i;
+      }
+    }
+  }
+  // The stored codes cost at least their index byte and the entropy of the
+  // histograms.
+  if (preset_idx < 0 || cost > 8 + HistogramsEntropy()) {
+    if (entropy_presets_) {
+      WriteBits(8, 0, storage_ix, storage);
+    }
+    ClusterHistograms();
+    EncodeContextMap(storage_ix, storage);
+    BuildAndStoreEntropyCodes(storage_ix, storage);
+    const double stored_cost = (*storage_ix - start_ix) + EntropyCodesCost();
+    if (stored_cost <= cost) {
+      cost = stored_cost;
+      preset_idx = -1;
+    }
+  }
+  if (reuse_cost <= cost) {
+    clustered_.swap(prev_clustered_);
+    context_map_.swap(prev_context_map_);
+    ans_tables_.swap(prev_ans_tables_);
+    *storage_ix = start_ix;
+    return false;
+  }
+  if (preset_idx >= 0) {
+    *storage_ix = start_ix;
+    storage[start_ix >> 3] &= (1 << (start_ix & 7)) - 1;
+    WriteBits(8, preset_idx + 1, storage_ix, storage);
+    UseEntropyPreset(GetEntropyPreset(preset_idx));
+  }
+  return true;
+}
+
+std::vector<EntropySource::HistogramEntry> EntropySource::HistogramEntries()
+    const {
+  std::vector<HistogramEntry> entries;
+  for (size_t ctx = 0; ctx < histograms_.size(); ++ctx) {
+    const Histogram& histogram = histograms_[ctx];
+    if (histogram.total_count == 0) continue;
+    for (int s = 0; s < MAX_SYMBOLS; ++s) {
+      if (histogram.data[s] > 0) {
+        entries.push_back({static_cast<uint32_t>(ctx), s, histogram.data[s]});
+      }
+    }
+  }
+  return entries;
+}
+
+double EntropySource::EntropyPresetCost(
+    const std::vector<HistogramEntry>& entries, int preset_idx) const {
+  const EntropyPreset& preset = GetEntropyPreset(preset_idx);
+  double bits = 0.0;
+  for (const HistogramEntry& entry : entries) {
+    const int count =
+        preset.counts[preset.context_map[entry.context]][entry.symbol];
+    if (count == 0) {
+      return std::numeric_limits<double>::infinity();
+    }
+    bits += entry.count * (ANS_LOG_TAB_SIZE - FastLog2(count));
+  }
+  return bits;
+}
+
+double EntropySource::HistogramsEntropy() const {
+  double bits = 0.0;
+  for (const Histogram& histogram : histograms_) {
+    if (histogram.total_count == 0) continue;
+    bits += histogram.total_count * FastLog2(histogram.total_count);
+    for (int s = 0; s < MAX_SYMBOLS; ++s) {
+      if (histogram.data[s] > 0) {
+        bits -= histogram.data[s] * FastLog2(histogram.data[s]);
+      }
+    }
+  }
+  return bits;
+}
+
+void EntropySource::UseEntropyPreset(const EntropyPreset& preset) {
+  context_map_ = preset.context_map;
+  clustered_.resize(preset.counts.size());
+  ans_tables_.resize(preset.counts.size());
+  for (size_t i = 0; i < preset.counts.size(); ++i) {
+    Histogram& histogram = clustered_[i];
+    histogram.Clear();
+    for (int s = 0; s < MAX_SYMBOLS; ++s) {
+      histogram.data[s] = preset.counts[i][s];
+    }
+    histogram.total_count = ANS_TAB_SIZE;
+    BuildANSEncodingData(preset.counts[i].data(), &ans_tables_[i]);
+  }
+}
+
+double EntropySource::EntropyCodesCost() const {
+  if (context_map_.size() != histograms_.size()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double bits = 0.0;
+  for (size_t ctx = 0; ctx < histograms_.size(); ++ctx) {
+    const Histogram& histogram = histograms_[ctx];
+    if (histogram.total_count == 0) continue;
+    const Histogram& code = clustered_[context_map_[ctx]];
+    for (int i = 0; i < MAX_SYMBOLS; ++i) {
+      if (histogram.data[i] > 0 && code.data[i] == 0) {
+        return std::numeric_limits<double>::infinity();
+      }
+    }
+    bits += HistogramCrossEntropy(histogram, code);
+  }
+  return bits;
+}
+
 double EntropySource::ClusteredEntropy(int histo_idx) {
   const Histogram& histo_a = histograms_[histo_idx];
   const Histogram& histo_b = clustered_[context_map_[histo_idx]];
@@ -98,16 +249,21 @@ double EntropySource::ClusteredEntropy(int histo_idx) {
 }
 
 DataStream::DataStream(EntropySource* entropy_source)
-    : pos_(3),
-      bw_pos_(0),
-      ac_pos0_(1),
-      ac_pos1_(2),
-      low_(0),
-      high_(~0),
-      bw_val_(0),
-      bw_bitpos_(0),
-      entropy_source_(entropy_source),
-      total_extra_bits_(0) {}
+    : entropy_source_(entropy_source), total_extra_bits_(0) {
+  Reset();
+}
+
+void DataStream::Reset() {
+  num_symbols_ = 0;
+  pos_ = 3;
+  bw_pos_ = 0;
+  ac_pos0_ = 1;
+  ac_pos1_ = 2;
+  low_ = 0;
+  high_ = ~0;
+  bw_val_ = 0;
+  bw_bitpos_ = 0;
+}
 
 void DataStream::ResizeForBlock() {
   if (pos_ + kSlackForOneBlock > code_words_.size()) {
@@ -118,6 +274,13 @@ void DataStream::ResizeForBlock() {
   }
 }
 
+void DataStream::ResizeForBlocks(size_t num_blocks) {
+  const size_t size = pos_ + num_blocks * kSlackForOneBlock;
+  if (size > code_words_.size()) {
+    code_words_.resize(size);
+  }
+}
+
 void DataStream::AddCode(int code, int context) {
   CodeWord word;
   word.context = context;
@@ -126,6 +289,7 @@ void DataStream::AddCode(int code, int context) {
   word.value = 0;
   CHECK(pos_ < code_words_.size());
   code_words_[pos_++] = word;
+  ++num_symbols_;
   entropy_source_->AddCode(code, context);
 }
 
@@ -193,19 +357,27 @@ void DataStream::EncodeCodeWords(const EntropySource& s,
   FlushBitWriter();
   FlushArithmeticCoder();
   if (!ecparams.arithmetic_only) {
-    ANSCoder ans;
+    // The ith symbol uses the (i % num_states)th state, and the symbols are
+    // encoded in reverse order.
+    const size_t num_states = ecparams.NumANSStates();
+    ANSCoder ans[kMaxANSStates];
+    size_t symbol_idx = num_symbols_;
     for (int i = pos_ - 1; i >= 0; --i) {
       CodeWord* const word = &code_words_[i];
       if (word->nbits == 0) {
         const ANSEncSymbolInfo info =
             s.GetANSTable(word->context)->info_[word->code];
-        word->value = ans.PutSymbol(info, &word->nbits);
+        --symbol_idx;
+        word->value =
+            ans[symbol_idx & (num_states - 1)].PutSymbol(info, &word->nbits);
       }
     }
-    const uint32_t state = ans.GetState();
-    CHECK(*pos + 4 <= len);
-    WriteUint16((state >> 16) & 0xffff, data, pos);
-    WriteUint16((state >> 0) & 0xffff, data, pos);
+    CHECK(*pos + 4 * num_states <= len);
+    for (size_t i = 0; i < num_states; ++i) {
+      const uint32_t state = ans[i].GetState();
+      WriteUint16((state >> 16) & 0xffff, data, pos);
+      WriteUint16((state >> 0) & 0xffff, data, pos);
+    }
   }
   for (int i = 0; i < pos_; ++i) {
     const CodeWord& word = code_words_[i];
@@ -216,6 +388,25 @@ void DataStream::EncodeCodeWords(const EntropySource& s,
   }
 }
 
+// Calls add_bit(prob, bit) for each binary decision of the gamma binarization
+// of val, where prob is the adaptive Prob of the decision.
+template <typename AddBit>
+void BinarizeGamma(int val, int log_alphabet_size, Prob* p, AddBit add_bit) {
+  const int n = val + 1;
+  const int k = Log2FloorNonZero(n);
+  for (int j = 0; j < k; ++j) {
+    add_bit(&p[j], 1);
+  }
+  if (k == log_alphabet_size) return;
+  add_bit(&p[k], 0);
+  int node = 1;
+  for (int b = k - 1; b >= 0; --b) {
+    const int bit = (n >> b) & 1;
+    add_bit(&p[GammaBitIndex(log_alphabet_size, k, node)], bit);
+    node = 2 * node + bit;
+  }
+}
+
 void EncodeSymbol(int val, int alphabet_size, Prob* p,
                   DataStream* data_stream) {
   int val0 = 0;
@@ -232,6 +423,18 @@ void EncodeSymbol(int val, int alphabet_size, Prob* p,
   }
 }
 
+// Encodes a symbol of the MAX_SYMBOLS alphabet with the gamma or the balanced
+// binarization.
+void EncodeByteSymbol(bool gamma, int val, Prob* p, DataStream* data_stream) {
+  if (gamma) {
+    BinarizeGamma(val, LOG_MAX_SYMBOLS, p, [data_stream](Prob* prob, int bit) {
+      data_stream->AddBit(prob, bit);
+    });
+  } else {
+    EncodeSymbol(val, MAX_SYMBOLS, p, data_stream);
+  }
+}
+
 size_t Base128Size(size_t val) {
   size_t size = 1;
   for (; val >= 128; val >>= 7) ++size;
@@ -276,6 +479,7 @@ void ProcessCoefficients(absl::Span<const RingliBlock> ringli_blocks,
   const size_t num_blocks = ringli_blocks.size();
   const size_t num_contexts = 2 + kNumZeroDensityContexts;
   entropy_source->Resize(num_contexts);
+  entropy_source->ClearHistograms();
 
   std::vector<Prob> last_nz_prob(kDctLength - 1);
   std::vector<Prob> is_zero_prob(kNumZeronessContexts);
@@ -292,9 +496,10 @@ void ProcessCoefficients(absl::Span<const RingliBlock> ringli_blocks,
       uint8_t quant_msb = header.quant[band] >> 8;
       uint8_t quant_lsb = header.quant[band] & 0xff;
       if (ecparams.arithmetic_only) {
-        EncodeSymbol(quant_msb, MAX_SYMBOLS, &symbol_prob[0], data_stream);
-        EncodeSymbol(quant_lsb, MAX_SYMBOLS, &symbol_prob[MAX_SYMBOLS - 1],
-                     data_stream);
+        EncodeByteSymbol(ecparams.gamma_symbols, quant_msb, &symbol_prob[0],
+                         data_stream);
+        EncodeByteSymbol(ecparams.gamma_symbols, quant_lsb,
+                         &symbol_prob[MAX_SYMBOLS - 1], data_stream);
       } else {
         data_stream->AddCode(quant_msb, 0);
         data_stream->AddCode(quant_lsb, 1);
@@ -339,9 +544,9 @@ void ProcessCoefficients(absl::Span<const RingliBlock> ringli_blocks,
               extra_bits &= (1 << nbits) - 1;
             }
             if (ecparams.arithmetic_only) {
-              EncodeSymbol(symbol, MAX_SYMBOLS,
-                           &symbol_prob[absval_ctx * (MAX_SYMBOLS - 1)],
-                           data_stream);
+              EncodeByteSymbol(ecparams.gamma_symbols, symbol,
+                               &symbol_prob[absval_ctx * (MAX_SYMBOLS - 1)],
+                               data_stream);
             } else {
               data_stream->AddCode(symbol, absval_ctx);
             }
@@ -354,57 +559,118 @@ void ProcessCoefficients(absl::Span<const RingliBlock> ringli_blocks,
       }
     }
   }
+}
+
+// Writes the size of the histogram data with size_bytes bytes and the
+// histogram data to output starting at *pos, an empty histogram data means
+// that the entropy codes of the previous segment are used. Returns the size of
+// the histogram data.
+size_t WriteHistograms(const EntropyCodingParams& ecparams, size_t size_bytes,
+                       EntropySource* entropy_source, std::string* output,
+                       size_t* pos) {
+  const size_t histograms_start = *pos;
+  // Skip some bytes for the size of the histogram data.
+  *pos += size_bytes;
+  uint8_t* storage = reinterpret_cast<uint8_t*>(&(*output)[*pos]);
+  size_t storage_ix = 0;
+  WriteBitsPrepareStorage(storage_ix, storage);
+  entropy_source->StoreOrReuseEntropyCodes(ecparams.segment_size > 0,
+                                           &storage_ix, storage);
+  // Encode histogram data size before the histogram data.
+  const size_t histograms_size = (storage_ix + 7) >> 3;
+  EncodeBase128Fix(histograms_size, size_bytes,
+                   reinterpret_cast<uint8_t*>(&(*output)[histograms_start]));
+  *pos += histograms_size;
+  return histograms_size;
+}
+
+// Writes the entropy coded data of a segment starting at *pos: the size of
+// the histogram data and the histogram data in ANS mode, followed by the code
+// words, which are preceded by their size if with_data_size is set. The sizes
+// are written with size_bytes bytes. Returns the size of the histogram data.
+size_t WriteEntropyCodedData(const EntropyCodingParams& ecparams,
+                             size_t size_bytes, bool with_data_size,
+                             EntropySource* entropy_source,
+                             DataStream* data_stream, std::string* output,
+                             size_t* pos) {
+  size_t histograms_size = 0;
   if (!ecparams.arithmetic_only) {
-    entropy_source->ClusterHistograms();
+    histograms_size =
+        WriteHistograms(ecparams, size_bytes, entropy_source, output, pos);
+  }
+  const size_t data_start = *pos;
+  if (with_data_size) {
+    // Skip some bytes for the size of the code words.
+    *pos += size_bytes;
   }
+  data_stream->EncodeCodeWords(*entropy_source, ecparams,
+                               reinterpret_cast<uint8_t*>(&(*output)[0]), pos,
+                               output->size());
+  if (with_data_size) {
+    // Encode the size of the code words before them.
+    const size_t data_size = *pos - data_start - size_bytes;
+    EncodeBase128Fix(data_size, size_bytes,
+                     reinterpret_cast<uint8_t*>(&(*output)[data_start]));
+  }
+  return histograms_size;
+}
+
+// Returns an upper bound on the size of the entropy coded data of num_values
+// coded samples or coefficients.
+// TODO(szabadka) Improve on this bound.
+size_t MaxEntropyCodedDataSize(size_t num_values) {
+  return num_values * sizeof(int32_t) + (1 << 12);
 }
 
-bool CompressCoefficients(const std::vector<RingliBlock>& ringli_blocks,
+bool CompressCoefficients(absl::Span<const RingliBlock> ringli_blocks,
                           size_t num_channels,
                           const EntropyCodingParams& ecparams,
-                          std::string* output) {
-  EntropySource entropy_source;
-  DataStream data_stream(&entropy_source);
-  ProcessCoefficients(ringli_blocks, num_channels, ecparams, &entropy_source,
+                          EntropySource* entropy_source, std::string* output) {
+  DataStream data_stream(entropy_source);
+  ProcessCoefficients(ringli_blocks, num_channels, ecparams, entropy_source,
                       &data_stream);
   const size_t num_coeffs =
       ringli_blocks.size() * num_channels * kRingliBlockSize;
-
-  // TODO(szabadka) Improve on this bound.
-  const size_t max_compressed_size = num_coeffs * 4 + (1 << 12);
+  const size_t max_compressed_size = MaxEntropyCodedDataSize(num_coeffs);
   const size_t size_bytes = Base128Size(max_compressed_size);
-  const size_t data_start = output->size();
-  output->resize(data_start + max_compressed_size);
-  size_t pos = data_start;
+  size_t pos = output->size();
+  output->resize(pos + max_compressed_size);
+  WriteEntropyCodedData(ecparams, size_bytes, /*with_data_size=*/true,
+                        entropy_source, &data_stream, output, &pos);
+  output->resize(pos);
+  return true;
+}
 
-  if (!ecparams.arithmetic_only) {
-    // Skip some bytes for the size of the histogram data.
-    pos += size_bytes;
-    uint8_t* storage = reinterpret_cast<uint8_t*>(&(*output)[pos]);
-    size_t storage_ix = 0;
-    WriteBitsPrepareStorage(storage_ix, storage);
-    entropy_source.EncodeContextMap(&storage_ix, storage);
-    entropy_source.BuildAndStoreEntropyCodes(&storage_ix, storage);
-    // Encode histogram data size before the histogram data.
-    const size_t histograms_size = (storage_ix + 7) >> 3;
-    EncodeBase128Fix(histograms_size, size_bytes,
-                     reinterpret_cast<uint8_t*>(&(*output)[data_start]));
-    pos += histograms_size;
-  }
+void SeekTableWriter::Reset() {
+  num_segments_ = 0;
+  offsets_.clear();
+}
 
-  const size_t coeff_data_start = pos;
-  // Skip some bytes for the size of the coefficient data.
-  pos += size_bytes;
-  data_stream.EncodeCodeWords(entropy_source, ecparams,
-                              reinterpret_cast<uint8_t*>(&(*output)[0]), &pos,
-                              output->size());
-  // Encode coeff data size before the coeff data.
-  const size_t coeff_data_size = pos - coeff_data_start - size_bytes;
-  EncodeBase128Fix(coeff_data_size, size_bytes,
-                   reinterpret_cast<uint8_t*>(&(*output)[coeff_data_start]));
+void SeekTableWriter::StartSegment(const std::string& output,
+                                   EntropySource* entropy_source) {
+  if (seek_interval_ > 0 && num_segments_ % seek_interval_ == 0) {
+    offsets_.push_back(output.size());
+    entropy_source->ClearEntropyCodes();
+  }
+  ++num_segments_;
+}
 
-  output->resize(pos);
-  return true;
+void SeekTableWriter::Write(std::string* output) const {
+  if (seek_interval_ == 0) return;
+  const size_t table_start = output->size();
+  size_t prev_offset = 0;
+  for (size_t offset : offsets_) {
+    const size_t delta = offset - prev_offset;
+    const size_t len = Base128Size(delta);
+    const size_t pos = output->size();
+    output->resize(pos + len);
+    EncodeBase128Fix(delta, len, reinterpret_cast<uint8_t*>(&(*output)[pos]));
+    prev_offset = offset;
+  }
+  const uint32_t table_size = output->size() - table_start;
+  for (int i = 0; i < 4; ++i) {
+    output->push_back((table_size >> (8 * i)) & 0xff);
+  }
 }
 
 void AppendUint16ToString(void* opaque, uint16_t val) {
@@ -413,8 +679,9 @@ void AppendUint16ToString(void* opaque, uint16_t val) {
   s->push_back(val >> 8);
 }
 
+template <typename ArithmeticEncoder>
 void WriteSymbol(int val, int alphabet_size, Prob* probs,
-                 BinaryArithmeticEncoder* ac, std::string* output) {
+                 ArithmeticEncoder* ac, std::string* output) {
   int val0 = 0;
   int val1 = alphabet_size;
   while (val0 + 1 < val1) {
@@ -432,25 +699,72 @@ void WriteSymbol(int val, int alphabet_size, Prob* probs,
   }
 }
 
+template <typename ArithmeticEncoder>
+void WriteByteSymbol(bool gamma, int val, Prob* probs, ArithmeticEncoder* ac,
+                     std::string* output) {
+  if (gamma) {
+    BinarizeGamma(val, LOG_MAX_SYMBOLS, probs, [ac, output](Prob* p, int bit) {
+      const uint8_t prob = p->get_proba();
+      p->Add(bit);
+      ac->AddBit(prob, bit, output, AppendUint16ToString);
+    });
+  } else {
+    WriteSymbol(val, MAX_SYMBOLS, probs, ac, output);
+  }
+}
+
+// Writes the symbol and the extra bits of an arithmetic coded value, see
+// EntropyCodingParams::bypass_bits.
+template <typename ArithmeticEncoder>
+void WriteArithmeticValue(const EntropyCodingParams& ecparams, int symbol,
+                          int nbits, int extra_bits, Prob* probs,
+                          ArithmeticEncoder* ac, std::string* output) {
+  WriteByteSymbol(ecparams.gamma_symbols, symbol, probs, ac, output);
+  if (ecparams.bypass_bits) {
+    ac->AddBits(nbits, extra_bits, output, AppendUint16ToString);
+  } else {
+    for (int b = 0; b < nbits; ++b) {
+      ac->AddBit(128, (extra_bits >> b) & 1, output, AppendUint16ToString);
+    }
+  }
+}
+
 EntropyCoder::EntropyCoder(const EntropyCodingParams& ecparams,
                            uint32_t sampling_freq, uint32_t num_channels,
-                           bool predictive, bool online)
+                           bool predictive, bool online,
+                           bool fast_clustering, ThreadPool* pool)
     : ecparams_(ecparams),
       sampling_freq_(sampling_freq),
       num_channels_(num_channels),
       predictive_(predictive),
-      online_(online) {
+      online_(online),
+      fast_clustering_(fast_clustering),
+      channel_substreams_(segmented() && ecparams.channel_substreams),
+      pool_(pool),
+      seek_table_(segmented() ? ecparams.seek_interval : 0) {
   Reset();
 }
 
+// Returns the number of coded values of num_blocks blocks of num_channels
+// channels of the predictive modes, i.e. the residuals and at most
+// kMaxPredictorOrder predictor parameters per channel.
+size_t NumPredictiveValues(size_t num_blocks, size_t num_channels) {
+  return num_blocks * num_channels * (kRingliBlockSize + kMaxPredictorOrder);
+}
+
 void EntropyCoder::Reset() {
   if (predictive_) {
-    if (online_ && ecparams_.arithmetic_only) {
+    if (range_coding()) {
+      context_model_.resize(num_channels_);
+      symbol_dist_.assign(context_model_[0].NumContexts(),
+                          AdaptiveDistribution());
+    } else if (online_ && ecparams_.arithmetic_only) {
       context_model_.resize(num_channels_);
       symbol_prob_.resize(context_model_[0].NumContexts() * (MAX_SYMBOLS - 1));
     } else {
       context_model_.resize(1);
-      entropy_source_ = std::make_unique<EntropySource>();
+      entropy_source_ = std::make_unique<EntropySource>(
+          fast_clustering_, ecparams_.entropy_presets);
       data_stream_ = std::make_unique<DataStream>(entropy_source_.get());
       const size_t num_contexts =
           3 + kNumLSFContexts + context_model_[0].NumContexts();
@@ -458,13 +772,42 @@ void EntropyCoder::Reset() {
       if (ecparams_.arithmetic_only) {
         symbol_prob_.resize(num_contexts * (MAX_SYMBOLS - 1));
       }
+      substreams_.clear();
+      if (channel_substreams_) {
+        for (uint32_t ci = 0; ci < num_channels_; ++ci) {
+          substreams_.emplace_back(entropy_source_.get());
+          substreams_.back().symbol_prob.resize(symbol_prob_.size());
+        }
+      }
       memset(order_histo_, 0, sizeof(order_histo_));
       lsf_extra_bits_ = 0;
     }
   }
   num_samples_ = 0;
   arith_encode_.Reset();
+  arith_encode64_.Reset();
+  range_encode_.Reset();
   idx_ = 0;
+  num_segment_blocks_ = 0;
+  histograms_size_ = 0;
+  segment_start_ = 0;
+  segment_size_bytes_ = 0;
+  seek_table_.Reset();
+}
+
+void EntropyCoder::ReserveBlocks(size_t num_blocks) {
+  // Only the ANS mode buffers the code words of the blocks.
+  if (!data_stream_ || ecparams_.arithmetic_only) return;
+  if (segmented()) {
+    num_blocks = std::min<size_t>(num_blocks, ecparams_.segment_size);
+  }
+  if (channel_substreams_) {
+    for (Substream& substream : substreams_) {
+      substream.data_stream.ResizeForBlocks(num_blocks);
+    }
+  } else {
+    data_stream_->ResizeForBlocks(num_blocks * num_channels_);
+  }
 }
 
 void EntropyCoder::ProcessSamples(const int* samples, std::string* output) {
@@ -475,11 +818,24 @@ void EntropyCoder::ProcessSamples(const int* samples, std::string* output) {
     const int symbol =
         EncodeValue(val, kPredNumDirectAbsval, &nbits, &extra_bits);
     const int ctx = context_model_[ci].Context();
-    WriteSymbol(symbol, MAX_SYMBOLS, &symbol_prob_[ctx * (MAX_SYMBOLS - 1)],
-                &arith_encode_, output);
-    for (int b = 0; b < nbits; ++b) {
-      arith_encode_.AddBit(128, (extra_bits >> b) & 1, output,
-                           AppendUint16ToString);
+    if (range_coding()) {
+      AdaptiveDistribution* const dist = &symbol_dist_[ctx];
+      uint32_t start, size;
+      dist->GetInterval(symbol, &start, &size);
+      range_encode_.AddSymbol(start, size, dist->total(), output,
+                              AppendUint16ToString);
+      dist->Add(symbol);
+      if (nbits > 0) {
+        range_encode_.AddBits(nbits, extra_bits, output, AppendUint16ToString);
+      }
+    } else if (wide_arithmetic_coding()) {
+      WriteArithmeticValue(ecparams_, symbol, nbits, extra_bits,
+                           &symbol_prob_[ctx * (MAX_SYMBOLS - 1)],
+                           &arith_encode64_, output);
+    } else {
+      WriteArithmeticValue(ecparams_, symbol, nbits, extra_bits,
+                           &symbol_prob_[ctx * (MAX_SYMBOLS - 1)],
+                           &arith_encode_, output);
     }
     context_model_[ci].Add(val);
   }
@@ -492,67 +848,88 @@ void EntropyCoder::ProcessSamples(const int* samples, std::string* output) {
   }
 }
 
-bool EntropyCoder::ProcessPredictiveBlock(const RingliBlock& block,
-                                          std::string* output) {
-  for (uint32_t ci = 0; ci < num_channels_; ++ci) {
-    data_stream_->ResizeForBlock();
-    const auto& header = block.header.pred[ci];
-    if (!online_) {
-      const int order = header.quant_lsf.size();
-      if (ecparams_.arithmetic_only) {
-        WriteSymbol(order, MAX_SYMBOLS, &symbol_prob_[2 * (MAX_SYMBOLS - 1)],
-                    &arith_encode_, output);
-      } else {
-        data_stream_->AddCode(order, 2);
-      }
-      ++order_histo_[order];
-      for (int p = 0; p < order; ++p) {
-        const int pred_lsf = p * (kLSFQuant[p] / order);
-        const int residual = header.quant_lsf[p] - pred_lsf;
-        int nbits = 0;
-        int extra_bits = 0;
-        const int symbol = EncodeValue(residual, 16, &nbits, &extra_bits);
-        const int ctx = 3 + LSFContext(p, order);
-        if (ecparams_.arithmetic_only) {
-          WriteSymbol(symbol, MAX_SYMBOLS,
-                      &symbol_prob_[ctx * (MAX_SYMBOLS - 1)], &arith_encode_,
+template <typename ArithmeticEncoder>
+void EntropyCoder::ProcessPredictiveChannel(
+    const RingliPredictiveHeader& header, const RingliVector& channel,
+    DataStream* data_stream, ArithmeticEncoder* arith_encode,
+    Prob* symbol_prob, std::string* output) {
+  data_stream->ResizeForBlock();
+  if (!online_) {
+    const int order = header.order;
+    if (ecparams_.arithmetic_only) {
+      WriteByteSymbol(ecparams_.gamma_symbols, order,
+                      &symbol_prob[2 * (MAX_SYMBOLS - 1)], arith_encode,
                       output);
-          for (int b = 0; b < nbits; ++b) {
-            arith_encode_.AddBit(128, (extra_bits >> b) & 1, output,
-                                 AppendUint16ToString);
-          }
-        } else {
-          data_stream_->AddCode(symbol, ctx);
-          if (nbits > 0) {
-            data_stream_->AddBits(nbits, extra_bits);
-          }
-        }
-        lsf_extra_bits_ += nbits;
-      }
+    } else {
+      data_stream->AddCode(order, 2);
     }
-    const auto& channel = block.channels[ci];
-    context_model_[0].Reset();
-    for (int i = 0; i < kRingliBlockSize; ++i) {
-      const int val = channel[i];
+    ++order_histo_[order];
+    for (int p = 0; p < order; ++p) {
+      const int pred_lsf = p * (kLSFQuant[p] / order);
+      const int residual = header.quant_lsf[p] - pred_lsf;
       int nbits = 0;
       int extra_bits = 0;
-      const int symbol =
-          EncodeValue(val, kPredNumDirectAbsval, &nbits, &extra_bits);
-      const int ctx = 3 + kNumLSFContexts + context_model_[0].Context();
+      const int symbol = EncodeValue(residual, 16, &nbits, &extra_bits);
+      const int ctx = 3 + LSFContext(p, order);
       if (ecparams_.arithmetic_only) {
-        WriteSymbol(symbol, MAX_SYMBOLS, &symbol_prob_[ctx * (MAX_SYMBOLS - 1)],
-                    &arith_encode_, output);
-        for (int b = 0; b < nbits; ++b) {
-          arith_encode_.AddBit(128, (extra_bits >> b) & 1, output,
-                               AppendUint16ToString);
-        }
+        WriteArithmeticValue(ecparams_, symbol, nbits, extra_bits,
+                             &symbol_prob[ctx * (MAX_SYMBOLS - 1)],
+                             arith_encode, output);
       } else {
-        data_stream_->AddCode(symbol, ctx);
+        data_stream->AddCode(symbol, ctx);
         if (nbits > 0) {
-          data_stream_->AddBits(nbits, extra_bits);
+          data_stream->AddBits(nbits, extra_bits);
         }
       }
-      context_model_[0].Add(val);
+      lsf_extra_bits_ += nbits;
+    }
+  }
+  context_model_[0].Reset();
+  for (int i = 0; i < kRingliBlockSize; ++i) {
+    const int val = channel[i];
+    int nbits = 0;
+    int extra_bits = 0;
+    const int symbol =
+        EncodeValue(val, kPredNumDirectAbsval, &nbits, &extra_bits);
+    const int ctx = 3 + kNumLSFContexts + context_model_[0].Context();
+    if (ecparams_.arithmetic_only) {
+      WriteArithmeticValue(ecparams_, symbol, nbits, extra_bits,
+                           &symbol_prob[ctx * (MAX_SYMBOLS - 1)], arith_encode,
+                           output);
+    } else {
+      data_stream->AddCode(symbol, ctx);
+      if (nbits > 0) {
+        data_stream->AddBits(nbits, extra_bits);
+      }
+    }
+    context_model_[0].Add(val);
+  }
+}
+
+bool EntropyCoder::ProcessPredictiveBlock(const RingliBlock& block,
+                                          std::string* output) {
+  for (uint32_t ci = 0; ci < num_channels_; ++ci) {
+    if (channel_substreams_) {
+      Substream& substream = substreams_[ci];
+      if (wide_arithmetic_coding()) {
+        ProcessPredictiveChannel(block.header.pred[ci], block.channels[ci],
+                                 &substream.data_stream,
+                                 &substream.arith_encode64,
+                                 substream.symbol_prob.data(), &substream.data);
+      } else {
+        ProcessPredictiveChannel(block.header.pred[ci], block.channels[ci],
+                                 &substream.data_stream,
+                                 &substream.arith_encode,
+                                 substream.symbol_prob.data(), &substream.data);
+      }
+    } else if (wide_arithmetic_coding()) {
+      ProcessPredictiveChannel(block.header.pred[ci], block.channels[ci],
+                               data_stream_.get(), &arith_encode64_,
+                               symbol_prob_.data(), output);
+    } else {
+      ProcessPredictiveChannel(block.header.pred[ci], block.channels[ci],
+                               data_stream_.get(), &arith_encode_,
+                               symbol_prob_.data(), output);
     }
   }
   return true;
@@ -560,51 +937,176 @@ bool EntropyCoder::ProcessPredictiveBlock(const RingliBlock& block,
 
 bool EntropyCoder::ProcessBlock(const RingliBlock& block, std::string* output) {
   num_samples_ += kRingliBlockSize * num_channels_;
-  if (predictive_) {
-    return ProcessPredictiveBlock(block, output);
+  if (!predictive_) {
+    return false;
+  }
+  if (segmented() && ecparams_.arithmetic_only && !channel_substreams_ &&
+      num_segment_blocks_ == 0) {
+    StartSegment(output);
+  }
+  if (!ProcessPredictiveBlock(block, output)) {
+    return false;
+  }
+  if (segmented() && ++num_segment_blocks_ == ecparams_.segment_size) {
+    WriteSegment(output);
+  }
+  return true;
+}
+
+void EntropyCoder::StartSegment(std::string* output) {
+  seek_table_.StartSegment(*output, entropy_source_.get());
+  segment_start_ = output->size();
+  segment_size_bytes_ = Base128Size(
+      MaxEntropyCodedDataSize(
+          NumPredictiveValues(ecparams_.segment_size, num_channels_)));
+  // Skip some bytes for the size of the arithmetic coded data.
+  output->resize(segment_start_ + segment_size_bytes_);
+}
+
+void EntropyCoder::FlushArithmeticEncoder(std::string* output) {
+  if (wide_arithmetic_coding()) {
+    arith_encode64_.Flush(output, AppendUint16ToString);
+  } else {
+    arith_encode_.Flush(output, AppendUint16ToString);
   }
-  return false;
+}
+
+void EntropyCoder::WriteSegment(std::string* output) {
+  if (channel_substreams_) {
+    WriteSubstreams(output);
+    return;
+  }
+  if (ecparams_.arithmetic_only) {
+    FlushArithmeticEncoder(output);
+    const size_t data_size =
+        output->size() - segment_start_ - segment_size_bytes_;
+    EncodeBase128Fix(data_size, segment_size_bytes_,
+                     reinterpret_cast<uint8_t*>(&(*output)[segment_start_]));
+    // The flush resets the arithmetic coder, and the next segment starts with
+    // the initial probabilities as well.
+    std::fill(symbol_prob_.begin(), symbol_prob_.end(), Prob());
+    num_segment_blocks_ = 0;
+    return;
+  }
+  const size_t max_compressed_size = MaxEntropyCodedDataSize(
+      NumPredictiveValues(num_segment_blocks_, num_channels_));
+  const size_t size_bytes = Base128Size(max_compressed_size);
+  seek_table_.StartSegment(*output, entropy_source_.get());
+  size_t pos = output->size();
+  output->resize(pos + max_compressed_size);
+  histograms_size_ += WriteEntropyCodedData(
+      ecparams_, size_bytes, /*with_data_size=*/true, entropy_source_.get(),
+      data_stream_.get(), output, &pos);
+  output->resize(pos);
+  entropy_source_->ClearHistograms();
+  data_stream_->Reset();
+  num_segment_blocks_ = 0;
+}
+
+void EntropyCoder::WriteSubstreams(std::string* output) {
+  seek_table_.StartSegment(*output, entropy_source_.get());
+  if (!ecparams_.arithmetic_only) {
+    // At most one 16-bit count per symbol of each histogram, the rest is for
+    // the context map.
+    const size_t max_histograms_size =
+        (3 + kNumLSFContexts + context_model_[0].NumContexts()) * MAX_SYMBOLS *
+            sizeof(uint16_t) +
+        (1 << 12);
+    const size_t size_bytes = Base128Size(max_histograms_size);
+    size_t pos = output->size();
+    output->resize(pos + size_bytes + max_histograms_size);
+    histograms_size_ += WriteHistograms(ecparams_, size_bytes,
+                                        entropy_source_.get(), output, &pos);
+    output->resize(pos);
+  }
+  // The substreams only share the entropy codes, so their code words are
+  // encoded in parallel.
+  const auto encode_substream = [this](size_t ci) {
+    Substream& substream = substreams_[ci];
+    if (ecparams_.arithmetic_only) {
+      if (wide_arithmetic_coding()) {
+        substream.arith_encode64.Flush(&substream.data, AppendUint16ToString);
+      } else {
+        substream.arith_encode.Flush(&substream.data, AppendUint16ToString);
+      }
+      std::fill(substream.symbol_prob.begin(), substream.symbol_prob.end(),
+                Prob());
+      return;
+    }
+    const size_t max_compressed_size = MaxEntropyCodedDataSize(
+        NumPredictiveValues(num_segment_blocks_, /*num_channels=*/1));
+    size_t pos = 0;
+    substream.data.resize(max_compressed_size);
+    substream.data_stream.EncodeCodeWords(
+        *entropy_source_, ecparams_,
+        reinterpret_cast<uint8_t*>(&substream.data[0]), &pos,
+        substream.data.size());
+    substream.data.resize(pos);
+    substream.data_stream.Reset();
+  };
+  if (pool_) {
+    pool_->ParallelFor(num_channels_, encode_substream);
+  } else {
+    for (uint32_t ci = 0; ci < num_channels_; ++ci) {
+      encode_substream(ci);
+    }
+  }
+  for (Substream& substream : substreams_) {
+    const size_t data_size = substream.data.size();
+    const size_t size_bytes = Base128Size(data_size);
+    const size_t pos = output->size();
+    output->resize(pos + size_bytes);
+    EncodeBase128Fix(data_size, size_bytes,
+                     reinterpret_cast<uint8_t*>(&(*output)[pos]));
+    output->append(substream.data);
+    substream.data.clear();
+  }
+  entropy_source_->ClearHistograms();
+  num_segment_blocks_ = 0;
 }
 
 bool EntropyCoder::Flush(std::string* output) {
+  if (segmented()) {
+    if (num_segment_blocks_ > 0) {
+      WriteSegment(output);
+    }
+    seek_table_.Write(output);
+    if (!ecparams_.arithmetic_only) {
+      const double duration =
+          1.0 * num_samples_ / num_channels_ / sampling_freq_;
+      PrintHistogram("predictor order", order_histo_, kMaxPredictorOrder + 1);
+      PrintSize("histograms", histograms_size_, duration);
+      size_t total_extra_bits = data_stream_->TotalExtraBits();
+      for (const Substream& substream : substreams_) {
+        total_extra_bits += substream.data_stream.TotalExtraBits();
+      }
+      PrintSize("extra bits", total_extra_bits / 8, duration);
+    }
+    return true;
+  }
+  if (range_coding()) {
+    range_encode_.Flush(output, AppendUint16ToString);
+    return true;
+  }
   if (ecparams_.arithmetic_only) {
-    arith_encode_.Flush(output, AppendUint16ToString);
+    FlushArithmeticEncoder(output);
     return true;
   }
   const double duration = 1.0 * num_samples_ / num_channels_ / sampling_freq_;
-  if (!ecparams_.arithmetic_only) {
-    entropy_source_->ClusterHistograms();
-  }
   PrintHistogram("predictor order", order_histo_, kMaxPredictorOrder + 1);
 
-  // TODO(szabadka) Improve on this bound.
-  const size_t max_compressed_size =
-      (num_samples_ * sizeof(int32_t)) + (1 << 12);
+  const size_t max_compressed_size = MaxEntropyCodedDataSize(num_samples_);
   const size_t size_bytes = Base128Size(max_compressed_size);
   const size_t data_start = output->size();
   output->resize(data_start + max_compressed_size);
   size_t pos = data_start;
 
-  if (!ecparams_.arithmetic_only) {
-    // Skip some bytes for the size of the histogram data.
-    pos += size_bytes;
-    uint8_t* storage = reinterpret_cast<uint8_t*>(&(*output)[pos]);
-    size_t storage_ix = 0;
-    WriteBitsPrepareStorage(storage_ix, storage);
-    entropy_source_->EncodeContextMap(&storage_ix, storage);
-    entropy_source_->BuildAndStoreEntropyCodes(&storage_ix, storage);
-    // Encode histogram data size before the histogram data.
-    const size_t histograms_size = (storage_ix + 7) >> 3;
-    EncodeBase128Fix(histograms_size, size_bytes,
-                     reinterpret_cast<uint8_t*>(&(*output)[data_start]));
-    pos += histograms_size;
-    PrintSize("histograms", histograms_size, duration);
-  }
-
-  const size_t compressed_data_start = pos;
-  data_stream_->EncodeCodeWords(*entropy_source_, ecparams_,
-                                reinterpret_cast<uint8_t*>(&(*output)[0]), &pos,
-                                output->size());
+  const size_t histograms_size = WriteEntropyCodedData(
+      ecparams_, size_bytes, /*with_data_size=*/false, entropy_source_.get(),
+      data_stream_.get(), output, &pos);
+  PrintSize("histograms", histograms_size, duration);
+  const size_t compressed_data_start =
+      data_start + size_bytes + histograms_size;
   const int total_extra_bits = data_stream_->TotalExtraBits();
   PrintSize("extra bits", total_extra_bits / 8, duration);
   PrintSize("entropy coded", pos - compressed_data_start - total_extra_bits / 8,
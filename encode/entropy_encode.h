@@ -19,13 +19,17 @@
 #include <string>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "common/context.h"
 #include "common/data_defs/constants.h"
 #include "common/distributions.h"
 #include "common/entropy_coding.h"
+#include "common/entropy_presets.h"
 #include "common/ringli_header.h"
+#include "common/thread_pool.h"
 #include "encode/ans_encode.h"
 #include "encode/arith_encode.h"
+#include "encode/range_encode.h"
 
 namespace ringli {
 
@@ -60,16 +64,43 @@ struct Histogram {
 // source.
 class EntropySource {
  public:
+  // If fast_clustering is set, the histograms are clustered with
+  // kFastClusteringCandidates candidate pairs per cluster. If entropy_presets
+  // is set, the contexts are the ones of the predictive mode, and the stored
+  // entropy codes can be built-in ones, see EntropyCodingParams.
+  explicit EntropySource(bool fast_clustering = false,
+                         bool entropy_presets = false)
+      : fast_clustering_(fast_clustering), entropy_presets_(entropy_presets) {}
+
   void Resize(int num_contexts) { histograms_.resize(num_contexts); }
 
   void AddCode(int code, int histo_ix) { histograms_[histo_ix].Add(code); }
 
+  // Starts collecting the histograms of the next segment, the entropy codes
+  // of the current one are kept.
+  void ClearHistograms();
+
+  // Drops the entropy codes of the current segment, so that the next segment
+  // stores its own ones.
+  void ClearEntropyCodes();
+
   void ClusterHistograms();
 
   void EncodeContextMap(size_t* storage_ix, uint8_t* storage) const;
 
   void BuildAndStoreEntropyCodes(size_t* storage_ix, uint8_t* storage);
 
+  // Clusters the histograms and stores the context map and entropy codes
+  // built from them. With entropy presets, stores the index of the built-in
+  // entropy code instead if that encodes the histograms with fewer bits, and
+  // skips the clustering if the built-in code costs at most the entropy of
+  // the histograms. If allow_reuse is set and the entropy codes of the
+  // previous segment encode the histograms with fewer bits than the new codes
+  // together with their stored size, keeps the previous codes, rewinds
+  // storage_ix and returns false.
+  bool StoreOrReuseEntropyCodes(bool allow_reuse, size_t* storage_ix,
+                                uint8_t* storage);
+
   const ANSTable* GetANSTable(int context) const {
     const int entropy_ix = context_map_[context];
     return &ans_tables_[entropy_ix];
@@ -80,11 +111,43 @@ class EntropySource {
   double ClusteredEntropy(int histo_idx);
 
  private:
+  // Returns the number of bits needed to encode the histograms with the
+  // current entropy codes, or infinity if some symbol can not be encoded.
+  double EntropyCodesCost() const;
+
+  // Non-zero count of a symbol in the histogram of a context.
+  struct HistogramEntry {
+    uint32_t context;
+    int symbol;
+    int count;
+  };
+
+  // Returns the non-zero entries of the histograms.
+  std::vector<HistogramEntry> HistogramEntries() const;
+
+  // Returns the number of bits needed to encode the histogram entries with
+  // the built-in entropy code, or infinity if some symbol can not be encoded.
+  double EntropyPresetCost(const std::vector<HistogramEntry>& entries,
+                           int preset_idx) const;
+
+  // Returns the sum of the entropies of the histograms, a lower bound of the
+  // number of bits needed to encode them with any entropy codes.
+  double HistogramsEntropy() const;
+
+  // Replaces the entropy codes with the built-in ones.
+  void UseEntropyPreset(const EntropyPreset& preset);
+
   static constexpr int kMaxNumberOfHistograms = 256;
+  const bool fast_clustering_;
+  const bool entropy_presets_;
   std::vector<Histogram> histograms_;
   std::vector<Histogram> clustered_;
   std::vector<uint32_t> context_map_;
   std::vector<ANSTable> ans_tables_;
+  // Entropy codes of the previous segment while the new ones are evaluated.
+  std::vector<Histogram> prev_clustered_;
+  std::vector<uint32_t> prev_context_map_;
+  std::vector<ANSTable> prev_ans_tables_;
 };
 
 // Manages the multiplexing of the ANS-coded and arithmetic coded bits.
@@ -92,12 +155,19 @@ class DataStream {
  public:
   explicit DataStream(EntropySource* entropy_source);
 
+  // Starts the code words of a new segment, keeping the allocated storage.
+  void Reset();
+
   void Resize(int max_num_code_words) {
     code_words_.resize(max_num_code_words);
   }
 
   void ResizeForBlock();
 
+  // Makes room for the code words of num_blocks channel blocks, so that
+  // ResizeForBlock() does not have to grow the storage until then.
+  void ResizeForBlocks(size_t num_blocks);
+
   void AddCode(int code, int context);
 
   void AddBits(int nbits, int bits);
@@ -137,6 +207,8 @@ class DataStream {
     data[(*pos)++] = val >> 8;
   }
 
+  // Number of ANS coded symbols.
+  size_t num_symbols_;
   int pos_;
   int bw_pos_;
   int ac_pos0_;
@@ -150,13 +222,45 @@ class DataStream {
   size_t total_extra_bits_;
 };
 
+// Collects the byte offsets of the seek points of a segmented stream and
+// writes the seek table: the offsets as base-128 coded differences, followed
+// by the size of the table as a 32-bit little-endian integer.
+class SeekTableWriter {
+ public:
+  // A zero seek_interval means that the stream has no seek table.
+  explicit SeekTableWriter(size_t seek_interval)
+      : seek_interval_(seek_interval) {}
+
+  void Reset();
+
+  // Called before a segment is appended to output. At the seek points the
+  // offset of the segment is recorded, and the segment is made independent of
+  // the previous ones by dropping the entropy codes of entropy_source.
+  void StartSegment(const std::string& output, EntropySource* entropy_source);
+
+  // Appends the seek table to output if the stream has one.
+  void Write(std::string* output) const;
+
+ private:
+  size_t seek_interval_;
+  size_t num_segments_ = 0;
+  std::vector<size_t> offsets_;
+};
+
 class EntropyCoder {
  public:
+  // If pool is not null, the channel substreams of a segment are encoded on
+  // it. See EntropySource for fast_clustering.
   EntropyCoder(const EntropyCodingParams& ecparams, uint32_t sampling_freq,
-               uint32_t num_channels, bool predictive, bool online);
+               uint32_t num_channels, bool predictive, bool online,
+               bool fast_clustering = false, ThreadPool* pool = nullptr);
 
   void Reset();
 
+  // Allocates the storage of the code words of num_blocks blocks, or of one
+  // segment if that is shorter, so that ProcessBlock() does not grow it.
+  void ReserveBlocks(size_t num_blocks);
+
   bool ProcessBlock(const RingliBlock& block, std::string* output);
 
   void ProcessSamples(const int* samples, std::string* output);
@@ -165,27 +269,83 @@ class EntropyCoder {
 
  private:
   bool ProcessPredictiveBlock(const RingliBlock& block, std::string* output);
+  template <typename ArithmeticEncoder>
+  void ProcessPredictiveChannel(const RingliPredictiveHeader& header,
+                                const RingliVector& channel,
+                                DataStream* data_stream,
+                                ArithmeticEncoder* arith_encode,
+                                Prob* symbol_prob, std::string* output);
+  bool segmented() const {
+    return ecparams_.segment_size > 0 &&
+           !(online_ && ecparams_.arithmetic_only);
+  }
+  bool range_coding() const {
+    return online_ && ecparams_.arithmetic_only && ecparams_.range_coding;
+  }
+  bool wide_arithmetic_coding() const {
+    return ecparams_.arithmetic_only && ecparams_.wide_arithmetic_coding;
+  }
+  // Finishes the data of the arithmetic coder of the arithmetic-only mode.
+  void FlushArithmeticEncoder(std::string* output);
+  // Reserves the bytes for the size of the segment in arithmetic-only mode.
+  void StartSegment(std::string* output);
+  // Appends the ANS coded data of the blocks since the previous segment, or
+  // finishes the arithmetic coded data of the segment.
+  void WriteSegment(std::string* output);
+  // Appends the histograms of the segment in ANS mode, followed by the size
+  // and data of each channel substream.
+  void WriteSubstreams(std::string* output);
+
+  // Entropy coder state of one channel in the channel substreams mode.
+  struct Substream {
+    explicit Substream(EntropySource* entropy_source)
+        : data_stream(entropy_source) {}
+    DataStream data_stream;
+    BinaryArithmeticEncoder arith_encode;
+    BinaryArithmeticEncoder64 arith_encode64;
+    std::vector<Prob> symbol_prob;
+    // Encoded data of the current segment.
+    std::string data;
+  };
 
   EntropyCodingParams ecparams_;
   uint32_t sampling_freq_;
   uint32_t num_channels_;
   bool predictive_;
   bool online_;
+  bool fast_clustering_;
+  bool channel_substreams_;
+  ThreadPool* pool_;
   BinaryArithmeticEncoder arith_encode_;
+  BinaryArithmeticEncoder64 arith_encode64_;
+  RangeEncoder range_encode_;
   std::unique_ptr<EntropySource> entropy_source_;
   std::unique_ptr<DataStream> data_stream_;
   std::vector<PredictiveContextModel> context_model_;
   std::vector<Prob> symbol_prob_;
+  std::vector<AdaptiveDistribution> symbol_dist_;
+  std::vector<Substream> substreams_;
   int order_histo_[kMaxPredictorOrder + 1];
   int lsf_extra_bits_;
   uint32_t num_samples_;
   size_t idx_;
+  // Number of blocks in the current segment, the total size of the histogram
+  // data of the segmented mode, and the position and number of bytes of the
+  // size of the current arithmetic coded segment.
+  size_t num_segment_blocks_;
+  size_t histograms_size_;
+  size_t segment_start_;
+  size_t segment_size_bytes_;
+  SeekTableWriter seek_table_;
 };
 
-bool CompressCoefficients(const std::vector<RingliBlock>& ringli_blocks,
+// Appends the entropy coded coefficients of ringli_blocks to output. In the
+// segmented mode the blocks form one segment, and entropy_source keeps the
+// entropy codes between the segments.
+bool CompressCoefficients(absl::Span<const RingliBlock> ringli_blocks,
                           size_t num_channels,
                           const EntropyCodingParams& ecparams,
-                          std::string* output);
+                          EntropySource* entropy_source, std::string* output);
 
 }  // namespace ringli
 
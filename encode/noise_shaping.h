@@ -19,7 +19,7 @@
 #include <stdint.h>
 
 #include <algorithm>
-#include <vector>
+#include <array>
 
 #include "absl/log/check.h"
 #include "common/data_defs/constants.h"
@@ -28,7 +28,7 @@ namespace ringli {
 
 class NoiseShaper {
  public:
-  NoiseShaper() : position_(0), noise_buffer_(kShapingFilterOrder, 0) {}
+  NoiseShaper() : position_(0), noise_buffer_{} {}
 
   void Reset() {
     position_ = 0;
@@ -41,7 +41,7 @@ class NoiseShaper {
 
  private:
   uint32_t position_;
-  std::vector<float> noise_buffer_;
+  std::array<float, kShapingFilterOrder> noise_buffer_;
 };
 
 }  // namespace ringli
@@ -0,0 +1,101 @@
+// Copyright 2024 The Ringli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENCODE_RANGE_ENCODE_H_
+#define ENCODE_RANGE_ENCODE_H_
+
+#include <stdint.h>
+
+namespace ringli {
+
+// Multi-symbol range encoder with 64-bit precision and 16-bit output words.
+// The [low_, high_] interval is narrowed to the subinterval of each coded
+// symbol, and the leading 16 bits are written out as soon as they are the
+// same for the whole interval. An interval that stays short without settling
+// its leading 16 bits is cut down to the part before the 48-bit boundary it
+// straddles, so that the interval is always at least 2^32 wide when coding a
+// symbol, and symbol totals of up to 2^32 are exact to within a 2^-32 part of
+// the interval.
+class RangeEncoder {
+ public:
+  RangeEncoder() { Reset(); }
+
+  void Reset() {
+    low_ = 0;
+    high_ = ~0;
+    num_words_ = kNumWindowWords;
+  }
+
+  typedef void (*Output)(void* opaque, uint16_t val);
+
+  // Codes the symbol with the interval [start, start + size) of [0, total).
+  void AddSymbol(uint32_t start, uint32_t size, uint32_t total, void* opaque,
+                 Output output) {
+    const uint64_t r = (high_ - low_) / total;
+    high_ = low_ + r * (start + size) - 1;
+    low_ += r * start;
+    num_words_ = 0;
+    while (NeedsWord()) {
+      output(opaque, high_ >> 48);
+      low_ <<= 16;
+      high_ = (high_ << 16) | 0xffff;
+      ++num_words_;
+    }
+  }
+
+  // Codes the nbits lowest bits of bits with equal probabilities, in chunks of
+  // at most 16 bits starting with the lowest ones.
+  void AddBits(int nbits, uint32_t bits, void* opaque, Output output) {
+    while (nbits > 0) {
+      const int n = nbits < 16 ? nbits : 16;
+      AddSymbol(bits & ((1u << n) - 1), 1, 1u << n, opaque, output);
+      bits >>= n;
+      nbits -= n;
+    }
+  }
+
+  // Writes only as many words as the decoder needs to read the last symbol,
+  // so that it does not read any symbols past the end of the data.
+  void Flush(void* opaque, Output output) {
+    for (int shift = 48; num_words_ < kNumWindowWords; shift -= 16) {
+      output(opaque, low_ >> shift);
+      ++num_words_;
+    }
+    Reset();
+  }
+
+ private:
+  static constexpr uint64_t kMinRange = 1ull << 32;
+  // Number of words in the 64-bit window of the decoder.
+  static constexpr int kNumWindowWords = 4;
+
+  // Cuts a short interval down to the part before the 48-bit boundary it
+  // straddles, and returns true if the leading 16 bits of the interval are
+  // settled.
+  bool NeedsWord() {
+    if (((low_ ^ high_) >> 48) != 0 && high_ - low_ < kMinRange) {
+      high_ = (high_ & ~((1ull << 48) - 1)) - 1;
+    }
+    return ((low_ ^ high_) >> 48) == 0;
+  }
+
+  uint64_t low_;
+  uint64_t high_;
+  // Number of words written after the last symbol.
+  int num_words_;
+};
+
+}  // namespace ringli
+
+#endif  // ENCODE_RANGE_ENCODE_H_
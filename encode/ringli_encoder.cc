@@ -23,12 +23,15 @@
 #include <cmath>
 #include <cstdlib>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/log/check.h"
+#include "absl/types/span.h"
+#include "common/ac_prediction.h"
 #include "common/block_predictor.h"
-#include "common/convolve.h"
 #include "common/covariance_lattice.h"
 #include "common/data_defs/constants.h"
 #include "common/data_defs/data_vector.h"
@@ -39,6 +42,7 @@
 #include "common/online_predictor.h"
 #include "common/predictor.h"
 #include "common/ringli_header.h"
+#include "common/thread_pool.h"
 #include "common/wav_header.h"
 #include "common/wav_reader.h"
 #include "encode/entropy_encode.h"
@@ -47,6 +51,10 @@
 namespace ringli {
 namespace {
 
+// Upper limit of the number of blocks per worker thread that are waiting to
+// be encoded or to be passed to the entropy coder.
+constexpr size_t kMaxPendingBlocksPerThread = 4;
+
 int QuantizationBySignal(double mean_signal,
                          const RingliEncoderConfig& config) {
   return round(config.quantization_curve.GetValue(mean_signal));
@@ -111,47 +119,54 @@ void CalculateQuantization(const AudioBlock& channels,
   }
 }
 
-RingliBlock EncodePredictive(const RingliEncoderConfig& config,
-                             const AudioBlock& block) {
+template <typename PredictorType>
+void EncodeOnlinePredictive(const RingliEncoderConfig& config,
+                            const RingliVector& input,
+                            PredictorType* predictor, RingliVector* residuals) {
+  const int quant = config.dconfig.pred_quant;
+  NoiseShaper noise_shaper;
+  const float iquant = 1.0 / quant;
+  for (int i = 0; i < kRingliBlockSize; i++) {
+    float prediction = predictor->Predict();
+    if (quant == 1) prediction = std::round(prediction);
+    double sample = input[i];
+    if (config.use_noise_shaping) {
+      float filtered_noise = noise_shaper.GetFilteredNoise();
+      sample += filtered_noise;
+    }
+    const float error = sample - prediction;
+    (*residuals)[i] = std::round(error * iquant);
+    const float sample_deq = prediction + quant * (*residuals)[i];
+    predictor->AddNewSample(sample_deq);
+    if (config.use_noise_shaping) {
+      noise_shaper.AddNewSample(sample_deq - sample);
+    }
+  }
+}
+
+// Overwrites all the fields of encoded_block that are used by the
+// predictive modes, so the same block can be reused for every input block.
+void EncodePredictive(const RingliEncoderConfig& config,
+                      const AudioBlock& block, RingliBlock* encoded_block) {
   const size_t num_channels = block.GetChannels().size();
   const int quant = config.dconfig.pred_quant;
   const int order_min = config.pred_order_min;
   const int order_max = config.pred_order_max;
   CHECK_GE(order_min, 2);
   CHECK_LE(order_max, kMaxPredictorOrder);
-  RingliBlock encoded_block(num_channels);
-  double sample;
   const auto& num_bits = [&](int residual) {
     return residual == 0 ? 0 : Log2FloorNonZero(std::abs(residual) + 1);
   };
   for (size_t c = 0; c < num_channels; ++c) {
     if (config.dconfig.use_online_predictive_coding) {
-      const bool fast_mode = config.dconfig.predictor_fast_mode();
-      std::unique_ptr<Predictor> predictor;
-      if (fast_mode) {
-        predictor = std::make_unique<FastOnlinePredictor>();
+      if (config.dconfig.predictor_fast_mode()) {
+        FastOnlinePredictor predictor;
+        EncodeOnlinePredictive(config, block[c], &predictor,
+                               &encoded_block->channels[c]);
       } else {
-        predictor =
-            std::make_unique<OnlinePredictor>(kOnlinePredictorRegulariser);
-      }
-      NoiseShaper noise_shaper;
-      const float iquant = 1.0 / quant;
-      for (int i = 0; i < kRingliBlockSize; i++) {
-        float prediction = predictor->Predict();
-        if (quant == 1) prediction = std::round(prediction);
-        sample = block[c][i];
-        if (config.use_noise_shaping) {
-          float filtered_noise = noise_shaper.GetFilteredNoise();
-          sample += filtered_noise;
-        }
-        const float error = sample - prediction;
-        encoded_block.channels[c][i] = std::round(error * iquant);
-        const float sample_deq =
-            prediction + quant * encoded_block.channels[c][i];
-        predictor->AddNewSample(sample_deq);
-        if (config.use_noise_shaping) {
-          noise_shaper.AddNewSample(sample_deq - sample);
-        }
+        OnlinePredictor predictor(kOnlinePredictorRegulariser);
+        EncodeOnlinePredictive(config, block[c], &predictor,
+                               &encoded_block->channels[c]);
       }
     } else {
       RingliVector best_residuals;
@@ -161,37 +176,63 @@ RingliBlock EncodePredictive(const RingliEncoderConfig& config,
       double regulariser = (quant * quant) * (1.0 / 12.0);
       CovarianceLattice<int32_t> covlattice_orig(
           block[c].Data(), kRingliBlockSize, kMaxPredictorOrder, regulariser);
+      int orders[kMaxPredictorOrder];
+      int num_orders = 0;
       for (int order = order_min; order <= order_max; order += 2) {
-        RingliPredictiveHeader& header = encoded_block.header.pred[c];
+        orders[num_orders++] = order;
+      }
+      const int num_trials = config.num_order_trials();
+      if (num_trials > 0 && num_trials < num_orders) {
+        // Each halving of the residual energy saves about half a bit per
+        // sample, the trials below use the same penalty for the order.
+        covlattice_orig.FitCoeffsCommon(orders[num_orders - 1]);
+        double estimated_score[kMaxPredictorOrder + 1];
+        for (int t = 0; t < num_orders; ++t) {
+          const int order = orders[t];
+          estimated_score[order] =
+              0.5 * kRingliBlockSize *
+                  std::log2(covlattice_orig.ResidualEnergy(order)) +
+              order * 1.5;
+        }
+        std::partial_sort(orders, orders + num_trials, orders + num_orders,
+                          [&](int a, int b) {
+                            return estimated_score[a] < estimated_score[b];
+                          });
+        num_orders = num_trials;
+      }
+      for (int t = 0; t < num_orders; ++t) {
+        const int order = orders[t];
+        RingliPredictiveHeader& header = encoded_block->header.pred[c];
         int total_num_bits = 0;
         float iquant = 1.0 / quant;
         BlockPredictor<kRingliBlockSize> block_predictor =
             BlockPredictor<kRingliBlockSize>::CreateForEncoder(order, &header,
                                                                covlattice_orig);
         if (quant == 1) {
+          float predictions[kRingliBlockSize];
+          block_predictor.PredictBlock(block[c].Data(), predictions);
           for (int i = 0; i < kRingliBlockSize; i++) {
-            const float prediction = std::round(block_predictor.Predict());
-            block_predictor.AddNewSample(block[c][i]);
-            encoded_block.channels[c][i] = block[c][i] - prediction;
-            total_num_bits += num_bits(encoded_block.channels[c][i]);
+            const float prediction = std::round(predictions[i]);
+            encoded_block->channels[c][i] = block[c][i] - prediction;
+            total_num_bits += num_bits(encoded_block->channels[c][i]);
           }
         } else {
           for (int i = 0; i < kRingliBlockSize; i++) {
             const float prediction = block_predictor.Predict();
             const float error = block[c][i] - prediction;
-            encoded_block.channels[c][i] = std::round(error * iquant);
+            encoded_block->channels[c][i] = std::round(error * iquant);
             const float sample_deq =
-                prediction + quant * encoded_block.channels[c][i];
+                prediction + quant * encoded_block->channels[c][i];
             block_predictor.AddNewSample(sample_deq);
-            total_num_bits += num_bits(encoded_block.channels[c][i]);
+            total_num_bits += num_bits(encoded_block->channels[c][i]);
           }
         }
         double score = total_num_bits + order * 1.5;
         if (best_score == 0 || score < best_score) {
           best_score = score;
-          if (order < order_max) {
+          if (t + 1 < num_orders) {
             best_header = header;
-            best_residuals = encoded_block.channels[c];
+            best_residuals = encoded_block->channels[c];
           }
           last_is_best = true;
         } else {
@@ -199,19 +240,20 @@ RingliBlock EncodePredictive(const RingliEncoderConfig& config,
         }
       }
       if (!last_is_best) {
-        encoded_block.channels[c] = best_residuals;
-        encoded_block.header.pred[c] = best_header;
+        encoded_block->channels[c] = best_residuals;
+        encoded_block->header.pred[c] = best_header;
       }
     }
   }
-  return encoded_block;
 }
 
-RingliBlock EncodeWithDCT(const RingliEncoderConfig& config,
-                          const DCT<kDctLength>& dct, const AudioBlock& prev,
-                          const AudioBlock& current, const AudioBlock& next) {
+// Overwrites all the fields of encoded_block that are used by the DCT mode,
+// so the same block can be reused for every input block.
+void EncodeWithDCT(const RingliEncoderConfig& config,
+                   const DCT<kDctLength>& dct, const AudioBlock& prev,
+                   const AudioBlock& current, const AudioBlock& next,
+                   RingliBlock* encoded_block) {
   const size_t num_channels = current.GetChannels().size();
-  RingliBlock encoded_block(num_channels);
 
   RingliDCTHeader prev_header;
   RingliDCTHeader curr_header;
@@ -220,8 +262,9 @@ RingliBlock EncodeWithDCT(const RingliEncoderConfig& config,
   CalculateQuantization(current, config, curr_header);
   CalculateQuantization(next, config, next_header);
 
+  const ACPredictionOperator& ac_prediction = GetACPredictionOperator();
   for (size_t c = 0; c < num_channels; ++c) {
-    DataVector<double, kACPredictionWindowSize> coeff_window;
+    ACPredictionWindow coeff_window;
     for (int i = 0; i < kACPredictionWindowSize; ++i) {
       if (i < kACPredictionBorder) {
         coeff_window[i] = prev[c][kRingliBlockSize - kACPredictionBorder + i];
@@ -242,8 +285,8 @@ RingliBlock EncodeWithDCT(const RingliEncoderConfig& config,
         coeff_window[i + k] = dct_data[k];
       }
     }
-    DataVector<double, kACPredictionWindowSize> predictor_window;
-    DataVector<double, kACPredictionWindowSize> output_window;
+    ACPredictionWindow predictor_window;
+    ACPredictionWindow prediction;
     int prev_k_limit = 0;
     for (int step = 0; step <= kNumACPredictionSteps; ++step) {
       int k_limit = step == kNumACPredictionSteps ? kDctLength
@@ -259,54 +302,37 @@ RingliBlock EncodeWithDCT(const RingliEncoderConfig& config,
           int32_t icoef = std::round(qcoef);
           if (i >= kACPredictionBorder &&
               i < kRingliBlockSize + kACPredictionBorder) {
-            encoded_block.channels[c][i - kACPredictionBorder + k] = icoef;
+            encoded_block->channels[c][i - kACPredictionBorder + k] = icoef;
           }
           if (step < kNumACPredictionSteps) {
             coeff_window[i + k] = icoef * quant + predictor_window[i + k];
           }
         }
-        if (step < kNumACPredictionSteps) {
-          DataVector<double, kDctLength> dct_data;
-          for (int k = 0; k < k_limit; ++k) {
-            dct_data[k] = coeff_window[i + k];
-          }
-          const DataVector<double, kDctLength> signal_data =
-              dct.ApplyInverseDCT(dct_data);
-          for (int k = 0; k < kDctLength; ++k) {
-            output_window[i + k] = signal_data[k];
-          }
-        }
       }
       if (step == kNumACPredictionSteps) {
         break;
       }
-      output_window =
-          Convolve(GaussianKernel<kDctLength>(kACPredictionSigma / k_limit),
-                   output_window);
+      ac_prediction.Apply(step, coeff_window, &prediction);
       for (int i = 0; i < kACPredictionWindowSize; i += kDctLength) {
-        DataVector<double, kDctLength> signal_data;
-        for (int k = 0; k < kDctLength; ++k) {
-          signal_data[k] = output_window[i + k];
-        }
-        const DataVector<double, kDctLength> dct_data =
-            dct.ApplyDirectDCT(signal_data);
         for (int k = k_limit; k < 2 * k_limit; ++k) {
-          predictor_window[i + k] += dct_data[k];
-          coeff_window[i + k] -= dct_data[k];
+          predictor_window[i + k] += prediction[i + k];
+          coeff_window[i + k] -= prediction[i + k];
         }
       }
       prev_k_limit = k_limit;
     }
   }
-  encoded_block.header.dct = curr_header;
-  return encoded_block;
+  encoded_block->header.dct = curr_header;
 }
 
 }  // namespace
 
 StreamingRingliEncoder::StreamingRingliEncoder(
     const RingliEncoderConfig& config)
-    : config_(config) {
+    : config_(config),
+      seek_table_(config.dconfig.has_seek_table()
+                      ? config.dconfig.ecparams.seek_interval
+                      : 0) {
   format_.format_chunk_size = 0;
   wav_reader_.RegisterCallback("fmt ", this, ParseFormatCb,
                                sizeof(FormatChunk));
@@ -317,8 +343,12 @@ void StreamingRingliEncoder::Reset() {
   wav_reader_.Reset();
   format_.format_chunk_size = 0;
   output_pos_ = 0;
-  ringli_blocks_.clear();
-  ringli_headers_.clear();
+  WaitForPendingBlocks();
+  num_input_blocks_ = 0;
+  num_scheduled_blocks_ = 0;
+  num_processed_blocks_ = 0;
+  num_ringli_blocks_ = 0;
+  seek_table_.Reset();
 }
 
 bool StreamingRingliEncoder::ParseFormatCb(void* opaque, const uint8_t* data,
@@ -346,33 +376,53 @@ void StreamingRingliEncoder::InitForFormat() {
   const size_t block_size = (fully_streaming ? 1 : kRingliBlockSize) *
                             num_channels * bytes_per_sample;
   wav_reader_.RegisterCallback("data", this, ProcessDataCb, block_size);
+  if (config_.num_threads > 0 && !fully_streaming && !pool_) {
+    pool_ = std::make_unique<ThreadPool>(config_.num_threads);
+  }
+  if (!fully_streaming) {
+    // The DCT mode schedules block n after input block n + 1 is read, and at
+    // most max_pending blocks wait to be processed after that, so the input
+    // blocks that a pending block still reads fit in the ring.
+    const size_t max_pending =
+        pool_ ? kMaxPendingBlocksPerThread * pool_->NumThreads() : 0;
+    const size_t ring_size = max_pending + 3;
+    // The block before the first one is zero, i.e. the last entry of the
+    // ring, which is overwritten only after the first block is encoded.
+    input_blocks_.assign(ring_size, AudioBlock(num_channels));
+    encoded_blocks_.assign(ring_size, RingliBlock(num_channels));
+    block_done_.assign(ring_size, 0);
+  }
   if (!config_.dconfig.use_predictive_coding) {
     dct_ = std::make_unique<DCT<kDctLength>>();
-    prev_ = std::make_unique<AudioBlock>(num_channels);
-    current_ = std::make_unique<AudioBlock>(num_channels);
-    next_ = std::make_unique<AudioBlock>(num_channels);
+    entropy_source_ =
+        std::make_unique<EntropySource>(config_.fast_clustering());
   } else {
+    encoded_samples_.resize(num_channels);
     entropy_coder_ = std::make_unique<EntropyCoder>(
         config_.dconfig.ecparams, format_.sampling_frequency, num_channels,
         config_.dconfig.use_predictive_coding,
-        config_.dconfig.use_online_predictive_coding);
+        config_.dconfig.use_online_predictive_coding,
+        config_.fast_clustering(), pool_.get());
     if (fully_streaming) {
-      const bool fast_mode = config_.dconfig.predictor_fast_mode();
       idx_ = 0;
-      for (int i = 0; i < num_channels; ++i) {
-        if (fast_mode) {
-          predictors_.emplace_back(std::make_unique<FastOnlinePredictor>());
-        } else {
-          predictors_.emplace_back(
+      if (config_.dconfig.predictor_fast_mode()) {
+        predictor_ = std::make_unique<FastOnlinePredictorBank>(num_channels);
+      } else {
+        std::vector<std::unique_ptr<Predictor>> predictors;
+        for (int i = 0; i < num_channels; ++i) {
+          predictors.emplace_back(
               std::make_unique<OnlinePredictor>(kOnlinePredictorRegulariser));
         }
+        predictor_ =
+            std::make_unique<PerChannelPredictor>(std::move(predictors));
       }
+      predictions_.resize(num_channels);
+      dequantized_samples_.resize(num_channels);
 
       noise_shapers_.resize(num_channels);
       adaptive_quantizers_.resize(num_channels);
 
       for (size_t c = 0; c < num_channels; ++c) {
-        predictors_[c]->Reset();
         noise_shapers_[c].Reset();
         adaptive_quantizers_[c].Reset();
       }
@@ -401,7 +451,15 @@ bool StreamingRingliEncoder::ProcessData(const uint8_t* data, size_t len,
         config_.dconfig.ecparams.arithmetic_only) {
       const size_t num_channels = format_.number_of_channels;
       const size_t bytes_per_sample = format_.bits_per_sample / 8;
-      std::vector<int> encoded(num_channels);
+      int* encoded = encoded_samples_.data();
+      float* predictions = predictions_.data();
+      float* samples_deq = dequantized_samples_.data();
+      // Like in the other predictive modes, the lossless mode rounds the
+      // predictions, so that the decoder can reproduce the samples exactly.
+      const bool round_predictions =
+          !config_.dconfig.use_adaptive_quantization &&
+          config_.dconfig.pred_quant == 1;
+      predictor_->Predict(predictions);
       for (int ci = 0; ci < num_channels; ++ci) {
         int16_t value;
         memcpy(&value, &data[ci * bytes_per_sample], bytes_per_sample);
@@ -420,11 +478,12 @@ bool StreamingRingliEncoder::ProcessData(const uint8_t* data, size_t len,
         const float iquant = 1.0f / quant;
         // printf("idx %d, c %d, quant: %f\n", int(idx_), ci, quant);
 
-        const float prediction = predictors_[ci]->Predict();
+        float prediction = predictions[ci];
+        if (round_predictions) prediction = std::round(prediction);
         const float error = sample - prediction;
         encoded[ci] = std::round(error * iquant);
         const float sample_deq = prediction + quant * encoded[ci];
-        predictors_[ci]->AddNewSample(sample_deq);
+        samples_deq[ci] = sample_deq;
         if (config_.dconfig.use_adaptive_quantization) {
           adaptive_quantizers_[ci].ProcessSample(sample_deq);
         }
@@ -432,28 +491,24 @@ bool StreamingRingliEncoder::ProcessData(const uint8_t* data, size_t len,
           noise_shapers_[ci].AddNewSample(sample_deq - sample);
         }
       }
-      entropy_coder_->ProcessSamples(encoded.data(), &ringli_data_);
+      predictor_->AddNewSamples(samples_deq);
+      entropy_coder_->ProcessSamples(encoded, &ringli_data_);
       ++idx_;
       if (idx_ == kRingliBlockSize) {
         idx_ = 0;
+        predictor_->Reset();
         for (int ci = 0; ci < num_channels; ++ci) {
-          predictors_[ci]->Reset();
           adaptive_quantizers_[ci].Reset();
         }
       }
     } else {
-      AudioBlock block(format_.number_of_channels);
-      CopyBlock(data, len, &block);
-      return entropy_coder_->ProcessBlock(EncodePredictive(config_, block),
-                                          &ringli_data_);
+      CopyBlock(data, len, NextInputBlock());
+      return EncodeNextBlock();
     }
-  } else if (chunk_pos == 0) {
-    CopyBlock(data, len, current_.get());
   } else {
-    CopyBlock(data, len, next_.get());
-    ProcessBlock(EncodeWithDCT(config_, *dct_, *prev_, *current_, *next_));
-    *prev_ = *current_;
-    *current_ = *next_;
+    CopyBlock(data, len, NextInputBlock());
+    // The DCT of a block needs the next block too.
+    return chunk_pos == 0 || EncodeNextBlock();
   }
   return true;
 }
@@ -475,43 +530,154 @@ void StreamingRingliEncoder::WriteHeader(size_t chunk_size) {
   // TODO(szabadka): Make it work for big-endian machines.
   ringli_data_.append(reinterpret_cast<char*>(&ringli_header),
                       sizeof(RingliHeader));
+  // The compressed data is rarely longer than the input, and the buffers of
+  // the blocks are allocated here instead of growing them block by block.
+  ringli_data_.reserve(ringli_data_.size() + chunk_size);
+  const size_t num_channels = format_.number_of_channels;
+  const size_t block_size =
+      kRingliBlockSize * num_channels * (format_.bits_per_sample / 8);
+  const size_t num_blocks = (chunk_size + block_size - 1) / block_size;
+  if (config_.dconfig.use_predictive_coding) {
+    entropy_coder_->ReserveBlocks(num_blocks);
+  } else {
+    const size_t segment_size = config_.dconfig.ecparams.segment_size;
+    const size_t num_segment_blocks =
+        config_.dconfig.segmented() ? std::min(num_blocks, segment_size)
+                                    : num_blocks;
+    ringli_blocks_.assign(num_segment_blocks, RingliBlock(num_channels));
+  }
 }
 
 void StreamingRingliEncoder::CopyBlock(const uint8_t* data, size_t len,
                                        AudioBlock* block) {
   const size_t n_channels = format_.number_of_channels;
-  std::vector<int16_t> block_data(kRingliBlockSize * n_channels);
-  if (data) {
-    memcpy(block_data.data(), data, len);
-  }
+  // The samples missing from the end of the last block are zero.
+  const size_t num_samples = data ? len / sizeof(int16_t) : 0;
   for (int j = 0; j < kRingliBlockSize; j++) {
     for (int channel = 0; channel < n_channels; channel++) {
-      (*block)[channel][j] = block_data[j * n_channels + channel];
+      const size_t ix = j * n_channels + channel;
+      int16_t value = 0;
+      if (ix < num_samples) {
+        memcpy(&value, &data[ix * sizeof(value)], sizeof(value));
+      }
+      (*block)[channel][j] = value;
     }
   }
 }
 
+AudioBlock* StreamingRingliEncoder::NextInputBlock() {
+  return &input_blocks_[num_input_blocks_++ % input_blocks_.size()];
+}
+
 bool StreamingRingliEncoder::ProcessBlock(const RingliBlock& ringli_block) {
   if (config_.dconfig.use_predictive_coding) {
     return entropy_coder_->ProcessBlock(ringli_block, &ringli_data_);
   }
-  ringli_headers_.push_back(ringli_block.header);
-  ringli_blocks_.push_back(ringli_block);
+  // Assigning the block reuses the storage of the previous segment.
+  if (num_ringli_blocks_ < ringli_blocks_.size()) {
+    ringli_blocks_[num_ringli_blocks_] = ringli_block;
+  } else {
+    ringli_blocks_.push_back(ringli_block);
+  }
+  ++num_ringli_blocks_;
+  if (config_.dconfig.segmented() &&
+      num_ringli_blocks_ == config_.dconfig.ecparams.segment_size) {
+    return CompressSegment();
+  }
   return true;
 }
 
+bool StreamingRingliEncoder::CompressSegment() {
+  seek_table_.StartSegment(ringli_data_, entropy_source_.get());
+  const bool ok = CompressCoefficients(
+      absl::MakeConstSpan(ringli_blocks_.data(), num_ringli_blocks_),
+      format_.number_of_channels, config_.dconfig.ecparams,
+      entropy_source_.get(), &ringli_data_);
+  num_ringli_blocks_ = 0;
+  return ok;
+}
+
+void StreamingRingliEncoder::EncodeBlock(size_t n) {
+  const size_t ring_size = input_blocks_.size();
+  RingliBlock* encoded_block = &encoded_blocks_[n % ring_size];
+  if (config_.dconfig.use_predictive_coding) {
+    EncodePredictive(config_, input_blocks_[n % ring_size], encoded_block);
+  } else {
+    const AudioBlock& prev = input_blocks_[(n + ring_size - 1) % ring_size];
+    const AudioBlock& next = input_blocks_[(n + 1) % ring_size];
+    EncodeWithDCT(config_, *dct_, prev, input_blocks_[n % ring_size], next,
+                  encoded_block);
+  }
+}
+
+bool StreamingRingliEncoder::EncodeNextBlock() {
+  const size_t n = num_scheduled_blocks_++;
+  const size_t slot = n % block_done_.size();
+  if (!pool_) {
+    EncodeBlock(n);
+    block_done_[slot] = 1;
+    return ProcessPendingBlocks(0);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    block_done_[slot] = 0;
+  }
+  // The task is small enough for std::function to store it inline.
+  pool_->Schedule([this, n]() {
+    EncodeBlock(n);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      block_done_[n % block_done_.size()] = 1;
+    }
+    block_done_cv_.notify_all();
+  });
+  return ProcessPendingBlocks(kMaxPendingBlocksPerThread *
+                              pool_->NumThreads());
+}
+
+bool StreamingRingliEncoder::ProcessPendingBlocks(size_t max_pending) {
+  while (num_processed_blocks_ < num_scheduled_blocks_) {
+    const size_t slot = num_processed_blocks_ % block_done_.size();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (num_scheduled_blocks_ - num_processed_blocks_ > max_pending) {
+        block_done_cv_.wait(lock, [&]() { return block_done_[slot] != 0; });
+      } else if (!block_done_[slot]) {
+        return true;
+      }
+    }
+    ++num_processed_blocks_;
+    if (!ProcessBlock(encoded_blocks_[slot])) return false;
+  }
+  return true;
+}
+
+void StreamingRingliEncoder::WaitForPendingBlocks() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (size_t n = num_processed_blocks_; n < num_scheduled_blocks_; ++n) {
+    const size_t slot = n % block_done_.size();
+    block_done_cv_.wait(lock, [&]() { return block_done_[slot] != 0; });
+  }
+}
+
 bool StreamingRingliEncoder::ProcessInput(const uint8_t* data, size_t len) {
   return wav_reader_.ProcessInput(data, len);
 }
 
 bool StreamingRingliEncoder::Flush() {
   if (config_.dconfig.use_predictive_coding) {
-    return entropy_coder_->Flush(&ringli_data_);
+    return ProcessPendingBlocks(0) && entropy_coder_->Flush(&ringli_data_);
+  }
+  CopyBlock(nullptr, 0, NextInputBlock());
+  if (!EncodeNextBlock() || !ProcessPendingBlocks(0)) {
+    return false;
+  }
+  if (num_ringli_blocks_ > 0 || !config_.dconfig.segmented()) {
+    if (!CompressSegment()) {
+      return false;
+    }
   }
-  CopyBlock(nullptr, 0, next_.get());
-  ProcessBlock(EncodeWithDCT(config_, *dct_, *prev_, *current_, *next_));
-  CompressCoefficients(ringli_blocks_, format_.number_of_channels,
-                       config_.dconfig.ecparams, &ringli_data_);
+  seek_table_.Write(&ringli_data_);
   return true;
 }
 
@@ -17,7 +17,9 @@
 
 #include <stdbool.h>
 
+#include <condition_variable>  // NOLINT
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <vector>
 
@@ -29,6 +31,7 @@
 #include "common/ringli_header.h"
 #include "common/segment_curve.h"
 #include "common/streaming.h"
+#include "common/thread_pool.h"
 #include "common/wav_header.h"
 #include "common/wav_reader.h"
 #include "encode/entropy_encode.h"
@@ -50,7 +53,22 @@ struct RingliEncoderConfig {
   uint8_t pred_order_min = 2;
   uint8_t pred_order_max = kMaxPredictorOrder;
   bool use_noise_shaping = false;
+  // Number of worker threads used to encode blocks, 0 means that everything
+  // is done on the calling thread. Does not change the encoded bitstream.
+  size_t num_threads = 0;
   RingliDecoderConfig dconfig;
+
+  // The low effort levels cluster the histograms with a bounded set of
+  // candidate pairs, see HistogramCombine(). The default effort keeps the
+  // exhaustive search.
+  bool fast_clustering() const { return dconfig.effort <= 3; }
+  // Number of predictor orders that the block-predictive mode encodes to find
+  // the best one, zero means every order of the range. The candidates are
+  // the orders with the lowest bit cost estimated from the residual energies
+  // of CovarianceLattice.
+  int num_order_trials() const {
+    return dconfig.effort <= 3 ? 1 : dconfig.effort <= 5 ? 2 : 0;
+  }
 };
 
 class StreamingRingliEncoder : public StreamingInterface {
@@ -63,13 +81,33 @@ class StreamingRingliEncoder : public StreamingInterface {
   size_t OutputSize() const override;
   size_t CopyOutput(uint8_t* buffer, size_t len) override;
 
+  // Number of tasks that the worker threads of the encoder have finished.
+  size_t NumThreadedTasks() const {
+    return pool_ ? pool_->NumCompletedTasks() : 0;
+  }
+
  private:
   void InitForFormat();
   bool ProcessData(const uint8_t* data, size_t len, size_t chunk_pos,
                    size_t chunk_size);
   void WriteHeader(size_t chunk_size);
   void CopyBlock(const uint8_t* data, size_t len, AudioBlock* block);
+  // Returns the ring buffer entry of the next input block.
+  AudioBlock* NextInputBlock();
   bool ProcessBlock(const RingliBlock& ringli_block);
+  // Entropy codes the blocks in ringli_blocks_ and appends them to the output.
+  bool CompressSegment();
+  // Encodes block n from its input blocks into its ring buffer entry.
+  void EncodeBlock(size_t n);
+  // Encodes the next block, on the thread pool if there is one, and passes
+  // the finished blocks to ProcessBlock(). Returns false if the entropy coding
+  // of a finished block failed.
+  bool EncodeNextBlock();
+  // Passes the finished pending blocks to ProcessBlock() in order, and waits
+  // for the unfinished ones while there are more than max_pending of them.
+  bool ProcessPendingBlocks(size_t max_pending);
+  // Waits until the worker threads finish all pending blocks.
+  void WaitForPendingBlocks();
 
   // wav reader callbacks
   static bool ParseFormatCb(void* opaque, const uint8_t* data, size_t len,
@@ -86,15 +124,40 @@ class StreamingRingliEncoder : public StreamingInterface {
   size_t idx_ = 0;
 
   std::unique_ptr<DCT<kDctLength>> dct_;
-  std::unique_ptr<AudioBlock> prev_;
-  std::unique_ptr<AudioBlock> current_;
-  std::unique_ptr<AudioBlock> next_;
+  // Ring buffers of the input and encoded blocks of the DCT and
+  // block-predictive modes, block n is at index n % size. The ring is long
+  // enough that the input blocks are kept while a pending block reads them,
+  // the DCT mode also reads the blocks before and after the encoded one.
+  std::vector<AudioBlock> input_blocks_;
+  std::vector<RingliBlock> encoded_blocks_;
+  // Whether the encoded block of the entry is finished, guarded by mutex_.
+  std::vector<uint8_t> block_done_;
+  size_t num_input_blocks_ = 0;
+  size_t num_scheduled_blocks_ = 0;
+  size_t num_processed_blocks_ = 0;
+  std::mutex mutex_;
+  std::condition_variable block_done_cv_;
+  // Residuals of the current time slot in the fully streaming mode.
+  std::vector<int> encoded_samples_;
   std::unique_ptr<EntropyCoder> entropy_coder_;
+  // Blocks of the DCT mode that are not entropy coded yet, i.e. the first
+  // num_ringli_blocks_ blocks of the current segment, or of the whole stream
+  // if it is not segmented. The storage is allocated for the data length
+  // of the stream, and reused by the segments.
   std::vector<RingliBlock> ringli_blocks_;
-  std::vector<RingliBlockHeader> ringli_headers_;
-  std::vector<std::unique_ptr<Predictor>> predictors_;
+  size_t num_ringli_blocks_ = 0;
+  std::unique_ptr<EntropySource> entropy_source_;
+  SeekTableWriter seek_table_;
+  // Predictor of the fully streaming mode, and its predictions and
+  // dequantized samples of the current time slot.
+  std::unique_ptr<MultiChannelPredictor> predictor_;
+  std::vector<float> predictions_;
+  std::vector<float> dequantized_samples_;
   std::vector<NoiseShaper> noise_shapers_;
   std::vector<AdaptiveQuantizer> adaptive_quantizers_;
+  // Declared last so that the worker threads are joined before any of the
+  // state they use is destroyed.
+  std::unique_ptr<ThreadPool> pool_;
 };
 
 void RingliCompress(const std::string& wav_data,